@@ -33,6 +33,8 @@ measures that legally restrict others from doing anything the license permits.
 #include "CLI11.hpp"
 #include "Manager.h"
 #include "SimpleLogger.h"
+#include "TrainingDataReader.h"
+#include "exception/FileReaderException.h"
 #include <cstdlib>
 #include <string>
 
@@ -60,6 +62,7 @@ int SIPAI::parseArgs(int argc, char **argv) {
 
   CLI::App app{app_params.title};
   addOptions(app, app_params, network_params, version);
+  const auto *packCommand = addPackCommand(app);
 
   // Parsing
   try {
@@ -80,6 +83,7 @@ int SIPAI::parseArgs(int argc, char **argv) {
     return EXIT_VERSION;
   }
 
+  isPacking_ = packCommand->parsed();
   return EXIT_SUCCESS;
 }
 
@@ -168,6 +172,27 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
          "specified location."
          "\nSee the input_file parameter for the supported image formats.")
       ->check(valid_path);
+  app.add_option(
+         "--ifd,--input_folder", app_params.input_folder,
+         "The directory of the input images to be enhanced together, into "
+         "the output_folder directory, instead of the input_file.\nThe "
+         "network is imported once for all the images, and the "
+         "loading_workers load the next images while the current one is "
+         "enhanced."
+         "\nSee the input_file parameter for the supported image formats.")
+      ->check(CLI::ExistingDirectory);
+  app.add_option(
+         "--il,--input_list", app_params.input_list,
+         "A CSV file listing the input images to be enhanced together, into "
+         "the output_folder directory, instead of the input_file.\nThe "
+         "first column contains the input file path. No headers."
+         "\nSee the input_folder parameter.")
+      ->check(CLI::ExistingFile);
+  app.add_option(
+         "--ofd,--output_folder", app_params.output_folder,
+         "The directory where the images of the input_folder or the "
+         "input_list are saved once enhanced, with their input file name."
+         "\nThe directory is created if needed.");
   app.add_option("--os,--output_scale", app_params.output_scale,
                  "The scale of the output image.\nThis option "
                  "is used in conjunction with the Enhancer mode.")
@@ -193,6 +218,22 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
          "training CSV file or pre-prepared input files."
          "\nSee the input_file parameter for the supported image formats.")
       ->check(CLI::ExistingDirectory);
+  app.add_option(
+         "--tsh,--training_shards", app_params.training_data_shards,
+         "Specify the index file of training shards, made by the pack "
+         "command, to be used for training and testing instead of the "
+         "training file or folder.\nThe images are read sequentially from the "
+         "large shards files, which is much faster than opening one file per "
+         "image on network or spinning disks.")
+      ->check(CLI::ExistingFile);
+  app.add_option(
+         "--tc,--tile_cache", app_params.tile_cache_folder,
+         "Specify a directory where the training images are cached once "
+         "split, resized and converted, one binary tiles file per image."
+         "\nThe next epochs and the next trainings with the same images and "
+         "parameters map the tiles files in memory instead of decoding the "
+         "images again."
+         "\nThe directory is created if needed.");
   app.add_option(
          "--trf,--training_reduce_factor", app_params.training_reduce_factor,
          "Specify the factor by which to reduce the resolution of "
@@ -363,6 +404,13 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
                  "functions on output layer.")
       ->default_val(network_params.output_activation_alpha)
       ->check(CLI::Range(-100.0f, 100.0f));
+  app.add_option("--nr, --neighbors_radius", network_params.neighbors_radius,
+                 "The radius of the connections between the adjacent neurons "
+                 "of a layer: 1 for the 4-neighborhood, 1.5 for the "
+                 "8-neighborhood, larger for extended neighborhoods, 0 to "
+                 "disable. Ignored when importing a network.")
+      ->default_val(network_params.neighbors_radius)
+      ->check(CLI::Range(0.0f, 16.0f));
   app.add_option(
          "--eas, --epoch_auto_save", app_params.epoch_autosave,
          "The frequency (in number of epochs) at which the neural "
@@ -383,6 +431,55 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
              std::to_string(NO_IMAGE_SPLIT))
       ->default_val(app_params.image_split)
       ->check(CLI::NonNegativeNumber);
+  app.add_option(
+         "--stt,--stream_tile", app_params.stream_tile_size,
+         "Enhance the input_file by square tiles of this size, in pixels, "
+         "read and written by strips of rows, instead of the image_split "
+         "parts of the whole image.\nThe output_file must be a TIFF image "
+         "(.tif or .tiff), written by strips.\nThe binary PPM and PGM input "
+         "images, and the uncompressed 8-bit TIFF ones such as the "
+         "output_file, are memory mapped: the memory is then bounded by the "
+         "tile size times the image width, for the very large images.\nThe "
+         "other input images are decoded at once in 8 bits, the memory "
+         "growing with the image size, and OpenCV refuses to decode the "
+         "images over OPENCV_IO_MAX_IMAGE_PIXELS pixels (2^30 by default)."
+         "\n0 for no streaming enhancement.")
+      ->default_val(app_params.stream_tile_size)
+      ->check(CLI::NonNegativeNumber);
+  app.add_option(
+         "--sth,--stream_halo", app_params.stream_tile_halo,
+         "The halo of the stream_tile tiles, in pixels: each tile is "
+         "enhanced with this margin of its neighbor tiles, and the overlaps "
+         "are feather blended, without seams between the tiles.\nIt must be "
+         "less than half the stream_tile size. To avoid resizing the tiles, "
+         "the stream_tile size plus twice the halo should be the input layer "
+         "size.")
+      ->default_val(app_params.stream_tile_halo)
+      ->check(CLI::NonNegativeNumber);
+  app.add_option(
+         "--bs,--batch_size", app_params.batch_size,
+         "Number of image parts, possibly from different images, that are "
+         "propagated together as a mini-batch during the training.\nThe "
+         "weights are updated once per mini-batch, with the gradients "
+         "averaged over its parts.\n1 will update the weights after each "
+         "part.")
+      ->default_val(app_params.batch_size)
+      ->check(CLI::PositiveNumber);
+  app.add_option(
+         "--tw,--training_workers", app_params.training_workers,
+         "Number of training workers, that propagate their own mini-batches "
+         "of image parts concurrently, with their own layers values and "
+         "errors.\nBy default, the weights are updated once all the workers "
+         "mini-batches are propagated, with the gradients averaged over all "
+         "of them.")
+      ->default_val(app_params.training_workers)
+      ->check(CLI::PositiveNumber);
+  app.add_flag(
+      "--hw,--hogwild", app_params.enable_hogwild,
+      "Enables the Hogwild training of the training workers: each worker "
+      "updates the shared weights on its own, without any lock nor waiting "
+      "for the other workers.\nThis scales better with the CPU cores, at the "
+      "cost of some lost updates between the workers.");
   app.add_flag(
       "--pad, --padding", app_params.enable_padding,
       "Enable this flag to add padding to the image if the split factor is not "
@@ -401,9 +498,64 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
                "instead of loading and unloading them, resulting of training "
                "speed but at the cost of more memory,\n"
                "depending on the images total count and size.");
+  app.add_option(
+         "--sb,--shuffle_buffer", app_params.shuffle_buffer,
+         "Number of shards records shuffled together with the random_loading "
+         "flag, the shards order being shuffled too.\nA larger buffer gives a "
+         "better randomization, with less sequential reads.")
+      ->default_val(app_params.shuffle_buffer)
+      ->check(CLI::PositiveNumber);
+  app.add_option(
+         "--cml,--cache_memory_limit", app_params.cache_memory_limit,
+         "Memory limit in MB of the loaded training images kept for the next "
+         "epochs, the least recently used images being dropped first.\n0 "
+         "will not keep any image, except with the bulk_loading flag that "
+         "keeps them all.")
+      ->default_val(app_params.cache_memory_limit)
+      ->check(CLI::NonNegativeNumber);
+  app.add_option(
+         "--lw,--loading_workers", app_params.loading_workers,
+         "Number of background workers that load and prepare the next "
+         "training images, while the network trains on the current ones.\n0 "
+         "will load the images in the training thread.")
+      ->default_val(app_params.loading_workers)
+      ->check(CLI::NonNegativeNumber);
+  app.add_option("--pf,--prefetch", app_params.prefetch_size,
+                 "Maximum number of training images loaded by the loading "
+                 "workers ahead of the training.")
+      ->default_val(app_params.prefetch_size)
+      ->check(CLI::PositiveNumber);
+  app.add_flag(
+      "--ft,--fused_training", app_params.enable_fused_training,
+      "Enables the fused training step, that propagates the errors and "
+      "updates the weights in a single pass over the weights of each layer, "
+      "instead of a backward propagation pass followed by a weights update "
+      "pass.\nThe results are the same, with half the memory traffic on the "
+      "weights.");
+  app.add_flag(
+      "--fm,--fast_math", app_params.enable_fast_math,
+      "Enables the float polynomial approximations of exp and tanh in the "
+      "activation functions, instead of the exact double precision ones.\n"
+      "This speeds up the Sigmoid, Tanh and ELU activation functions, with "
+      "twice the values per vector instruction, and an error below 1e-6, "
+      "relative to the activation values, or absolute for the values below "
+      "1.");
   app.add_flag(
       "--par,--parallelism", app_params.enable_parallel,
       "Enables CPU parallel processing for neural network computations. ");
+  app.add_option("--th,--threads", app_params.threads,
+                 "Number of CPU threads of the parallel processing, shared by "
+                 "the layers computations with work stealing.\n0 will use all "
+                 "the hardware threads.")
+      ->default_val(app_params.threads)
+      ->check(CLI::NonNegativeNumber);
+  app.add_option("--seed", app_params.seed,
+                 "Seed of the random initialization of the network weights. "
+                 "The same seed gives the same network, whatever the CPU "
+                 "threads count.\n0 will use a random seed, written in the "
+                 "logs.")
+      ->default_val(app_params.seed)
+      ->check(CLI::NonNegativeNumber);
   app.add_flag("--vul,--vulkan", app_params.enable_vulkan,
                "Enables GPU acceleration by leveraging Vulkan "
                "for processing (experimental). "
@@ -417,7 +569,48 @@ void SIPAI::addOptions(CLI::App &app, AppParams &app_params,
                "of the CPU, except if Vulkan failed to initialize.");
 }
 
+CLI::App *SIPAI::addPackCommand(CLI::App &app) {
+  auto *pack = app.add_subcommand(
+      "pack", "Pack the images of the training_file or of the "
+              "training_folder in large shards files, with an index file, "
+              "to be used with the training_shards option.\nThe images files "
+              "are copied as is, without being decoded.");
+  pack->fallthrough();
+  pack->add_option("-o,--output", packIndex_,
+                   "The index file to write, the shards files being written "
+                   "next to it and named after it. Ex: -o shards/train.idx")
+      ->required();
+  pack->add_option("--ss,--shard_size", packShardSize_,
+                   "The size of a shard file, in MB.")
+      ->default_val(packShardSize_)
+      ->check(CLI::PositiveNumber);
+  return pack;
+}
+
+void SIPAI::pack() {
+  const auto &app_params = Manager::getConstInstance().app_params;
+  TrainingDataReader reader;
+  StringPool paths;
+  std::vector<DataEntry> datas;
+  bool withInputs = false;
+  if (!app_params.training_data_file.empty()) {
+    datas = reader.loadTrainingDataPaths(paths);
+    withInputs = true;
+  } else if (!app_params.training_data_folder.empty()) {
+    datas = reader.loadTrainingDataFolder(paths);
+  } else {
+    throw FileReaderException(
+        "The pack command requires a training file or a training folder");
+  }
+  TrainingShardWriter().pack(datas, paths, withInputs, packIndex_,
+                             packShardSize_ * 1024 * 1024);
+}
+
 void SIPAI::run() {
+  if (isPacking_) {
+    pack();
+    return;
+  }
   Manager::getInstance()
       .showHeader()
       .createOrImportNetwork()
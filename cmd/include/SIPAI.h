@@ -12,6 +12,9 @@
 #include "AppParams.h"
 #include "CLI11.hpp"
 #include "NeuralNetworkParams.h"
+#include "TrainingShard.h"
+#include <cstddef>
+#include <string>
 
 class SIPAI {
 public:
@@ -37,4 +40,16 @@ private:
   int parseArgs(int argc, char **argv);
   void addOptions(CLI::App &app, sipai::AppParams &app_params,
                   sipai::NeuralNetworkParams &network_params, bool &version);
+  CLI::App *addPackCommand(CLI::App &app);
+
+  /**
+   * @brief Pack the training images in shards, instead of running the neural
+   * network.
+   *
+   */
+  void pack();
+
+  bool isPacking_ = false;
+  std::string packIndex_ = "";
+  size_t packShardSize_ = sipai::SHARD_SIZE_MB;
 };
\ No newline at end of file
@@ -0,0 +1,25 @@
+/**
+ * @file ActivationFunctionType.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Activation function enum, without dependencies
+ * @date 2024-06-14
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+
+namespace sipai {
+/**
+ * @brief Activation Function enum.
+ * Beware the int values are used in the Vulkan GLSL shader
+ */
+enum class EActivationFunction {
+  ELU = 0,
+  LReLU = 1,
+  PReLU = 2,
+  ReLU = 3,
+  Sigmoid = 4,
+  Tanh = 5
+};
+} // namespace sipai
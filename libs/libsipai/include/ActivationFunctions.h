@@ -9,27 +9,15 @@
  */
 
 #pragma once
+#include "ActivationFunctionType.h"
 #include "Common.h"
 #include <algorithm>
+#include <cmath>
 #include <map>
-#include <math.h>
-#include <opencv2/opencv.hpp>
+#include <stdexcept>
 #include <string>
 
 namespace sipai {
-/**
- * @brief Activation Function enum.
- * Beware the int values are used in the Vulkan GLSL shader
- */
-enum class EActivationFunction {
-  ELU = 0,
-  LReLU = 1,
-  PReLU = 2,
-  ReLU = 3,
-  Sigmoid = 4,
-  Tanh = 5
-};
-
 const std::map<std::string, EActivationFunction, std::less<>> activation_map{
     {"ELU", EActivationFunction::ELU},
     {"LReLU", EActivationFunction::LReLU},
@@ -47,6 +35,15 @@ inline std::string getActivationStr(EActivationFunction activation) {
   return "";
 }
 
+/**
+ * @brief Activation function and its derivative for one channel value,
+ * specialized at compile time so that the layers kernels can inline them.
+ * The derivative is computed from the neuron value, as stored in the layer.
+ *
+ * @tparam F the activation function
+ */
+template <EActivationFunction F> struct Activation;
+
 /**
  * @brief the sigmoid function is commonly used as the
  * activation function during the forward propagation step. The reason for this
@@ -56,16 +53,14 @@ inline std::string getActivationStr(EActivationFunction activation) {
  * the sigmoid function itself: if σ(x) is the sigmoid function, then its
  * derivative σ'(x) can be computed as σ(x) * (1 - σ(x)).
  */
-inline auto sigmoid = [](const cv::Vec4f &rgba) {
-  cv::Vec4f result;
-  cv::exp(-rgba, result);
-  cv::divide(cv::Vec4f::all(1.0f), (cv::Vec4f::all(1.0f) + result), result);
-  return Common::clamp4f(result);
-};
-
-inline auto sigmoidDerivative = [](const cv::Vec4f &rgba) {
-  cv::Vec4f sigmoidValue = sigmoid(rgba);
-  return sigmoidValue.mul(cv::Vec4f::all(1.0f) - sigmoidValue);
+template <> struct Activation<EActivationFunction::Sigmoid> {
+  static float function(float v, float) {
+    return std::clamp(1.0f / (1.0f + std::exp(-v)), 0.0f, 1.0f);
+  }
+  static float derivative(float v, float alpha) {
+    const float sigmoidValue = function(v, alpha);
+    return sigmoidValue * (1.0f - sigmoidValue);
+  }
 };
 
 /**
@@ -73,16 +68,14 @@ inline auto sigmoidDerivative = [](const cv::Vec4f &rgba) {
  * sigmoid function but maps the input to a range between -1 and 1. It is often
  * used in the hidden layers of a neural network.
  */
-inline auto tanhFunc = [](const cv::Vec4f &rgba) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val,
-                 [](float v) { return (std::tanh(v) / 2.0f) + 0.5f; });
-  return result;
-};
-
-inline auto tanhDerivative = [](const cv::Vec4f &rgba) {
-  cv::Vec4f tanhValue = tanhFunc(rgba);
-  return cv::Vec4f::all(1.0f) - tanhValue.mul(tanhValue);
+template <> struct Activation<EActivationFunction::Tanh> {
+  static float function(float v, float) {
+    return (std::tanh(v) / 2.0f) + 0.5f;
+  }
+  static float derivative(float v, float alpha) {
+    const float tanhValue = function(v, alpha);
+    return 1.0f - tanhValue * tanhValue;
+  }
 };
 
 /**
@@ -91,16 +84,10 @@ inline auto tanhDerivative = [](const cv::Vec4f &rgba) {
  * popular in recent years because it helps to alleviate the vanishing gradient
  * problem.
  * Combine ReLU with clamping to [0, 1] range
- * @param rgba
- * @return ReLU
  */
-
-inline auto relu = [](const cv::Vec4f &rgba) { return Common::clamp4f(rgba); };
-inline auto reluDerivative = [](const cv::Vec4f &rgba) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val,
-                 [](float v) { return v > 0.0f ? 1.0f : 0.0f; });
-  return result;
+template <> struct Activation<EActivationFunction::ReLU> {
+  static float function(float v, float) { return std::clamp(v, 0.0f, 1.0f); }
+  static float derivative(float v, float) { return v > 0.0f ? 1.0f : 0.0f; }
 };
 
 /**
@@ -109,12 +96,13 @@ inline auto reluDerivative = [](const cv::Vec4f &rgba) {
  * ReLU problem where neurons become inactive and only output zero.
  * Combine LReLU with clamping to [0, 1] range
  */
-inline auto leakyRelu = [](const cv::Vec4f &rgba) {
-  return Common::clamp4f(rgba * 0.01f);
-};
-
-inline auto leakyReluDerivative = [](const cv::Vec4f &rgba) {
-  return Common::clamp4f(rgba, cv::Vec4f::all(0.01f), cv::Vec4f::all(1.0f));
+template <> struct Activation<EActivationFunction::LReLU> {
+  static float function(float v, float) {
+    return std::clamp(v * 0.01f, 0.0f, 1.0f);
+  }
+  static float derivative(float v, float) {
+    return std::clamp(v, 0.01f, 1.0f);
+  }
 };
 
 /**
@@ -123,20 +111,13 @@ inline auto leakyReluDerivative = [](const cv::Vec4f &rgba) {
  * This can give it a bit more flexibility and help it to learn more complex
  * patterns
  */
-inline auto parametricRelu = [](const cv::Vec4f &rgba, float alpha) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val, [alpha](float v) {
-    float value = std::max(alpha * v, v);
-    return std::clamp(value, 0.f, 1.f);
-  });
-  return result;
-};
-
-inline auto parametricReluDerivative = [](const cv::Vec4f &rgba, float alpha) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val,
-                 [alpha](float v) { return v > 0.0f ? 1.0f : alpha; });
-  return result;
+template <> struct Activation<EActivationFunction::PReLU> {
+  static float function(float v, float alpha) {
+    return std::clamp(std::max(alpha * v, v), 0.0f, 1.0f);
+  }
+  static float derivative(float v, float alpha) {
+    return v > 0.0f ? 1.0f : alpha;
+  }
 };
 
 /**
@@ -147,19 +128,42 @@ inline auto parametricReluDerivative = [](const cv::Vec4f &rgba, float alpha) {
  * “dead neuron” problem.
  *
  */
-inline auto elu = [](const cv::Vec4f &rgba, float alpha) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val, [alpha](float v) {
-    float value = v >= 0 ? v : alpha * (exp(v) - 1);
-    return std::clamp(value, 0.f, 1.f);
-  });
-  return result;
+template <> struct Activation<EActivationFunction::ELU> {
+  static float function(float v, float alpha) {
+    return std::clamp(v >= 0.0f ? v : alpha * (std::exp(v) - 1.0f), 0.0f,
+                      1.0f);
+  }
+  static float derivative(float v, float alpha) {
+    return v > 0.0f ? 1.0f : alpha * std::exp(v);
+  }
 };
 
-inline auto eluDerivative = [](const cv::Vec4f &rgba, float alpha) {
-  cv::Vec4f result;
-  std::transform(rgba.val, rgba.val + 4, result.val,
-                 [alpha](float v) { return v > 0.0f ? 1.0f : alpha * exp(v); });
-  return result;
-};
+/**
+ * @brief Call a function with the Activation<F> of an activation function, as
+ * its only argument. This is the single runtime dispatch of a layer pass, the
+ * function being instantiated for each activation function.
+ *
+ * @param activation the activation function
+ * @param function a generic lambda, taking the Activation<F> by value
+ */
+template <typename Function>
+decltype(auto) dispatchActivation(EActivationFunction activation,
+                                  Function &&function) {
+  switch (activation) {
+  case EActivationFunction::ELU:
+    return function(Activation<EActivationFunction::ELU>{});
+  case EActivationFunction::LReLU:
+    return function(Activation<EActivationFunction::LReLU>{});
+  case EActivationFunction::PReLU:
+    return function(Activation<EActivationFunction::PReLU>{});
+  case EActivationFunction::ReLU:
+    return function(Activation<EActivationFunction::ReLU>{});
+  case EActivationFunction::Sigmoid:
+    return function(Activation<EActivationFunction::Sigmoid>{});
+  case EActivationFunction::Tanh:
+    return function(Activation<EActivationFunction::Tanh>{});
+  default:
+    throw std::invalid_argument("Unimplemented Activation Function");
+  }
+}
 } // namespace sipai
\ No newline at end of file
@@ -0,0 +1,59 @@
+/**
+ * @file ActivationKernels.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Activation functions kernels, on whole raw float buffers
+ * @date 2024-06-09
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "ActivationFunctions.h"
+#include "CpuDispatch.h"
+#include <cstddef>
+
+namespace sipai::kernels {
+/**
+ * @brief Enable the float polynomial approximations of exp and tanh in the
+ * activation kernels, instead of the double precision ones, exact once
+ * rounded to float. Both are vectorized. Process wide.
+ *
+ * @param enable
+ */
+void setFastMath(bool enable);
+
+/**
+ * @brief Check if the activation kernels use the polynomial approximations.
+ */
+bool isFastMath();
+
+/**
+ * @brief Apply an activation function to n float values, with the
+ * instruction set selected by getCpuIsa(). values and outputs can be the same
+ * buffer.
+ *
+ * @param activation the activation function
+ * @param alpha the activation function alpha parameter
+ * @param values the input values
+ * @param outputs the activated values
+ * @param n count of float values, i.e. 4 per RGBA neuron
+ */
+void activate(EActivationFunction activation, float alpha, const float *values,
+              float *outputs, size_t n);
+
+/**
+ * @brief Apply an activation function derivative to n float values, with the
+ * instruction set selected by getCpuIsa(). values and derivatives can be the
+ * same buffer.
+ *
+ * @param activation the activation function
+ * @param alpha the activation function alpha parameter
+ * @param values the neurons values
+ * @param derivatives the derivatives
+ * @param n count of float values, i.e. 4 per RGBA neuron
+ */
+void activationDerivative(EActivationFunction activation, float alpha,
+                          const float *values, float *derivatives, size_t n);
+
+// The instruction set versions are declared by KernelsIsa.h
+} // namespace sipai::kernels
@@ -0,0 +1,224 @@
+/**
+ * @file ActivationKernelsImpl.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Whole buffer activation kernels, compiled once per instruction set.
+ * @date 2024-06-09
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+// No #pragma once: ActivationKernels.cpp and each Kernels*.cpp include this
+// file after defining SIPAI_KERNELS_ISA, the namespace of their instruction
+// set. Everything here stays in that namespace, so that no inline function
+// compiled with an instruction set can be picked by the linker for another one.
+#ifndef SIPAI_KERNELS_ISA
+#error "SIPAI_KERNELS_ISA must be defined before including this file"
+#endif
+
+#include "KernelsIsa.h"
+#include <cstdint>
+#include <cstring>
+
+namespace sipai::kernels::SIPAI_KERNELS_ISA {
+namespace {
+inline float clamp01(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+// std::bit_cast, without its inline template shared with the other files
+template <typename To, typename From> inline To bitCast(From from) {
+  To to;
+  std::memcpy(&to, &from, sizeof(to));
+  return to;
+}
+
+/**
+ * @brief Polynomial exp approximation (Cephes expf), without branches nor
+ * calls so that the loops using it are vectorized: e^x = 2^n * e^r, with
+ * r = x - n * ln(2) in [-ln(2)/2, ln(2)/2]. Relative error below 2e-7.
+ */
+inline float fastExp(float x) {
+  constexpr float LOG2E = 1.44269504088896341f;
+  constexpr float LN2_HI = 0.693359375f;
+  constexpr float LN2_LO = -2.12194440e-4f;
+  constexpr float ROUND = 12582912.0f; // 1.5 * 2^23, rounds to integer
+  x = x < -87.0f ? -87.0f : (x > 88.0f ? 88.0f : x);
+  const float t = x * LOG2E + ROUND;
+  const int32_t n = bitCast<int32_t>(t) - bitCast<int32_t>(ROUND);
+  const float fn = t - ROUND;
+  const float r = x - fn * LN2_HI - fn * LN2_LO;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  return p * bitCast<float>((n + 127) << 23);
+}
+
+/**
+ * @brief Polynomial exp in double precision, without branches nor calls as
+ * fastExp(), so that the exact loops are vectorized too: e^x = 2^n * e^r, with
+ * r in [-ln(2)/2, ln(2)/2] and the Taylor series of e^r to the degree 11.
+ * Relative error below 1e-15, i.e. the libm expf results once rounded to
+ * float, including the overflows to infinity and the underflows to 0.
+ */
+inline double exactExp(double x) {
+  constexpr double LOG2E = 1.4426950408889634;
+  constexpr double LN2_HI = 0.6931471803691238;
+  constexpr double LN2_LO = 1.9082149292705877e-10;
+  constexpr double ROUND = 6755399441055744.0; // 1.5 * 2^52, rounds to integer
+  x = x < -200.0 ? -200.0 : (x > 200.0 ? 200.0 : x);
+  const double t = x * LOG2E + ROUND;
+  const int64_t n = bitCast<int64_t>(t) - bitCast<int64_t>(ROUND);
+  const double fn = t - ROUND;
+  const double r = x - fn * LN2_HI - fn * LN2_LO;
+  double p = 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r * r + r + 1.0;
+  return p * bitCast<double>((n + 1023) << 52);
+}
+
+// exp and tanh, either exact in double precision, or with the float
+// polynomial approximation. tanh(x) / 2 + 0.5 is sigmoid(2x).
+struct ExactMath {
+  static float exp(float x) { return (float)exactExp(x); }
+  static float halfTanh(float x) {
+    return (float)(1.0 / (1.0 + exactExp(-2.0 * (double)x)));
+  }
+};
+
+struct FastMath {
+  static float exp(float x) { return fastExp(x); }
+  static float halfTanh(float x) { return 1.0f / (1.0f + fastExp(-2.0f * x)); }
+};
+
+// Same functions as the Activation<F> of ActivationFunctions.h, per float.
+template <typename Math> struct Sigmoid {
+  static float function(float v, float) {
+    return clamp01(1.0f / (1.0f + Math::exp(-v)));
+  }
+  static float derivative(float v, float alpha) {
+    const float s = function(v, alpha);
+    return s * (1.0f - s);
+  }
+};
+
+template <typename Math> struct Tanh {
+  static float function(float v, float) { return Math::halfTanh(v); }
+  static float derivative(float v, float alpha) {
+    const float t = function(v, alpha);
+    return 1.0f - t * t;
+  }
+};
+
+struct ReLU {
+  static float function(float v, float) { return clamp01(v); }
+  static float derivative(float v, float) { return v > 0.0f ? 1.0f : 0.0f; }
+};
+
+struct LReLU {
+  static float function(float v, float) { return clamp01(v * 0.01f); }
+  static float derivative(float v, float) {
+    return v < 0.01f ? 0.01f : (v > 1.0f ? 1.0f : v);
+  }
+};
+
+struct PReLU {
+  static float function(float v, float alpha) {
+    const float a = alpha * v;
+    return clamp01(a > v ? a : v);
+  }
+  static float derivative(float v, float alpha) {
+    return v > 0.0f ? 1.0f : alpha;
+  }
+};
+
+template <typename Math> struct ELU {
+  static float function(float v, float alpha) {
+    return clamp01(v >= 0.0f ? v : alpha * (Math::exp(v) - 1.0f));
+  }
+  static float derivative(float v, float alpha) {
+    return v > 0.0f ? 1.0f : alpha * Math::exp(v);
+  }
+};
+
+template <typename Op>
+void applyFunction(const float *values, float *outputs, size_t n,
+                   float alpha) {
+  for (size_t k = 0; k < n; ++k) {
+    outputs[k] = Op::function(values[k], alpha);
+  }
+}
+
+template <typename Op>
+void applyDerivative(const float *values, float *outputs, size_t n,
+                     float alpha) {
+  for (size_t k = 0; k < n; ++k) {
+    outputs[k] = Op::derivative(values[k], alpha);
+  }
+}
+
+template <typename Math, template <typename> class Apply>
+void dispatch(EActivationFunction activation, const float *values,
+              float *outputs, size_t n, float alpha) {
+  switch (activation) {
+  case EActivationFunction::ELU:
+    return Apply<ELU<Math>>::run(values, outputs, n, alpha);
+  case EActivationFunction::LReLU:
+    return Apply<LReLU>::run(values, outputs, n, alpha);
+  case EActivationFunction::PReLU:
+    return Apply<PReLU>::run(values, outputs, n, alpha);
+  case EActivationFunction::ReLU:
+    return Apply<ReLU>::run(values, outputs, n, alpha);
+  case EActivationFunction::Sigmoid:
+    return Apply<Sigmoid<Math>>::run(values, outputs, n, alpha);
+  case EActivationFunction::Tanh:
+    return Apply<Tanh<Math>>::run(values, outputs, n, alpha);
+  default:
+    // checked by ActivationKernels.cpp
+    return;
+  }
+}
+
+template <typename Op> struct FunctionOf {
+  static void run(const float *values, float *outputs, size_t n, float alpha) {
+    applyFunction<Op>(values, outputs, n, alpha);
+  }
+};
+
+template <typename Op> struct DerivativeOf {
+  static void run(const float *values, float *outputs, size_t n, float alpha) {
+    applyDerivative<Op>(values, outputs, n, alpha);
+  }
+};
+} // namespace
+
+void activate(EActivationFunction activation, float alpha, bool fastMath,
+              const float *values, float *outputs, size_t n) {
+  if (fastMath) {
+    dispatch<FastMath, FunctionOf>(activation, values, outputs, n, alpha);
+  } else {
+    dispatch<ExactMath, FunctionOf>(activation, values, outputs, n, alpha);
+  }
+}
+
+void activationDerivative(EActivationFunction activation, float alpha,
+                          bool fastMath, const float *values,
+                          float *derivatives, size_t n) {
+  if (fastMath) {
+    dispatch<FastMath, DerivativeOf>(activation, values, derivatives, n,
+                                     alpha);
+  } else {
+    dispatch<ExactMath, DerivativeOf>(activation, values, derivatives, n,
+                                      alpha);
+  }
+}
+} // namespace sipai::kernels::SIPAI_KERNELS_ISA
@@ -17,6 +17,7 @@
 namespace sipai {
 constexpr int NO_MAX_EPOCHS = 0;
 constexpr int NO_IMAGE_SPLIT = 0;
+constexpr size_t NO_SEED = 0;
 
 struct ShaderDefinition {
   sipai::EShader name;
@@ -29,10 +30,15 @@ struct AppParams {
   std::string version = "0.0.1";
   std::string input_file = "";
   std::string output_file = "";
+  std::string input_folder = "";  // batch enhancement
+  std::string input_list = "";    // batch enhancement, CSV list of images
+  std::string output_folder = ""; // batch enhancement
   std::string training_data_file = "";
   std::string training_data_folder = "";
+  std::string training_data_shards = ""; // shards index file
   std::string network_to_import = "";
   std::string network_to_export = "";
+  std::string tile_cache_folder = ""; // empty = no tile cache
   std::list<ShaderDefinition> shaders {
     { EShader::EnhancerForward1, "data/glsl/EnhancerShader-forward1.comp", "data/glsl/EnhancerShader-forward1.comp.in" },
     { EShader::EnhancerForward2, "data/glsl/EnhancerShader-forward2.comp", "data/glsl/EnhancerShader-forward2.comp.in" },
@@ -57,11 +63,24 @@ struct AppParams {
   size_t max_epochs_without_improvement = 2; // TODO: check for 0 = no max
   size_t epoch_autosave = 100;               // TODO: check for 0 = no autosave
   size_t image_split = NO_IMAGE_SPLIT;
+  size_t stream_tile_size = 0; // streaming enhancement, 0 = no streaming
+  size_t stream_tile_halo = 0; // streaming tiles overlap, on each side
   size_t training_reduce_factor = 4;
+  size_t batch_size = 1; // image parts per weights update
+  size_t training_workers = 1;
   bool random_loading = false;
   bool bulk_loading = false;
+  size_t shuffle_buffer = 1024; // shards records shuffled together
+  size_t cache_memory_limit = 0; // MB of loaded images kept, 0 = no cache
+  size_t loading_workers = 2; // 0 = loading in the training thread
+  size_t prefetch_size = 4;   // loaded images ahead of the training
   bool enable_vulkan = false;
   bool enable_parallel = true;
+  size_t threads = 0; // 0 = all the hardware threads
+  size_t seed = NO_SEED; // weights initialization, NO_SEED = random
+  bool enable_fused_training = false;
+  bool enable_hogwild = false;
+  bool enable_fast_math = false;
   bool enable_padding = false;
   bool verbose = false;
   bool verbose_debug = false;
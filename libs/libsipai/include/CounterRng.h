@@ -0,0 +1,75 @@
+/**
+ * @file CounterRng.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Counter-based random numbers generator
+ * @date 2024-06-18
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include <array>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+namespace sipai {
+/**
+ * @brief Streams of random numbers of a network layer.
+ */
+enum class ERngStream : uint32_t { Weights = 0, Neighbors = 1 };
+
+/**
+ * @brief The CounterRng class is a Philox4x32-10 counter-based random numbers
+ * generator (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"):
+ * the random numbers are a pure function of the seed and of a counter, here
+ * the position of a weight in the network. Without any state to share, the
+ * weights are initialized in parallel, with the same results whatever the
+ * threads count.
+ */
+class CounterRng {
+public:
+  using Block = std::array<uint32_t, 4>;
+
+  explicit CounterRng(uint64_t seed)
+      : key_{(uint32_t)seed, (uint32_t)(seed >> 32)} {}
+
+  /**
+   * @brief The 128 random bits of a counter.
+   *
+   * @param counter
+   * @return Block
+   */
+  Block operator()(Block counter) const;
+
+  /**
+   * @brief Four random numbers of a counter, with a normal distribution of
+   * mean 0 and standard deviation 1.
+   *
+   * @param counter
+   * @return cv::Vec4f
+   */
+  cv::Vec4f normal(const Block &counter) const;
+
+  /**
+   * @brief Fill in parallel a CV_32FC4 matrix with random numbers of a
+   * normal distribution of mean 0 and standard deviation 1. The element
+   * (row, col) of the matrix is keyed on the counter (col, row, layer,
+   * stream): for the layers weights, the neuron index and the weight index.
+   *
+   * @param mat the CV_32FC4 matrix to fill
+   * @param layer the layer index in the network
+   * @param stream the random numbers of the layer
+   */
+  void fillNormal(cv::Mat &mat, uint32_t layer, ERngStream stream) const;
+
+  /**
+   * @brief A non deterministic seed, from the system random device.
+   *
+   * @return uint64_t
+   */
+  static uint64_t randomSeed();
+
+private:
+  std::array<uint32_t, 2> key_;
+};
+} // namespace sipai
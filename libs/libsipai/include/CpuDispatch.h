@@ -0,0 +1,69 @@
+/**
+ * @file CpuDispatch.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Runtime selection of the instruction set of the CPU kernels
+ * @date 2024-06-12
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "KernelsIsa.h"
+#include <string>
+
+namespace sipai::kernels {
+/**
+ * @brief Instruction sets of the CPU kernels, from the slowest.
+ */
+enum class ECpuIsa { Baseline = 0, SSE42 = 1, AVX2 = 2, AVX512 = 3 };
+
+/**
+ * @brief Detect the best instruction set supported by the CPU and the OS,
+ * with cpuid and xgetbv.
+ *
+ * @return ECpuIsa
+ */
+ECpuIsa detectCpuIsa();
+
+/**
+ * @brief The instruction set used by the CPU kernels: the detected one,
+ * unless a lower one has been set.
+ *
+ * @return ECpuIsa
+ */
+ECpuIsa getCpuIsa();
+
+/**
+ * @brief Set the instruction set used by the CPU kernels, limited to the
+ * detected one. Process wide, for testing and benchmarking the kernels paths.
+ *
+ * @param isa
+ */
+void setCpuIsa(ECpuIsa isa);
+
+/**
+ * @brief Get the instruction set name.
+ *
+ * @param isa
+ * @return std::string
+ */
+std::string getCpuIsaStr(ECpuIsa isa);
+
+// Calls the function of a kernel for the selected instruction set
+#ifdef SIPAI_KERNELS_X86
+#define SIPAI_KERNELS_DISPATCH(function, ...)                                  \
+  switch (getCpuIsa()) {                                                       \
+  case ECpuIsa::AVX512:                                                        \
+    return avx512::function(__VA_ARGS__);                                      \
+  case ECpuIsa::AVX2:                                                          \
+    return avx2::function(__VA_ARGS__);                                        \
+  case ECpuIsa::SSE42:                                                         \
+    return sse42::function(__VA_ARGS__);                                       \
+  default:                                                                     \
+    return baseline::function(__VA_ARGS__);                                    \
+  }
+#else
+#define SIPAI_KERNELS_DISPATCH(function, ...)                                  \
+  return baseline::function(__VA_ARGS__);
+#endif
+} // namespace sipai::kernels
@@ -8,12 +8,26 @@
  *
  */
 #pragma once
-#include "Data.h"
+#include "StringPool.h"
+#include <cstdint>
 #include <vector>
 
 namespace sipai {
+/**
+ * @brief The images paths of a training data, as offsets in the paths pool of
+ * its list.
+ */
+struct DataEntry {
+  StringPool::Offset file_input = 0;
+  StringPool::Offset file_target = 0;
+  // location of the images record, if packed in a training shard
+  StringPool::Offset shard_file = 0;
+  uint64_t shard_offset = 0;
+};
+
 struct DataList {
-  std::vector<Data> data_training;
-  std::vector<Data> data_validation;
+  StringPool paths;
+  std::vector<DataEntry> data_training;
+  std::vector<DataEntry> data_validation;
 };
 } // namespace sipai
\ No newline at end of file
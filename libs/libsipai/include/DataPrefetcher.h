@@ -0,0 +1,77 @@
+/**
+ * @file DataPrefetcher.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Background loading of the training data
+ * @date 2024-06-20
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "Data.h"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief The DataPrefetcher class loads the data of a collection with a pool
+ * of background workers, ahead of their use, into a bounded queue. The data
+ * are given in the collection order, whatever the order the workers loaded
+ * them.
+ */
+class DataPrefetcher {
+public:
+  using Loader = std::function<std::shared_ptr<Data>(size_t index)>;
+
+  /**
+   * @brief Start the workers, loading the data 0 to count - 1.
+   *
+   * @param count the collection size
+   * @param workers the count of loading workers
+   * @param capacity the maximum count of loaded data not used yet
+   * @param loader the loading function of a data, called by the workers
+   */
+  DataPrefetcher(size_t count, size_t workers, size_t capacity, Loader loader);
+
+  /**
+   * @brief Stop the workers, after the data they are loading.
+   */
+  ~DataPrefetcher();
+
+  DataPrefetcher(DataPrefetcher const &) = delete;
+  void operator=(DataPrefetcher const &) = delete;
+
+  /**
+   * @brief Get the next data of the collection, waiting for its loading if
+   * required. Rethrows the exception of a worker that failed to load it.
+   *
+   * @return std::shared_ptr<Data> the next data, or nullptr at the end of the
+   * collection
+   */
+  std::shared_ptr<Data> next();
+
+private:
+  void work();
+
+  Loader loader_;
+  size_t count_;
+  size_t nextToLoad_ = 0;
+  size_t nextToUse_ = 0;
+  bool stop_ = false;
+
+  // The loaded data, in a ring of capacity slots: data i in slot i % capacity
+  std::vector<std::shared_ptr<Data>> slots_;
+  std::vector<std::exception_ptr> errors_;
+
+  std::mutex mutex_;
+  std::condition_variable loaded_;
+  std::condition_variable used_;
+  std::vector<std::thread> workers_;
+};
+} // namespace sipai
@@ -19,10 +19,16 @@ struct Image {
   size_t orig_width;
   int orig_type;
   int orig_channels;
+  // Memory of the data when not owned by the cv::Mat, such as a mapped file
+  std::shared_ptr<const void> storage = nullptr;
 
+  // Resize to a new Mat, the data being unchanged if already at the size
   void resize(size_t width, size_t height) {
-    if (width > 0 && height > 0) {
-      cv::resize(data, data, cv::Size((int)width, (int)height));
+    if (width > 0 && height > 0 &&
+        (data.cols != (int)width || data.rows != (int)height)) {
+      cv::Mat resized;
+      cv::resize(data, resized, cv::Size((int)width, (int)height));
+      data = resized;
     }
   }
 };
@@ -0,0 +1,96 @@
+/**
+ * @file ImageCache.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Memory budgeted cache of the loaded training images parts
+ * @date 2024-06-24
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "Data.h"
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace sipai {
+/**
+ * @brief The ImageCache class keeps the input and target images parts of the
+ * training data, up to a memory limit, evicting the least recently used ones
+ * first. Thread safe, for the loading workers.
+ */
+class ImageCache {
+public:
+  struct Statistics {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+  };
+
+  /**
+   * @brief Construct a new cache.
+   *
+   * @param limit the memory limit, in bytes
+   */
+  explicit ImageCache(size_t limit) : limit_(limit) {}
+
+  /**
+   * @brief Get the images parts of a key, and mark them as the most recently
+   * used.
+   *
+   * @param key
+   * @param input the cached input parts
+   * @param target the cached target parts
+   * @return true if cached
+   */
+  bool get(const std::string &key, ImageParts &input, ImageParts &target);
+
+  /**
+   * @brief Add the images parts of a key, evicting the least recently used
+   * ones if the memory limit is exceeded. Parts larger than the limit are not
+   * cached.
+   *
+   * @param key
+   * @param input
+   * @param target
+   */
+  void put(const std::string &key, const ImageParts &input,
+           const ImageParts &target);
+
+  /**
+   * @brief Memory of the images parts data, in bytes.
+   */
+  static size_t getBytes(const ImageParts &parts);
+
+  size_t getLimit() const { return limit_; }
+
+  size_t getUsed() const;
+
+  size_t getCount() const;
+
+  /**
+   * @brief Get the statistics since the last call, and reset them.
+   *
+   * @return Statistics
+   */
+  Statistics takeStatistics();
+
+private:
+  struct Entry {
+    std::string key;
+    ImageParts input;
+    ImageParts target;
+    size_t bytes = 0;
+  };
+
+  size_t limit_;
+  size_t used_ = 0;
+  Statistics statistics_;
+  // the most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  mutable std::mutex mutex_;
+};
+} // namespace sipai
@@ -37,6 +37,23 @@ public:
                        bool withPadding, size_t resize_x = 0,
                        size_t resize_y = 0) const;
 
+  /**
+   * @brief Decodes an image from an encoded file content in memory and
+   * returns it as Image parts, as loadImage() does.
+   *
+   * @param buffer The encoded image file content.
+   * @param imageName The image name, for the errors.
+   * @param split The split factor.
+   * @param withPadding Add padding to the splitted image parts.
+   * @param resize_x Optional resize the imported image on X (width).
+   * @param resize_y Optional resize the imported image on Y (height).
+   * @return Image The imported image parts, optionally resized.
+   */
+  ImageParts decodeImage(const std::vector<uchar> &buffer,
+                         const std::string &imageName, size_t split,
+                         bool withPadding, size_t resize_x = 0,
+                         size_t resize_y = 0) const;
+
   /**
    * @brief Generate an input image from a target image
    *
@@ -51,7 +68,8 @@ public:
                                 size_t resize_y = 0) const;
 
   /**
-   * @brief Split an OpenCV Mat to smaller Mats.
+   * @brief Split an OpenCV Mat to smaller Mats. The parts are views on the
+   * input Mat, not copies, except the edge parts that need a padding.
    *
    * @param inputImage The OpenCV Mat to split.
    * @param split The split factor.
@@ -70,9 +88,43 @@ public:
    * @param split The split factor.
    * @param resize_x Optional resize the exported image on X (width)
    * @param resize_y Optional resize the exported image on Y (height)
+   * @param withPadding The parts were padded: the padding is cropped out.
    */
   void saveImage(const std::string &imagePath, const ImageParts &imageParts,
-                 size_t split, size_t resize_x = 0, size_t resize_y = 0) const;
+                 size_t split, size_t resize_x = 0, size_t resize_y = 0,
+                 bool withPadding = false) const;
+
+  /**
+   * @brief Save a whole image, such as the joined parts of an image.
+   *
+   * @param imagePath The file path of the image to be saved.
+   * @param image The Image to save, not modified.
+   * @param resize_x Optional resize the exported image on X (width)
+   * @param resize_y Optional resize the exported image on Y (height)
+   */
+  void saveImage(const std::string &imagePath, Image image,
+                 size_t resize_x = 0, size_t resize_y = 0) const;
+
+  /**
+   * @brief Convert a decoded image, or a view on a part of it, to the BGRA
+   * floats in [0, 1] of the network values, as loadImage() does.
+   *
+   * @param mat The decoded image, of 1, 3 or 4 channels.
+   * @param dst The CV_32FC4 values, of the image size.
+   */
+  void convertToValues(const cv::Mat &mat, cv::Mat dst) const;
+
+  /**
+   * @brief Convert the network values back to the decoded image format, as
+   * saveImage() does before writing the image.
+   *
+   * @param values The CV_32FC4 values.
+   * @param orig_type The original image type.
+   * @param orig_channels The original image channels.
+   * @return cv::Mat The image, in the OpenCV channels order.
+   */
+  cv::Mat convertFromValues(const cv::Mat &values, int orig_type,
+                            int orig_channels) const;
 
   /**
    * @brief Concat the images parts into one image.
@@ -84,6 +136,15 @@ public:
    */
   Image joinImages(const ImageParts &images, int splitsX, int splitsY) const;
 
+  /**
+   * @brief Crop the padding of the right and bottom parts out of an image
+   * joined from padded parts, keeping the original image ratio.
+   *
+   * @param image The joined image, cropped as a view.
+   * @param split The split factor of the parts.
+   */
+  void cropPadding(Image &image, size_t split) const;
+
   /**
    * @brief Computes the loss between the output image
    * and the target image. The smaller loss, the better.
@@ -94,5 +155,10 @@ public:
    * @return The computed loss.
    */
   float computeLoss(const cv::Mat &outputData, const cv::Mat &targetData) const;
+
+private:
+  ImageParts toImageParts(const cv::Mat &mat, cv::Size origSize, size_t split,
+                          bool withPadding, size_t resize_x,
+                          size_t resize_y) const;
 };
 } // namespace sipai
\ No newline at end of file
@@ -0,0 +1,161 @@
+/**
+ * @file ImageStrips.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Images read and written by strips of rows, for the large images
+ * @date 2024-06-29
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief The ImageStripReader class reads the rows of an 8-bit image by
+ * strips, in the OpenCV channels order (BGR) of cv::imread.
+ *
+ * The binary PPM and PGM images (.ppm, .pgm, .pnm), and the uncompressed
+ * 8-bit TIFF and BigTIFF images (.tif, .tiff) with contiguous strips, such as
+ * the ones of the ImageStripWriter, are memory mapped, so that only the strips
+ * being read are in memory. The other images can't be decoded by strips: they
+ * are decoded once, in 8-bit, within the OpenCV decoding limit.
+ */
+class ImageStripReader {
+public:
+  /**
+   * @brief Open an image.
+   *
+   * @param path
+   */
+  explicit ImageStripReader(const std::string &path);
+
+  int width() const { return width_; }
+
+  int height() const { return height_; }
+
+  int channels() const { return channels_; }
+
+  /**
+   * @brief The type of the strips, and of the decoded image.
+   */
+  int type() const { return CV_MAKETYPE(CV_8U, channels_); }
+
+  /**
+   * @brief true if the strips are read from a memory mapped file, false if
+   * the image is decoded in memory.
+   */
+  bool isMapped() const { return file_ != nullptr; }
+
+  /**
+   * @brief Read some rows.
+   *
+   * @param y the first row
+   * @param rows the rows count
+   * @return cv::Mat the rows, valid until the next read
+   */
+  cv::Mat readRows(int y, int rows);
+
+private:
+  bool mapNetpbm(const std::string &path);
+
+  bool mapTiff(const std::string &path);
+
+  int width_ = 0;
+  int height_ = 0;
+  int channels_ = 0;
+  // memory mapped Netpbm or TIFF image
+  std::shared_ptr<MappedFile> file_;
+  const unsigned char *pixels_ = nullptr;
+  cv::Mat strip_;
+  // or decoded image
+  cv::Mat image_;
+};
+
+/**
+ * @brief Size of the strips of the TIFF images written, in bytes.
+ */
+constexpr size_t TIFF_STRIP_SIZE = 1024 * 1024;
+
+/**
+ * @brief The ImageStripWriter class writes an 8-bit image by strips of rows,
+ * as an uncompressed BigTIFF file, without keeping the image in memory. The
+ * rows are written as they come, whatever their count, and the TIFF directory
+ * at the end, with the file divided in strips of TIFF_STRIP_SIZE.
+ */
+class ImageStripWriter {
+public:
+  /**
+   * @brief Create the image file.
+   *
+   * @param path a .tif or .tiff path
+   * @param width
+   * @param height
+   * @param channels 1 (gray) or 3 (color)
+   */
+  ImageStripWriter(const std::string &path, int width, int height,
+                   int channels);
+
+  /**
+   * @brief Write the next rows.
+   *
+   * @param rows some rows of the image width, in the OpenCV channels order
+   * (BGR), of type CV_8UC(channels)
+   */
+  void writeRows(const cv::Mat &rows);
+
+  /**
+   * @brief Write the TIFF directory, once all the rows are written.
+   */
+  void close();
+
+  /**
+   * @brief true if the path is a TIFF file path, that can be written by
+   * strips.
+   */
+  static bool isSupported(const std::string &path);
+
+private:
+  std::string path_;
+  int width_;
+  int height_;
+  int channels_;
+  int written_ = 0;
+  std::ofstream file_;
+  cv::Mat rgb_;
+};
+
+/**
+ * @brief The position in an output image of a position in an input image,
+ * exact at the image edges.
+ *
+ * @param position the input position, in [0, size]
+ * @param size the input image size, along the axis
+ * @param outputSize the output image size, along the axis
+ */
+int toOutputPosition(int position, int size, int outputSize);
+
+/**
+ * @brief The feather weights of the output of a streaming tile along an axis.
+ * The tile [begin, end) is enhanced with a halo of its neighbors, and its
+ * weights are linear ramps over its overlaps with them, the complement of
+ * their own ramps, so that the weights of the overlapping tiles sum to 1.
+ *
+ * @param begin the tile begin, without its halo
+ * @param end the tile end, without its halo
+ * @param halo
+ * @param size the input image size, along the axis
+ * @param outputSize the output image size, along the axis
+ * @return std::vector<float> the weights of the output of the tile with its
+ * halo, from toOutputPosition(max(begin - halo, 0))
+ */
+std::vector<float> featherWeights(int begin, int end, int halo, int size,
+                                  int outputSize);
+} // namespace sipai
@@ -0,0 +1,60 @@
+/**
+ * @file InferenceSession.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Forward propagation context, with its own layers values
+ * @date 2024-06-28
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "NeuralNetwork.h"
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief The InferenceSession class runs the forward propagation of a network
+ * into its own layers values buffers, the network weights being shared and
+ * only read. Several threads can use their own sessions on the same network
+ * concurrently, as long as the network weights are not updated meanwhile.
+ * A session is not thread safe by itself.
+ */
+class InferenceSession {
+public:
+  /**
+   * @brief Construct a new session of a network, which must outlive it.
+   *
+   * @param network
+   */
+  explicit InferenceSession(const NeuralNetwork &network)
+      : network_(network) {}
+
+  /**
+   * @brief Forward propagation of a sample, such as an image part.
+   *
+   * @param inputValues The input layer neurons values, of any shape.
+   * @return The output layer neurons values, with the output layer shape. A
+   * view on the session buffers, valid until the next forward propagation of
+   * the session: clone it to keep it.
+   */
+  cv::Mat forwardPropagation(const cv::Mat &inputValues);
+
+  /**
+   * @brief Forward propagation of a mini-batch of samples at once.
+   *
+   * @param inputValues The input values, one row per sample of the input layer
+   * neurons values.
+   * @return The output values, one row per sample of the output layer neurons
+   * values. A view on the session buffers, as forwardPropagation().
+   */
+  cv::Mat forwardPropagationBatch(const cv::Mat &inputValues);
+
+  const NeuralNetwork &getNetwork() const { return network_; }
+
+private:
+  const NeuralNetwork &network_;
+
+  // The layers values of the last forward propagation, reused by the next ones
+  std::vector<cv::Mat> values_;
+};
+} // namespace sipai
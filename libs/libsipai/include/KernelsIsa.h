@@ -0,0 +1,81 @@
+/**
+ * @file KernelsIsa.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Declarations of the CPU kernels compiled once per instruction set
+ * @date 2024-06-14
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+// The Kernels*.cpp files are compiled with the -m flags of their instruction
+// set, and only include this file and the *KernelsImpl.h files: no OpenCV, no
+// standard containers nor strings, and nothing with a static initializer, as
+// any inline function or initializer compiled there could run on a CPU
+// without that instruction set.
+#pragma once
+#include "ActivationFunctionType.h"
+#include <cstddef>
+
+// The SSE4.2, AVX2 and AVX-512 versions of the kernels are only compiled on
+// x86, see CMakeLists.txt
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIPAI_KERNELS_X86
+#endif
+
+// Declares the functions of a kernel for each instruction set namespace, as
+// compiled by the Kernels*.cpp files
+#ifdef SIPAI_KERNELS_X86
+#define SIPAI_KERNELS_DECLARE_ISA(declaration)                                 \
+  namespace baseline {                                                         \
+  declaration                                                                  \
+  }                                                                            \
+  namespace sse42 {                                                            \
+  declaration                                                                  \
+  }                                                                            \
+  namespace avx2 {                                                             \
+  declaration                                                                  \
+  }                                                                            \
+  namespace avx512 {                                                           \
+  declaration                                                                  \
+  }
+#else
+#define SIPAI_KERNELS_DECLARE_ISA(declaration)                                 \
+  namespace baseline {                                                         \
+  declaration                                                                  \
+  }
+#endif
+
+namespace sipai::kernels {
+/**
+ * @brief Count of float per neuron value, as a neuron value is a RGBA
+ * cv::Vec4f.
+ */
+constexpr size_t CHANNELS = 4;
+
+// The instruction set versions of the activation kernels, see
+// ActivationKernelsImpl.h. The activation function is checked by the callers.
+SIPAI_KERNELS_DECLARE_ISA(
+    void activate(EActivationFunction activation, float alpha, bool fastMath,
+                  const float *values, float *outputs, size_t n);
+    void activationDerivative(EActivationFunction activation, float alpha,
+                              bool fastMath, const float *values,
+                              float *derivatives, size_t n);)
+
+// The instruction set versions of the layers loops, on a range of rows or
+// columns, see LayerKernelsImpl.h
+SIPAI_KERNELS_DECLARE_ISA(
+    void forwardRows(const float *weights, size_t ldw, const float *inputs,
+                     size_t ldi, float *outputs, size_t ldo, size_t n_in,
+                     size_t batch, size_t begin, size_t end);
+    void backwardColumns(const float *weights, size_t ldw, const float *errors,
+                         size_t lde, float *propagated, size_t ldp,
+                         size_t n_out, size_t batch, size_t begin, size_t end);
+    void fusedColumns(float *weights, size_t ldw, const float *errors,
+                      size_t lde, const float *inputs, size_t ldi,
+                      float *propagated, size_t ldp, float learningRate,
+                      size_t n_out, size_t batch, size_t begin, size_t end);
+    void sumSquaredDiff(const float *a, const float *b, size_t n,
+                        double sums[CHANNELS]);
+    void multiplyAccumulate(const float *a, const float *b, float scale,
+                            float *out, size_t n);)
+} // namespace sipai::kernels
@@ -9,6 +9,8 @@
  */
 #pragma once
 #include "ActivationFunctions.h"
+#include "NeighborStencil.h"
+#include "NetworkArena.h"
 #include "Neuron.h"
 #include "exception/NeuralNetworkException.h"
 #include <atomic>
@@ -26,6 +28,11 @@ using NeuronMat = std::vector<std::vector<Neuron>>;
 
 enum class LayerType { LayerInput, LayerHidden, LayerOutput };
 
+/**
+ * @brief Alignment in bytes of the layer weights rows, a cache line.
+ */
+constexpr int WEIGHTS_ALIGNMENT = ARENA_ALIGNMENT;
+
 const std::map<std::string, LayerType, std::less<>> layer_map{
     {"LayerInput", LayerType::LayerInput},
     {"LayerHidden", LayerType::LayerHidden},
@@ -47,8 +54,6 @@ public:
         neurons[y][x].index_y = y;
       }
     }
-    values = cv::Mat((int)size_y, (int)size_x, CV_32FC4);
-    errors = cv::Mat((int)size_y, (int)size_x, CV_32FC4);
   }
   virtual ~Layer() = default;
 
@@ -61,14 +66,31 @@ public:
   NeuronMat neurons;
 
   /**
-   * @brief 2D matrix of values, in format (x,y)
-   *
+   * @brief Weights of the connections with the previous layer, in format
+   * [neuron][previous layer neuron], i.e. a (total() x previous total())
+   * CV_32FC4 matrix. All the layer weights are in one 64-byte aligned block of
+   * the network arena, each row padded to 64 bytes, and each Neuron::weights
+   * is a view on its row. Empty for the input layer. Valid as long as the
+   * network is not destroyed or rebuilt.
+   */
+  cv::Mat weights;
+
+  /**
+   * @brief Connections of the neurons with their adjacent neurons in the
+   * layer, set by NeuralNetworkBuilder::addNeighbors(). Empty for the input
+   * layer.
+   */
+  NeighborStencil neighbors;
+
+  /**
+   * @brief 2D matrix of values, in format (x,y), a view on the network arena
+   * valid as long as the network is not destroyed or rebuilt
    */
   cv::Mat values;
 
   /**
-   * @brief 2D matrix of errors, in format (x,y)
-   *
+   * @brief 2D matrix of errors, in format (x,y), a view on the network arena
+   * valid as long as the network is not destroyed or rebuilt
    */
   cv::Mat errors;
 
@@ -131,8 +153,24 @@ public:
 
   EActivationFunction eactivationFunction = EActivationFunction::ReLU;
   float activationFunctionAlpha = 0.0f;
-  std::function<cv::Vec4f(cv::Vec4f)> activationFunction;
-  std::function<cv::Vec4f(cv::Vec4f)> activationFunctionDerivative;
+
+  /**
+   * @brief Apply the layer activation function to a neuron value, with the
+   * exact libm functions. The layers use the vectorized activation kernels
+   * instead, on whole buffers.
+   *
+   * @param rgba the neuron weighted sum
+   * @return cv::Vec4f the activated value
+   */
+  cv::Vec4f activationFunction(const cv::Vec4f &rgba) const;
+
+  /**
+   * @brief Apply the layer activation function derivative to a neuron value.
+   *
+   * @param rgba the neuron value
+   * @return cv::Vec4f the derivative
+   */
+  cv::Vec4f activationFunctionDerivative(const cv::Vec4f &rgba) const;
 
   const std::string UndefinedLayer = "UndefinedLayer";
 
@@ -150,16 +188,80 @@ public:
     }
   }
 
+  /**
+   * @brief Allocate the zeroed values and errors of the layer in the network
+   * arena.
+   *
+   * @param arena the network arena
+   */
+  void initValues(NetworkArena &arena);
+
+  /**
+   * @brief Allocate the contiguous weights of the layer for a previous layer
+   * of (size_x, size_y) neurons in the network arena, and bind the neurons
+   * weights views on it. The weights are set to zero.
+   *
+   * @param previous_size_x
+   * @param previous_size_y
+   * @param arena the network arena
+   */
+  void initWeights(size_t previous_size_x, size_t previous_size_y,
+                   NetworkArena &arena);
+
   /**
    * @brief Performs forward propagation using the previous layer.
    */
   virtual void forwardPropagation();
 
+  /**
+   * @brief Performs forward propagation of a batch of previous layer values,
+   * as a matrix product of the layer weights with the inputs.
+   *
+   * @param inputs previous layer values, previousLayer->total() CV_32FC4
+   * values per sample, one sample per row or a single (x,y) sample.
+   * @param outputs the layer values, (samples x total()) CV_32FC4, allocated
+   * if needed.
+   */
+  void forwardPropagation(const cv::Mat &inputs, cv::Mat &outputs) const;
+
   /**
    * @brief Performs backward propagation using the next layer.
    */
   virtual void backwardPropagation(const float &error_min,
                                    const float &error_max);
+
+  /**
+   * @brief Performs backward propagation of a batch of next layer errors, as
+   * a transposed matrix product of the next layer weights with the errors.
+   *
+   * @param nextErrors next layer errors, (samples x nextLayer->total())
+   * CV_32FC4.
+   * @param values the layer values, (samples x total()) CV_32FC4.
+   * @param errors the layer errors, (samples x total()) CV_32FC4, allocated
+   * if needed.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   */
+  void backwardPropagation(const cv::Mat &nextErrors, const cv::Mat &values,
+                           cv::Mat &errors, const float &error_min,
+                           const float &error_max) const;
+
+  /**
+   * @brief Computes the layer errors from the errors propagated back by the
+   * next layer: adds the adjacent neurons errors, then applies the derivative
+   * of the activation function and the clamping.
+   *
+   * @param propagated errors propagated by the next layer, (samples x
+   * total()) CV_32FC4.
+   * @param values the layer values, (samples x total()) CV_32FC4.
+   * @param errors the layer errors, (samples x total()) CV_32FC4.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   */
+  void computeErrorsFromPropagated(const cv::Mat &propagated,
+                                   const cv::Mat &values, cv::Mat &errors,
+                                   const float &error_min,
+                                   const float &error_max) const;
   /**
    * @brief Updates the weights of the neurons in this layer using the
    * previous layer and a learning rate.
@@ -168,6 +270,39 @@ public:
    */
   virtual void updateWeights(float learningRate);
 
+  /**
+   * @brief Updates the weights of the neurons in this layer from a batch of
+   * previous layer values and of this layer values and errors.
+   *
+   * @param inputs previous layer values, (samples x previousLayer->total())
+   * CV_32FC4.
+   * @param values the layer values, (samples x total()) CV_32FC4.
+   * @param errors the layer errors, (samples x total()) CV_32FC4.
+   * @param learningRate The learning rate to use when updating weights.
+   */
+  void updateWeights(const cv::Mat &inputs, const cv::Mat &values,
+                     const cv::Mat &errors, float learningRate);
+
+  /**
+   * @brief Fused backward propagation and weights update: in a single sweep
+   * over the weights, propagates the layer errors to the previous layer, then
+   * updates the weights. Same results than backwardPropagation() of the
+   * previous layer followed by updateWeights() of this layer, with half the
+   * memory traffic on the weights.
+   *
+   * @param inputs previous layer values, (samples x previousLayer->total())
+   * CV_32FC4.
+   * @param values the layer values, (samples x total()) CV_32FC4.
+   * @param errors the layer errors, (samples x total()) CV_32FC4.
+   * @param learningRate The learning rate to use when updating weights.
+   * @param propagated errors propagated to the previous layer, (samples x
+   * previousLayer->total()) CV_32FC4, to use with the previous layer
+   * computeErrorsFromPropagated(). Can be nullptr to only update the weights.
+   */
+  void updateWeightsAndPropagate(const cv::Mat &inputs, const cv::Mat &values,
+                                 const cv::Mat &errors, float learningRate,
+                                 cv::Mat *propagated);
+
   const std::string getLayerTypeStr() const {
     for (const auto &[key, mLayerType] : layer_map) {
       if (mLayerType == layerType) {
@@ -177,11 +312,10 @@ public:
     return UndefinedLayer;
   }
 
-  void
-  setActivationFunction(const std::function<cv::Vec4f(cv::Vec4f)> &function,
-                        const std::function<cv::Vec4f(cv::Vec4f)> &derivative) {
-    activationFunction = function;
-    activationFunctionDerivative = derivative;
+  void setActivationFunction(EActivationFunction function, float alpha) {
+    eactivationFunction = function;
+    activationFunctionAlpha = alpha;
   }
+
 };
 } // namespace sipai
\ No newline at end of file
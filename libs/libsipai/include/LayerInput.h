@@ -41,7 +41,8 @@ public:
     if (inputValues.total() != total()) {
       throw std::invalid_argument("Invalid input values size");
     }
-    values = inputValues;
+    // the image parts can be views on a larger image
+    values = inputValues.isContinuous() ? inputValues : inputValues.clone();
   }
 };
 } // namespace sipai
\ No newline at end of file
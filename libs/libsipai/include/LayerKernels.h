@@ -0,0 +1,164 @@
+/**
+ * @file LayerKernels.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Numeric kernels of the layers, on raw RGBA float buffers
+ * @date 2024-06-02
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "ActivationFunctions.h"
+#include "CpuDispatch.h"
+#include <cstddef>
+
+namespace sipai::kernels {
+/**
+ * @brief Enable the updates of weights shared by concurrent workers, as the
+ * Hogwild training workers: updateGemm(), fusedBackwardUpdate() and
+ * updateWeights() then write the weights with relaxed atomic_ref loads and
+ * stores, without vectorization. Process wide.
+ *
+ * @param enable
+ */
+void setSharedWeights(bool enable);
+
+/**
+ * @brief Check if the weights updates are for shared weights.
+ */
+bool isSharedWeights();
+
+/**
+ * @brief Forward matrix product of the layer weights with a batch of inputs,
+ * per RGBA channel: outputs[b][i] = sum_j(weights[i][j] * inputs[b][j]).
+ * Each weights row is read once for the whole batch, and there is no
+ * temporary allocation.
+ *
+ * @param weights (n_out x n_in) RGBA weights, rows of ldw floats
+ * @param ldw weights row stride, in floats
+ * @param inputs (batch x n_in) RGBA values, rows of ldi floats
+ * @param ldi inputs row stride, in floats
+ * @param outputs (batch x n_out) RGBA weighted sums, rows of ldo floats
+ * @param ldo outputs row stride, in floats
+ * @param n_out neurons of the layer
+ * @param n_in neurons of the previous layer
+ * @param batch samples count, 1 for a matrix-vector product
+ */
+void forwardGemm(const float *weights, size_t ldw, const float *inputs,
+                 size_t ldi, float *outputs, size_t ldo, size_t n_out,
+                 size_t n_in, size_t batch);
+
+/**
+ * @brief forwardGemm() with the activation function applied to the output
+ * neurons, by the vectorized activation kernels, as soon as the weighted sums
+ * of a block of rows are computed.
+ *
+ * @param activation the activation function of the layer
+ * @param alpha the activation function alpha parameter
+ */
+void forwardGemm(const float *weights, size_t ldw, const float *inputs,
+                 size_t ldi, float *outputs, size_t ldo, size_t n_out,
+                 size_t n_in, size_t batch, EActivationFunction activation,
+                 float alpha);
+
+/**
+ * @brief Backward transposed matrix product of the layer weights with a batch
+ * of layer errors, per RGBA channel:
+ * propagated[b][j] = sum_i(weights[i][j] * errors[b][i]).
+ * Each weights row is streamed once for the whole batch and
+ * scatter-accumulated into the propagated errors rows.
+ *
+ * @param weights (n_out x n_in) RGBA weights, rows of ldw floats
+ * @param ldw weights row stride, in floats
+ * @param errors (batch x n_out) RGBA errors of the layer, rows of lde floats
+ * @param lde errors row stride, in floats
+ * @param propagated (batch x n_in) RGBA errors for the previous layer, rows of
+ * ldp floats, overwritten
+ * @param ldp propagated row stride, in floats
+ * @param n_out neurons of the layer
+ * @param n_in neurons of the previous layer
+ * @param batch samples count
+ */
+void backwardGemmT(const float *weights, size_t ldw, const float *errors,
+                   size_t lde, float *propagated, size_t ldp, size_t n_out,
+                   size_t n_in, size_t batch);
+
+/**
+ * @brief Weights update from a batch of layer errors and previous layer
+ * values, per RGBA channel:
+ * weights[i][j] -= learningRate * sum_b(errors[b][i] * inputs[b][j]).
+ *
+ * @param weights (n_out x n_in) RGBA weights, rows of ldw floats, updated
+ * @param ldw weights row stride, in floats
+ * @param errors (batch x n_out) RGBA errors of the layer, rows of lde floats
+ * @param lde errors row stride, in floats
+ * @param inputs (batch x n_in) RGBA values of the previous layer, rows of ldi
+ * floats
+ * @param ldi inputs row stride, in floats
+ * @param learningRate the learning rate
+ * @param n_out neurons of the layer
+ * @param n_in neurons of the previous layer
+ * @param batch samples count
+ */
+void updateGemm(float *weights, size_t ldw, const float *errors, size_t lde,
+                const float *inputs, size_t ldi, float learningRate,
+                size_t n_out, size_t n_in, size_t batch);
+
+/**
+ * @brief Fused backwardGemmT() and updateGemm(), in a single sweep over the
+ * weights: each chunk of a weights row is first used to propagate the errors
+ * with its current values, then updated while still in cache.
+ *
+ * @param propagated (batch x n_in) RGBA errors for the previous layer, rows of
+ * ldp floats, overwritten. Can be nullptr to only update the weights.
+ * @param ldp propagated row stride, in floats
+ * @see backwardGemmT(), updateGemm() for the other parameters.
+ */
+void fusedBackwardUpdate(float *weights, size_t ldw, const float *errors,
+                         size_t lde, const float *inputs, size_t ldi,
+                         float *propagated, size_t ldp, float learningRate,
+                         size_t n_out, size_t n_in, size_t batch);
+
+/**
+ * @brief Sums of the squared differences of two RGBA buffers, per channel:
+ * sums[c] = sum_j((a[j][c] - b[j][c])^2). Blocks of neurons are summed in
+ * float, then accumulated in double.
+ *
+ * @param a n RGBA values
+ * @param b n RGBA values
+ * @param n count of RGBA values
+ * @param sums the 4 channels sums
+ */
+void sumSquaredDiff(const float *a, const float *b, size_t n,
+                    double sums[CHANNELS]);
+
+/**
+ * @brief Scaled element-wise product accumulation of n floats:
+ * out[k] += scale * a[k] * b[k]. Used by the neighbors stencil, on segments
+ * of rows of the layer.
+ *
+ * @param a n floats
+ * @param b n floats
+ * @param scale the products factor
+ * @param out n floats, accumulated
+ * @param n count of floats, i.e. 4 per RGBA neuron
+ */
+void multiplyAccumulate(const float *a, const float *b, float scale,
+                        float *out, size_t n);
+
+/**
+ * @brief multiplyAccumulate() on weights, as the neighbors stencil weights:
+ * weights[k] += scale * a[k] * b[k], updating shared weights if enabled by
+ * setSharedWeights().
+ *
+ * @param a n floats
+ * @param b n floats
+ * @param scale the products factor
+ * @param weights n floats, updated
+ * @param n count of floats, i.e. 4 per RGBA neuron
+ */
+void updateWeights(const float *a, const float *b, float scale,
+                   float *weights, size_t n);
+
+// The instruction set versions of the loops are declared by KernelsIsa.h
+} // namespace sipai::kernels
@@ -0,0 +1,179 @@
+/**
+ * @file LayerKernelsImpl.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Inner loops of the layers kernels, compiled once per instruction set.
+ * @date 2024-06-12
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+// No #pragma once: included by each Kernels*.cpp after defining
+// SIPAI_KERNELS_ISA, see ActivationKernelsImpl.h.
+#ifndef SIPAI_KERNELS_ISA
+#error "SIPAI_KERNELS_ISA must be defined before including this file"
+#endif
+
+#include "KernelsIsa.h"
+#include <cstddef>
+
+namespace sipai::kernels::SIPAI_KERNELS_ISA {
+namespace {
+// Neurons per unrolled step: 4 RGBA values, i.e. 16 floats, that the compiler
+// maps to SIMD registers.
+constexpr size_t UNROLL = 4;
+constexpr size_t LANES = UNROLL * CHANNELS;
+// Neurons per chunk of a weights row in the fused kernel, i.e. 4 KB of
+// weights that stay in the L1 cache between the propagation and the update.
+constexpr size_t CHUNK = 256;
+// Neurons per block of the loss kernel, summed in float before double.
+constexpr size_t LOSS_BLOCK = 4096;
+
+/**
+ * @brief RGBA dot product of n neurons, with independent accumulators to
+ * break the addition dependency chain.
+ */
+inline void dot4(const float *w, const float *x, size_t n, float *out) {
+  float acc[LANES] = {};
+  size_t j = 0;
+  for (; j + UNROLL <= n; j += UNROLL) {
+    const float *wj = w + j * CHANNELS;
+    const float *xj = x + j * CHANNELS;
+    for (size_t k = 0; k < LANES; ++k) {
+      acc[k] += wj[k] * xj[k];
+    }
+  }
+  for (; j < n; ++j) {
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      acc[c] += w[j * CHANNELS + c] * x[j * CHANNELS + c];
+    }
+  }
+  for (size_t c = 0; c < CHANNELS; ++c) {
+    out[c] = (acc[c] + acc[CHANNELS + c]) +
+             (acc[2 * CHANNELS + c] + acc[3 * CHANNELS + c]);
+  }
+}
+
+/**
+ * @brief RGBA scaled accumulation of n neurons: out[j] += w[j] * e.
+ */
+inline void axpy4(const float *w, const float *e, size_t n, float *out) {
+  float e4[LANES];
+  for (size_t k = 0; k < LANES; ++k) {
+    e4[k] = e[k % CHANNELS];
+  }
+  size_t j = 0;
+  for (; j + UNROLL <= n; j += UNROLL) {
+    const float *wj = w + j * CHANNELS;
+    float *oj = out + j * CHANNELS;
+    for (size_t k = 0; k < LANES; ++k) {
+      oj[k] += wj[k] * e4[k];
+    }
+  }
+  for (; j < n; ++j) {
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      out[j * CHANNELS + c] += w[j * CHANNELS + c] * e[c];
+    }
+  }
+}
+} // namespace
+
+void forwardRows(const float *weights, size_t ldw, const float *inputs,
+                 size_t ldi, float *outputs, size_t ldo, size_t n_in,
+                 size_t batch, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const float *w = weights + i * ldw;
+    for (size_t b = 0; b < batch; ++b) {
+      dot4(w, inputs + b * ldi, n_in, outputs + b * ldo + i * CHANNELS);
+    }
+  }
+}
+
+void backwardColumns(const float *weights, size_t ldw, const float *errors,
+                     size_t lde, float *propagated, size_t ldp, size_t n_out,
+                     size_t batch, size_t begin, size_t end) {
+  const size_t n = end - begin;
+  for (size_t b = 0; b < batch; ++b) {
+    float *p = propagated + b * ldp + begin * CHANNELS;
+    for (size_t k = 0; k < n * CHANNELS; ++k) {
+      p[k] = 0.0f;
+    }
+  }
+  for (size_t i = 0; i < n_out; ++i) {
+    const float *wj = weights + i * ldw + begin * CHANNELS;
+    for (size_t b = 0; b < batch; ++b) {
+      axpy4(wj, errors + b * lde + i * CHANNELS, n,
+            propagated + b * ldp + begin * CHANNELS);
+    }
+  }
+}
+
+void fusedColumns(float *weights, size_t ldw, const float *errors, size_t lde,
+                  const float *inputs, size_t ldi, float *propagated,
+                  size_t ldp, float learningRate, size_t n_out, size_t batch,
+                  size_t begin, size_t end) {
+  if (propagated != nullptr) {
+    for (size_t b = 0; b < batch; ++b) {
+      float *p = propagated + b * ldp + begin * CHANNELS;
+      for (size_t k = 0; k < (end - begin) * CHANNELS; ++k) {
+        p[k] = 0.0f;
+      }
+    }
+  }
+  for (size_t i = 0; i < n_out; ++i) {
+    for (size_t j = begin; j < end; j += CHUNK) {
+      const size_t n = end - j < CHUNK ? end - j : CHUNK;
+      float *wj = weights + i * ldw + j * CHANNELS;
+      if (propagated != nullptr) {
+        for (size_t b = 0; b < batch; ++b) {
+          axpy4(wj, errors + b * lde + i * CHANNELS, n,
+                propagated + b * ldp + j * CHANNELS);
+        }
+      }
+      for (size_t b = 0; b < batch; ++b) {
+        const float *e = errors + b * lde + i * CHANNELS;
+        const float delta[CHANNELS] = {
+            -learningRate * e[0], -learningRate * e[1], -learningRate * e[2],
+            -learningRate * e[3]};
+        axpy4(inputs + b * ldi + j * CHANNELS, delta, n, wj);
+      }
+    }
+  }
+}
+
+void sumSquaredDiff(const float *a, const float *b, size_t n,
+                    double sums[CHANNELS]) {
+  for (size_t c = 0; c < CHANNELS; ++c) {
+    sums[c] = 0.0;
+  }
+  for (size_t j = 0; j < n; j += LOSS_BLOCK) {
+    const size_t count = n - j < LOSS_BLOCK ? n - j : LOSS_BLOCK;
+    const float *aj = a + j * CHANNELS;
+    const float *bj = b + j * CHANNELS;
+    float acc[LANES] = {};
+    size_t k = 0;
+    for (; k + UNROLL <= count; k += UNROLL) {
+      for (size_t l = 0; l < LANES; ++l) {
+        const float d = aj[k * CHANNELS + l] - bj[k * CHANNELS + l];
+        acc[l] += d * d;
+      }
+    }
+    for (; k < count; ++k) {
+      for (size_t c = 0; c < CHANNELS; ++c) {
+        const float d = aj[k * CHANNELS + c] - bj[k * CHANNELS + c];
+        acc[c] += d * d;
+      }
+    }
+    for (size_t c = 0; c < CHANNELS; ++c) {
+      sums[c] += (double)((acc[c] + acc[CHANNELS + c]) +
+                          (acc[2 * CHANNELS + c] + acc[3 * CHANNELS + c]));
+    }
+  }
+}
+
+void multiplyAccumulate(const float *a, const float *b, float scale,
+                        float *out, size_t n) {
+  for (size_t k = 0; k < n; ++k) {
+    out[k] += scale * a[k] * b[k];
+  }
+}
+} // namespace sipai::kernels::SIPAI_KERNELS_ISA
@@ -31,6 +31,23 @@ public:
 
   void computeErrors(cv::Mat const &expectedValues);
 
+  /**
+   * @brief Compute the errors of some samples, given as rows of the layer
+   * neurons values.
+   *
+   * @param expectedValues the expected values, one row per sample
+   * @param values the neurons values, one row per sample
+   * @param errors the computed errors, one row per sample
+   */
+  void computeErrors(const cv::Mat &expectedValues, const cv::Mat &values,
+                     cv::Mat &errors) const;
+
+  /**
+   * @brief Get the output values, a view on the network arena valid as long
+   * as the network is not destroyed or rebuilt.
+   *
+   * @return cv::Mat
+   */
   cv::Mat getOutputValues() const { return values; }
 };
 } // namespace sipai
\ No newline at end of file
@@ -18,6 +18,7 @@
 #include <cstddef>
 #include <memory>
 #include <mutex>
+#include <tbb/global_control.h>
 
 namespace sipai {
 class Manager {
@@ -116,5 +117,8 @@ private:
   static std::unique_ptr<Manager> instance_;
 
   RunnerVisitorFactory runnerVisitorFactory_;
+
+  // Limits the TBB threads of the layers kernels, for the whole run
+  std::unique_ptr<tbb::global_control> parallelismControl_;
 };
 } // namespace sipai
\ No newline at end of file
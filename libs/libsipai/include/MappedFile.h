@@ -0,0 +1,56 @@
+/**
+ * @file MappedFile.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief File content mapped in memory
+ * @date 2024-06-27
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief The MappedFile class maps a file content in memory, unmapped with
+ * the last shared pointer on it. The mapping is private: the content can be
+ * modified in place (copy on write) without changing the file. The content
+ * is read in a buffer on Windows.
+ */
+class MappedFile {
+public:
+  /**
+   * @brief Map a file.
+   *
+   * @param path
+   * @return std::shared_ptr<MappedFile> nullptr if the file can't be mapped,
+   * or is empty
+   */
+  static std::shared_ptr<MappedFile> map(const std::string &path);
+
+  MappedFile(MappedFile const &) = delete;
+  void operator=(MappedFile const &) = delete;
+  ~MappedFile();
+
+  unsigned char *data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+  std::string_view view() const {
+    return std::string_view(reinterpret_cast<const char *>(data_), size_);
+  }
+
+private:
+  MappedFile() = default;
+
+  unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<unsigned char> buffer_;
+#endif
+};
+} // namespace sipai
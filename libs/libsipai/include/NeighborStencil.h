@@ -0,0 +1,178 @@
+/**
+ * @file NeighborStencil.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Connections between the adjacent neurons of a same layer
+ * @date 2024-06-14
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "CounterRng.h"
+#include "NetworkArena.h"
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief Position of a neighbor, relative to a neuron of the same layer.
+ */
+struct NeighborOffset {
+  int dx = 0;
+  int dy = 0;
+};
+
+/**
+ * @brief The NeighborStencil class holds the connections of the neurons of a
+ * layer with their adjacent neurons, as one dense plane of weights per
+ * neighbor direction, applied to whole layers as a stencil. The weights of
+ * the connections going out of the layer borders are zero and never used.
+ */
+class NeighborStencil {
+public:
+  /**
+   * @brief Set the neighborhood of a layer of (size_x, size_y) neurons: the
+   * neurons at an euclidean distance of at most radius. 1 is the
+   * 4-neighborhood (Von Neumann neighborhood), 1.5 the 8-neighborhood (Moore
+   * neighborhood), larger radius give extended neighborhoods and 0 no
+   * neighbors. The weights are zeros, allocated in the network arena.
+   *
+   * @param size_x width of the layer
+   * @param size_y height of the layer
+   * @param radius the neighborhood radius
+   * @param arena the network arena
+   */
+  void init(size_t size_x, size_t size_y, float radius, NetworkArena &arena);
+
+  /**
+   * @brief Get the offsets of the neighbors in a neighborhood radius, by
+   * distance, the horizontal neighbors first: left, right, up and down for
+   * the 4-neighborhood.
+   *
+   * @param radius the neighborhood radius
+   * @return std::vector<NeighborOffset>
+   */
+  static std::vector<NeighborOffset> getOffsets(float radius);
+
+  /**
+   * @brief Set random weights to the connections, with a normal distribution
+   * of mean 0 and standard deviation 1, keyed on the layer index and the
+   * weights positions.
+   *
+   * @param rng the network weights random numbers generator
+   * @param layer the layer index in the network
+   */
+  void randomize(const CounterRng &rng, uint32_t layer);
+
+  /**
+   * @brief Offsets of the neighbors, see getOffsets().
+   */
+  std::vector<NeighborOffset> offsets;
+
+  /**
+   * @brief All the weights of the connections, in one (offsets.size() *
+   * size_y x size_x) CV_32FC4 matrix of the arena: the planes stacked
+   * vertically.
+   */
+  cv::Mat weights;
+
+  /**
+   * @brief One (size_y x size_x) CV_32FC4 plane of weights per offset: the
+   * weights of the connections of each neuron with its neighbor at this
+   * offset, as a view on its rows of the weights.
+   */
+  std::vector<cv::Mat> planes;
+
+  bool empty() const { return offsets.empty(); }
+
+  /**
+   * @brief Count of the neighbors of a neuron, inside the layer.
+   */
+  size_t count(size_t x, size_t y) const;
+
+  /**
+   * @brief Apply a function to the connections of a neuron with its
+   * neighbors inside the layer, in the offsets order.
+   *
+   * @tparam Function a lambda (size_t nx, size_t ny, cv::Vec4f &weight)
+   * @param x the neuron column
+   * @param y the neuron row
+   * @param operation
+   */
+  template <typename Function>
+  void forEach(size_t x, size_t y, Function operation) {
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      size_t nx = 0;
+      size_t ny = 0;
+      if (neighborOf(x, y, offsets[k], nx, ny)) {
+        operation(nx, ny, planes[k].at<cv::Vec4f>((int)y, (int)x));
+      }
+    }
+  }
+
+  template <typename Function>
+  void forEach(size_t x, size_t y, Function operation) const {
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      size_t nx = 0;
+      size_t ny = 0;
+      if (neighborOf(x, y, offsets[k], nx, ny)) {
+        operation(nx, ny, planes[k].at<cv::Vec4f>((int)y, (int)x));
+      }
+    }
+  }
+
+  /**
+   * @brief Accumulate the weighted neighbors inputs of all the neurons of a
+   * sample: outputs[i] += sum_k(planes[k][i] * inputs[i + offsets[k]]).
+   *
+   * @param inputs the layer size_x * size_y RGBA values of the sample
+   * @param outputs the layer size_x * size_y RGBA values to accumulate into,
+   * not overlapping the inputs
+   */
+  void accumulate(const cv::Vec4f *inputs, cv::Vec4f *outputs) const;
+
+  /**
+   * @brief Update the weights of the connections from the values and errors
+   * of a sample: planes[k][i] -= learningRate * errors[i] *
+   * values[i + offsets[k]].
+   *
+   * @param values the layer size_x * size_y RGBA values of the sample
+   * @param errors the layer size_x * size_y RGBA errors of the sample
+   * @param learningRate the learning rate
+   */
+  void update(const cv::Vec4f *values, const cv::Vec4f *errors,
+              float learningRate);
+
+  /**
+   * @brief CSV of the weights of the connections of a neuron, in the offsets
+   * order, with the lasts columns filled with empty ",RGBA" up to
+   * max_weights.
+   */
+  std::string toStringCsv(size_t x, size_t y, size_t max_weights) const;
+
+private:
+  bool neighborOf(size_t x, size_t y, const NeighborOffset &offset,
+                  size_t &nx, size_t &ny) const {
+    const long long ix = (long long)x + offset.dx;
+    const long long iy = (long long)y + offset.dy;
+    if (ix < 0 || iy < 0 || ix >= (long long)size_x_ ||
+        iy >= (long long)size_y_) {
+      return false;
+    }
+    nx = (size_t)ix;
+    ny = (size_t)iy;
+    return true;
+  }
+
+  // Neurons rows [y0, y1) and columns [x0, x1) having a neighbor inside the
+  // layer at an offset.
+  void inside(const NeighborOffset &offset, size_t &x0, size_t &x1, size_t &y0,
+              size_t &y1) const;
+
+  size_t size_x_ = 0;
+  size_t size_y_ = 0;
+};
+} // namespace sipai
@@ -0,0 +1,90 @@
+/**
+ * @file NetworkArena.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Single allocation for the matrices of a neural network
+ * @date 2024-06-16
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "NeuralNetworkParams.h"
+#include <cstddef>
+#include <opencv2/opencv.hpp>
+
+namespace sipai {
+/**
+ * @brief Alignment in bytes of the matrices allocated in the arena, a cache
+ * line.
+ */
+constexpr int ARENA_ALIGNMENT = 64;
+
+/**
+ * @brief The NetworkArena class holds, in one zeroed buffer allocated once,
+ * the matrices of a network: the layers weights, neighbors weights, values
+ * and errors. The matrices are views on the arena, which must outlive them.
+ */
+class NetworkArena {
+public:
+  /**
+   * @brief Size in bytes of a (rows x cols) CV_32FC4 matrix in the arena.
+   *
+   * @param rows
+   * @param cols
+   * @param alignRows pad each row to ARENA_ALIGNMENT bytes
+   * @return size_t
+   */
+  static size_t matBytes(size_t rows, size_t cols, bool alignRows = false);
+
+  /**
+   * @brief Size in bytes of the matrices of a layer.
+   *
+   * @param size_x width of the layer
+   * @param size_y height of the layer
+   * @param previous_total neurons of the previous layer, 0 for the input
+   * layer
+   * @param neighbors_radius the neighborhood radius, 0 for the input layer
+   * @return size_t
+   */
+  static size_t layerBytes(size_t size_x, size_t size_y, size_t previous_total,
+                           float neighbors_radius);
+
+  /**
+   * @brief Size in bytes of the matrices of a network, from its parameters.
+   *
+   * @param params
+   * @return size_t
+   */
+  static size_t networkBytes(const NeuralNetworkParams &params);
+
+  /**
+   * @brief Allocate the zeroed arena, once.
+   *
+   * @param bytes the arena size, see networkBytes()
+   */
+  void reserve(size_t bytes);
+
+  /**
+   * @brief Get a zeroed (rows x cols) CV_32FC4 matrix from the arena,
+   * aligned to ARENA_ALIGNMENT bytes. Throws a NeuralNetworkException if the
+   * arena is too small.
+   *
+   * @param rows
+   * @param cols
+   * @param alignRows pad each row to ARENA_ALIGNMENT bytes
+   * @return cv::Mat a view on the arena, that dangles once the arena is
+   * destroyed or reserved again: clone it to keep it longer
+   */
+  cv::Mat allocate(size_t rows, size_t cols, bool alignRows = false);
+
+  size_t capacity() const { return capacity_; }
+
+  size_t used() const { return used_; }
+
+private:
+  cv::Mat buffer_;
+  uchar *data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t used_ = 0;
+};
+} // namespace sipai
@@ -10,6 +10,7 @@
 #pragma once
 #include "Common.h"
 #include "Layer.h"
+#include "NetworkArena.h"
 #include <algorithm>
 #include <atomic>
 #include <cstddef>
@@ -48,13 +49,19 @@ public:
    */
   std::vector<Layer *> layers;
 
+  /**
+   * @brief The memory of the layers weights, neighbors weights, values and
+   * errors, allocated once by NeuralNetworkBuilder::allocateArena().
+   */
+  NetworkArena arena;
+
   /**
    * @brief Performs forward propagation on the network using the given input
    * values.
    *
    * @param inputValues The input values for forward propagation.
    * @return A vector of output values from the output layer after forward
-   * propagation.
+   * propagation, a copy that does not depend on the network lifetime.
    */
   cv::Mat forwardPropagation(const cv::Mat &inputValues);
 
@@ -78,8 +85,141 @@ public:
   void updateWeights(float learning_rate);
 
   /**
-   * @brief max weights of all neurons, useful for csv export
-   * It is also the maximum layer neurons.
+   * @brief Performs backward propagation and updates the weights in a single
+   * pass over the weights of each layer, with the same results than
+   * backwardPropagation() followed by updateWeights().
+   *
+   * @param expectedValues The expected values for backward propagation.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   * @param learning_rate The learning rate
+   */
+  void backwardPropagationAndUpdateWeights(const cv::Mat &expectedValues,
+                                           const float &error_min,
+                                           const float &error_max,
+                                           float learning_rate);
+
+  /**
+   * @brief Performs forward propagation of a mini-batch of samples at once.
+   * The layers values of the batch are kept in batchValues.
+   *
+   * @param inputValues The input values, one row per sample of the input layer
+   * neurons values.
+   * @return The output values, one row per sample of the output layer neurons
+   * values.
+   */
+  cv::Mat forwardPropagationBatch(const cv::Mat &inputValues);
+
+  /**
+   * @brief Performs forward propagation of a mini-batch of samples at once,
+   * into the given layers values buffers. The network is not modified, so
+   * that several threads can propagate their own mini-batches concurrently.
+   *
+   * @param inputValues The input values, one row per sample of the input layer
+   * neurons values.
+   * @param values The layers values of the batch, one row per sample.
+   * @return The output values, one row per sample of the output layer neurons
+   * values.
+   */
+  cv::Mat forwardPropagationBatch(const cv::Mat &inputValues,
+                                  std::vector<cv::Mat> &values) const;
+
+  /**
+   * @brief Performs backward propagation of the mini-batch of the last
+   * forwardPropagationBatch(). The layers errors of the batch are kept in
+   * batchErrors.
+   *
+   * @param expectedValues The expected values, one row per sample of the
+   * output layer neurons values.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   */
+  void backwardPropagationBatch(const cv::Mat &expectedValues,
+                                const float &error_min, const float &error_max);
+
+  /**
+   * @brief Performs backward propagation of a mini-batch, into the given
+   * layers errors buffers. The network is not modified.
+   *
+   * @param expectedValues The expected values, one row per sample of the
+   * output layer neurons values.
+   * @param values The layers values of the batch forward propagation.
+   * @param errors The layers errors of the batch, one row per sample.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   */
+  void backwardPropagationBatch(const cv::Mat &expectedValues,
+                                const std::vector<cv::Mat> &values,
+                                std::vector<cv::Mat> &errors,
+                                const float &error_min,
+                                const float &error_max) const;
+
+  /**
+   * @brief Updates the weights once for the mini-batch of the last
+   * backwardPropagationBatch(), with the gradients accumulated over all the
+   * samples and averaged.
+   *
+   * @param learning_rate The learning rate
+   */
+  void updateWeightsBatch(float learning_rate);
+
+  /**
+   * @brief Updates the weights once for a mini-batch, with the gradients
+   * accumulated over all the samples and averaged.
+   *
+   * @param values The layers values of the batch forward propagation.
+   * @param errors The layers errors of the batch backward propagation.
+   * @param learning_rate The learning rate
+   */
+  void updateWeightsBatch(const std::vector<cv::Mat> &values,
+                          const std::vector<cv::Mat> &errors,
+                          float learning_rate);
+
+  /**
+   * @brief Performs backwardPropagationBatch() and updateWeightsBatch() in a
+   * single pass over the weights of each layer.
+   *
+   * @param expectedValues The expected values, one row per sample of the
+   * output layer neurons values.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   * @param learning_rate The learning rate
+   */
+  void backwardPropagationAndUpdateWeightsBatch(const cv::Mat &expectedValues,
+                                                const float &error_min,
+                                                const float &error_max,
+                                                float learning_rate);
+
+  /**
+   * @brief Performs backwardPropagationBatch() and updateWeightsBatch() in a
+   * single pass over the weights of each layer, with the given layers buffers.
+   *
+   * @param expectedValues The expected values, one row per sample of the
+   * output layer neurons values.
+   * @param values The layers values of the batch forward propagation.
+   * @param errors The layers errors of the batch, one row per sample.
+   * @param error_min error minimum
+   * @param error_max error maximum
+   * @param learning_rate The learning rate
+   */
+  void backwardPropagationAndUpdateWeightsBatch(
+      const cv::Mat &expectedValues, const std::vector<cv::Mat> &values,
+      std::vector<cv::Mat> &errors, const float &error_min,
+      const float &error_max, float learning_rate);
+
+  /**
+   * @brief Layers values of the current mini-batch, one row per sample.
+   */
+  std::vector<cv::Mat> batchValues;
+
+  /**
+   * @brief Layers errors of the current mini-batch, one row per sample.
+   */
+  std::vector<cv::Mat> batchErrors;
+
+  /**
+   * @brief max weights of all neurons, or neighbors weights with a large
+   * neighbors radius, useful for csv export
    * Updated during neural network import or creation
    */
   size_t max_weights = 0;
@@ -9,6 +9,7 @@
  */
 #pragma once
 #include "AppParams.h"
+#include "CounterRng.h"
 #include "NeuralNetwork.h"
 #include "NeuralNetworkImportExportFacade.h"
 #include "NeuralNetworkParams.h"
@@ -90,7 +91,15 @@ public:
   NeuralNetworkBuilder &bindLayers();
 
   /**
-   * @brief Initializes the weights of the neurons.
+   * @brief Allocate the network arena from the network parameters, and the
+   * layers values and errors in it. Must be called before addNeighbors() and
+   * initializeWeights(), that allocate in the arena too.
+   */
+  NeuralNetworkBuilder &allocateArena();
+
+  /**
+   * @brief Initializes the weights of the neurons, in parallel, from the
+   * seed of the app parameters: the same seed gives the same network.
    */
   NeuralNetworkBuilder &initializeWeights();
 
@@ -114,6 +123,10 @@ private:
   bool isImported = false;
   std::function<void(int)> progressCallback_ = {};
   int progressCallbackValue_ = 0;
+  std::unique_ptr<CounterRng> rng_ = nullptr;
+
+  // The weights random numbers generator, seeded on first use
+  const CounterRng &_getRng();
 
   void _incrementProgress(int increment) {
     if (progressCallback_) {
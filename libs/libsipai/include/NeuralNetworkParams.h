@@ -44,5 +44,11 @@ struct NeuralNetworkParams {
   float output_activation_alpha = 0.1f; // used for ELU and PReLU
   EActivationFunction hidden_activation_function = EActivationFunction::LReLU;
   EActivationFunction output_activation_function = EActivationFunction::LReLU;
+  /**
+   * @brief Radius of the neighborhood of the neurons connections in a same
+   * layer: 1 for the 4-neighborhood, 1.5 for the 8-neighborhood, 0 for none.
+   *
+   */
+  float neighbors_radius = 1.0f;
 };
 } // namespace sipai
\ No newline at end of file
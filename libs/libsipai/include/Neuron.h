@@ -9,7 +9,6 @@
  */
 #pragma once
 #include "ActivationFunctions.h"
-#include "NeuronConnection.h"
 #include <exception>
 #include <functional>
 #include <math.h>
@@ -22,15 +21,16 @@ namespace sipai {
 
 /**
  * @brief The Neuron class represents a neuron in a neural network. It contains
- * a value, bias, error, and a vector of weights. It also has methods for
- * initializing weights.
+ * a view on its weights, stored contiguously by its Layer. Its neighbors
+ * connections are in the NeighborStencil of its Layer.
  */
 class Neuron {
 public:
   // Default constructor
   Neuron() = default;
 
-  // The weights of the neuron
+  // The weights of the neuron, a view on its row of the Layer::weights
+  // (no memory owned)
   cv::Mat weights;
 
   // Index in current layer
@@ -42,26 +42,6 @@ public:
   mutable size_t neighborsIndex = 0;
   mutable size_t neighborsSize = 0;
 
-  // Connections to the adjacents neurons in the same layer, using
-  // 4-neighborhood (Von Neumann neighborhood). Could be improve to
-  // 8-neighborhood (Moore neighborhood) or Extended neighborhood (radius)
-  // later.
-  std::vector<NeuronConnection> neighbors;
-
-  /**
-   * @brief Initializes the weights of the neuron to a given size. The weights
-   * are randomized to break symmetry.
-   *
-   * @param size_x The new size in X of the weights vector.
-   * @param size_y The new size in Y of the weights vector.
-   */
-  void initWeights(size_t size_x, size_t size_y) {
-    weights = cv::Mat((int)size_y, (int)size_x, CV_32FC4);
-
-    // Random initialization
-    cv::randn(weights, cv::Vec4f::all(0), cv::Vec4f::all(1));
-  }
-
   std::string toStringCsv(size_t max_weights) const {
     std::ostringstream oss;
     for (int y = 0; y < weights.rows; y++) {
@@ -82,23 +62,5 @@ public:
     }
     return str;
   }
-
-  std::string toNeighborsStringCsv(size_t max_weights) const {
-    std::ostringstream oss;
-    for (const auto &neighbor : neighbors) {
-      for (int i = 0; i < 4; i++) {
-        oss << neighbor.weight[i] << ",";
-      }
-    }
-    // fill the lasts columns with empty ",RGBA"
-    for (size_t i = neighbors.size(); i < max_weights; ++i) {
-      oss << ",,,,";
-    }
-    std::string str = oss.str();
-    if (!str.empty()) {
-      str.pop_back(); // remove the extra comma
-    }
-    return str;
-  }
 };
 } // namespace sipai
\ No newline at end of file
@@ -10,7 +10,10 @@
 #pragma once
 #include "Common.h"
 #include "ImageHelper.h"
+#include "InferenceSession.h"
 #include "RunnerVisitor.h"
+#include <string>
+#include <vector>
 
 namespace sipai {
 class RunnerEnhancerOpenCVVisitor : public RunnerVisitor {
@@ -18,6 +21,56 @@ public:
   void visit() const override;
 
 private:
+  /**
+   * @brief Enhance all the images of the input folder or of the input list
+   * into the output folder, with the network imported once. The next images
+   * are loaded by the loading workers and the enhanced ones are saved in
+   * background, while the network enhances the current image. An image that
+   * fails is logged and skipped, and the batch fails at its end.
+   */
+  void _enhanceBatch() const;
+
+  /**
+   * @brief Enhance the input file by tiles of the stream tile size, read from
+   * the input image and written to the TIFF output file by strips of tiles
+   * rows, so that the whole image is never in memory. The tiles of a strip are
+   * dispatched to the worker threads. Each tile is enhanced with a halo of
+   * its neighbors, and the overlapping outputs are feather blended.
+   */
+  void _enhanceStreaming() const;
+
+  /**
+   * @brief Create an inference session per worker thread.
+   */
+  std::vector<InferenceSession> _createSessions() const;
+
+  /**
+   * @brief Forward propagation of the parts of an image, dispatched to the
+   * worker threads, each one with its own session.
+   *
+   * @param sessions the sessions of the workers, reused from an image to the
+   * next one
+   * @param inputParts
+   * @return Image the output parts joined in a single image
+   */
+  Image _enhance(std::vector<InferenceSession> &sessions,
+                 const ImageParts &inputParts) const;
+
+  /**
+   * @brief Forward propagation of a tile of a decoded image.
+   *
+   * @param session the session of the worker
+   * @param tile the decoded tile, a view on the image
+   * @param tileSize the size of the full tiles, to which the edge tiles are
+   * padded, in black if the padding is enabled, else by reflection
+   * @param outputSize the output size of the tile
+   * @return cv::Mat the output values of the tile, of the output size
+   */
+  cv::Mat _enhanceTile(InferenceSession &session, const cv::Mat &tile,
+                       int tileSize, const cv::Size &outputSize) const;
+
+  void _saveImage(const std::string &path, const Image &output) const;
+
   ImageHelper imageHelper_;
 };
 } // namespace sipai
\ No newline at end of file
@@ -11,7 +11,10 @@
 #include "Common.h"
 #include "ImageHelper.h"
 #include "RunnerTrainingVisitor.h"
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace sipai {
 class RunnerTrainingOpenCVVisitor : public RunnerTrainingVisitor {
@@ -24,6 +27,64 @@ private:
   float _training(size_t epoch, std::shared_ptr<Data> data, TrainingPhase phase,
                   bool isLossFrequency) const;
 
+  /**
+   * @brief A mini-batch of image parts, one row per part, with its layers
+   * values and errors buffers and its loss. The loss is averaged per image, as
+   * without mini-batches: each part weighs 1 / its image parts count in the
+   * loss, and lossComputed counts the images.
+   */
+  struct BatchBuffers {
+    BatchBuffers(size_t batchSize, size_t inputTotal, size_t outputTotal);
+
+    float averageLoss() const;
+
+    cv::Mat inputs;
+    cv::Mat targets;
+    std::vector<float> lossWeights;
+    std::vector<cv::Mat> values;
+    std::vector<cv::Mat> errors;
+    float loss = 0.0f;
+    size_t lossComputed = 0;
+  };
+
+  /**
+   * @brief Feeds the image parts of a training phase to the mini-batches, one
+   * image after the other. Thread safe, for the training workers: the images
+   * are loaded and the parts copied outside of the lock, so that the workers
+   * load different images concurrently.
+   */
+  class PartsFeeder {
+  public:
+    PartsFeeder(size_t epoch, TrainingPhase phase);
+
+    /**
+     * @brief Fill a mini-batch with the next parts.
+     *
+     * @param batch the mini-batch
+     * @return size_t the parts count, 0 at the end of the phase
+     */
+    size_t fill(BatchBuffers &batch);
+
+  private:
+    std::mutex mutex_;
+    size_t epoch_;
+    TrainingPhase phase_;
+    size_t lossFrequency_ = 1;
+    size_t counter_ = 0;
+    bool isLossFrequency_ = false;
+    std::shared_ptr<Data> data_;
+    size_t part_ = 0;
+    // the images loaded by the workers, not used yet
+    std::deque<std::shared_ptr<Data>> loaded_;
+  };
+
+  float batchTraining(size_t epoch, TrainingPhase phase) const;
+
+  float parallelTraining(size_t epoch, TrainingPhase phase) const;
+
+  void _batchTraining(BatchBuffers &batch, TrainingPhase phase,
+                      bool updateWeights) const;
+
   ImageHelper imageHelper_;
 };
 } // namespace sipai
\ No newline at end of file
@@ -0,0 +1,82 @@
+/**
+ * @file StringPool.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Strings stored in a single buffer
+ * @date 2024-06-27
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace sipai {
+/**
+ * @brief The StringPool class stores many strings, such as the images paths
+ * of the training data, null terminated in a single buffer, and identifies
+ * them by their offset in the buffer. The offset 0 is the empty string.
+ */
+class StringPool {
+public:
+  using Offset = uint64_t;
+
+  StringPool() { clear(); }
+
+  /**
+   * @brief Add a string.
+   *
+   * @param str
+   * @return Offset the offset of the added string
+   */
+  Offset add(std::string_view str) {
+    if (str.empty()) {
+      return 0;
+    }
+    const Offset offset = chars_.size();
+    chars_.append(str);
+    chars_.push_back('\0');
+    return offset;
+  }
+
+  /**
+   * @brief Add the strings of another pool.
+   *
+   * @param other
+   * @return Offset the value to add to the other pool offsets, except to the
+   * offset 0 of the empty string
+   */
+  Offset append(const StringPool &other) {
+    const Offset base = chars_.size() - 1;
+    chars_.append(other.chars_, 1);
+    return base;
+  }
+
+  /**
+   * @brief Get a string, valid until the next change of the pool.
+   *
+   * @param offset
+   * @return std::string_view
+   */
+  std::string_view get(Offset offset) const {
+    return std::string_view(chars_.data() + offset);
+  }
+
+  /**
+   * @brief Memory of the strings, in bytes.
+   */
+  size_t size() const { return chars_.size(); }
+
+  void reserve(size_t size) { chars_.reserve(size); }
+
+  void clear() {
+    chars_.assign(1, '\0');
+    chars_.shrink_to_fit();
+  }
+
+private:
+  std::string chars_;
+};
+} // namespace sipai
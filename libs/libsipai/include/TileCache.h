@@ -0,0 +1,93 @@
+/**
+ * @file TileCache.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief On disk cache of the preprocessed training images parts
+ * @date 2024-06-22
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "Data.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief The TileCache class stores on disk the input and target images
+ * parts of the training data, already split, resized and converted to
+ * floats, in a binary tiles file per data. The tiles files are memory mapped
+ * when loaded, so the parts are views on the files pages, without decoding
+ * nor copy.
+ *
+ * A tiles file is a TileFileHeader, followed by a TileHeader per part, the
+ * input parts then the target parts, and the 64-byte aligned parts data.
+ */
+class TileCache {
+public:
+  /**
+   * @brief Construct a new tile cache in a folder, created if needed.
+   *
+   * @param folder
+   */
+  explicit TileCache(const std::string &folder);
+
+  /**
+   * @brief Path of the tiles file of some images, from their paths, sizes
+   * and last modification times, and from the preprocessing parameters.
+   *
+   * @param images the images paths
+   * @param params the preprocessing parameters, as a string
+   * @return std::string the tiles file path, empty if an image is missing
+   */
+  std::string getPath(const std::vector<std::string> &images,
+                      const std::string &params) const;
+
+  /**
+   * @brief Load the images parts of a tiles file, mapped in memory.
+   *
+   * @param path the tiles file path
+   * @param input the input parts
+   * @param target the target parts
+   * @return true if loaded, false if the file does not exist or is invalid
+   */
+  bool load(const std::string &path, ImageParts &input,
+            ImageParts &target) const;
+
+  /**
+   * @brief Save the images parts in a tiles file. The file is written under
+   * a temporary name then renamed, so that it is never read partially.
+   *
+   * @param path the tiles file path
+   * @param input the input parts
+   * @param target the target parts
+   */
+  void save(const std::string &path, const ImageParts &input,
+            const ImageParts &target) const;
+
+  static constexpr char MAGIC[8] = {'S', 'I', 'P', 'A', 'I', 'T', 'C', '1'};
+
+  struct TileFileHeader {
+    char magic[8];
+    uint64_t input_count;
+    uint64_t target_count;
+  };
+
+  struct TileHeader {
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    int32_t orig_type;
+    int32_t orig_channels;
+    int32_t reserved;
+    uint64_t orig_height;
+    uint64_t orig_width;
+    uint64_t offset; // from the start of the file
+    uint64_t bytes;
+  };
+
+private:
+  std::string folder_;
+};
+} // namespace sipai
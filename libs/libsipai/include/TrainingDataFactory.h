@@ -10,14 +10,21 @@
 #pragma once
 #include "Common.h"
 #include "DataList.h"
+#include "DataPrefetcher.h"
+#include "ImageCache.h"
 #include "ImageHelper.h"
+#include "TileCache.h"
 #include "TrainingDataReader.h"
+#include "TrainingShard.h"
 #include "exception/TrainingDataFactoryException.h"
 #include <atomic>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <string>
+#include <vector>
 
 namespace sipai {
 class TrainingDataFactory {
@@ -41,13 +48,25 @@ public:
   };
 
   /**
-   * @brief Get the next input and target images for training.
+   * @brief Get the next input and target images for training. With loading
+   * workers, the next images are loaded in background, ahead of their use.
    *
    * @return Pointer to the next input and target images
    * for training, or nullptr if no more images are available.
    */
   std::shared_ptr<Data> next(const TrainingPhase &phase);
 
+  /**
+   * @brief Claim the next input and target images, as next(), but without
+   * loading them: the returned function loads them, and can be called by
+   * another thread, concurrently with the loading of the other images.
+   *
+   * @return std::function<std::shared_ptr<Data>()> the loading of the next
+   * images, or an empty function if no more images are available.
+   */
+  std::function<std::shared_ptr<Data>()>
+  nextLoader(const TrainingPhase &phase);
+
   /**
    * @brief Get training pairs collection size
    *
@@ -71,11 +90,19 @@ public:
   void loadData();
 
   /**
-   * @brief Reset training and validation counters
+   * @brief Reset training and validation counters, and stop the background
+   * loading of their images.
    *
    */
   void resetCounters();
 
+  /**
+   * @brief Log the images cache statistics since the last call, if the images
+   * are cached in memory.
+   *
+   */
+  void logCacheStatistics();
+
   /**
    * @brief Indicate if the collections are loaded
    *
@@ -99,28 +126,33 @@ public:
   void clear();
 
   /**
-   * @brief Shuffle a vector
+   * @brief Shuffle a vector. The shards records are shuffled by shards and
+   * within a window of records, to keep reading the shards sequentially.
    *
    * @param data
    */
-  void shuffle(TrainingPhase phase) {
-    switch (phase) {
-    case TrainingPhase::Training:
-      std::shuffle(dataList_.data_training.begin(),
-                   dataList_.data_training.end(), gen_);
-      break;
-    case TrainingPhase::Validation:
-      std::shuffle(dataList_.data_validation.begin(),
-                   dataList_.data_validation.end(), gen_);
-    default:
-      break;
-    }
-  }
+  void shuffle(TrainingPhase phase);
 
 private:
   TrainingDataFactory() : gen_(rd_()) {}
   static std::unique_ptr<TrainingDataFactory> instance_;
 
+  /**
+   * @brief Load the input and target images of a data of a collection.
+   * Called by the loading workers too: must not change the collection.
+   *
+   * @param datas the training or validation collection
+   * @param index the data index in the collection
+   * @return std::shared_ptr<Data>
+   */
+  std::shared_ptr<Data> load(const std::vector<DataEntry> &datas,
+                             size_t index) const;
+
+  std::shared_ptr<Data> makeData(const std::string &file_input,
+                                 const std::string &file_target,
+                                 const ImageParts &inputImageParts,
+                                 const ImageParts &targetImageParts) const;
+
   TrainingDataReader trainingDataReader_;
   ImageHelper imageHelper_;
   std::atomic<bool> isLoaded_ = false;
@@ -133,5 +165,19 @@ private:
 
   DataList dataList_;
   DataListType dataListType_;
+
+  // loaded images parts in memory, if bulk loading or a cache memory limit
+  std::unique_ptr<ImageCache> imageCache_;
+
+  // preprocessed images parts on disk, if a tile cache folder is set
+  std::unique_ptr<TileCache> tileCache_;
+  std::string tileCacheParams_;
+
+  // images files read from the shards, if a shards index is set
+  std::unique_ptr<TrainingShardReader> shardReader_;
+
+  // background loading of the next images, from the current indexes
+  std::unique_ptr<DataPrefetcher> trainingPrefetcher_;
+  std::unique_ptr<DataPrefetcher> validationPrefetcher_;
 };
 } // namespace sipai
\ No newline at end of file
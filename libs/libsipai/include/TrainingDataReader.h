@@ -10,20 +10,35 @@
 #pragma once
 #include "Common.h"
 #include "Data.h"
+#include "DataList.h"
+#include "StringPool.h"
 
 namespace sipai {
 class TrainingDataReader {
 public:
   /**
-   * @brief Reads the training data from a CSV file.
+   * @brief Reads the training data from a CSV file. The file is memory mapped
+   * and parsed by chunks of lines in parallel.
+   * @param paths The pool where the images paths are added.
    * @return A vector of data.
    */
-  std::vector<Data> loadTrainingDataPaths();
+  std::vector<DataEntry> loadTrainingDataPaths(StringPool &paths);
 
   /**
    * @brief Reads the training data from a target folder.
+   * @param paths The pool where the images paths are added.
    * @return A vector of data.
    */
-  std::vector<Data> loadTrainingDataFolder();
+  std::vector<DataEntry> loadTrainingDataFolder(StringPool &paths);
+
+  /**
+   * @brief Reads the training data from a shards index file.
+   * @param paths The pool where the images and shards paths are added.
+   * @param withInputs set if the shards have the input images, otherwise the
+   * inputs are generated from the targets.
+   * @return A vector of data, in the shards order.
+   */
+  std::vector<DataEntry> loadTrainingDataShards(StringPool &paths,
+                                                bool &withInputs);
 };
 } // namespace sipai
\ No newline at end of file
@@ -0,0 +1,130 @@
+/**
+ * @file TrainingShard.h
+ * @author Damien Balima (www.dams-labs.net)
+ * @brief Training images packed in large sequential shard files
+ * @date 2024-06-26
+ *
+ * @copyright Damien Balima (c) CC-BY-NC-SA-4.0 2024
+ *
+ */
+#pragma once
+#include "Data.h"
+#include "DataList.h"
+#include "StringPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace sipai {
+/**
+ * @brief Default size of a shard file, in MB.
+ */
+constexpr size_t SHARD_SIZE_MB = 256;
+
+/**
+ * @brief Bytes of a shard read ahead of the record being read.
+ */
+constexpr size_t SHARD_READAHEAD = 8 * 1024 * 1024;
+
+/**
+ * @brief Header of a record of a shard file, followed by the target image
+ * name, the input image file content, and the target image file content. The
+ * input content is empty if the input images are generated from the targets.
+ */
+struct ShardRecordHeader {
+  char magic[4];
+  uint32_t name_size;
+  uint64_t input_size;
+  uint64_t target_size;
+};
+
+/**
+ * @brief The TrainingShardWriter class packs the encoded input and target
+ * images files of a training data list into shard files, written
+ * sequentially, and an index file of their records. The images are not
+ * decoded.
+ *
+ * The index is a text file: a "SIPAI-SHARDS\t1\t<with inputs 0|1>" header
+ * line, then a "<shard file>\t<offset>\t<target>\t<input>" line per record,
+ * the shard files being next to the index.
+ */
+class TrainingShardWriter {
+public:
+  /**
+   * @brief Pack the images of a data list.
+   *
+   * @param datas the data list, with the input and target images paths
+   * @param paths the paths pool of the data list
+   * @param withInputs pack the input images, otherwise only the targets
+   * @param indexPath the index file path, the shards being named after it
+   * @param shardBytes the size from which a new shard is started
+   */
+  void pack(const std::vector<DataEntry> &datas, const StringPool &paths,
+            bool withInputs, const std::string &indexPath,
+            size_t shardBytes) const;
+};
+
+/**
+ * @brief The TrainingShardReader class reads the records of the shards of an
+ * index, with the next bytes of the shard read ahead by the system. Thread
+ * safe, for the loading workers.
+ */
+class TrainingShardReader {
+public:
+  TrainingShardReader() = default;
+  TrainingShardReader(TrainingShardReader const &) = delete;
+  void operator=(TrainingShardReader const &) = delete;
+  ~TrainingShardReader();
+
+  /**
+   * @brief Read an index file.
+   *
+   * @param indexPath
+   * @param paths the pool of the images and shards paths, each shard path
+   * being added once
+   * @param withInputs set if the shards have the input images
+   * @return std::vector<DataEntry> the records, with their shard file and
+   * offset, in the shards order
+   */
+  static std::vector<DataEntry> loadIndex(const std::string &indexPath,
+                                          StringPool &paths, bool &withInputs);
+
+  /**
+   * @brief Read the encoded images of a record.
+   *
+   * @param data a record of the index
+   * @param paths the paths pool of the index
+   * @param input the input image file content, empty if not packed
+   * @param target the target image file content
+   */
+  void read(const DataEntry &data, const StringPool &paths,
+            std::vector<uchar> &input, std::vector<uchar> &target) const;
+
+  /**
+   * @brief Shuffle the records, keeping the reads mostly sequential: the
+   * shards order is shuffled, then the records are shuffled within a window
+   * of the next buffer records.
+   *
+   * @param datas the records
+   * @param buffer the shuffle window, in records
+   * @param gen the random generator
+   */
+  static void shuffle(std::vector<DataEntry> &datas, size_t buffer,
+                      std::mt19937 &gen);
+
+  /**
+   * @brief Close the shards files.
+   */
+  void close();
+
+private:
+  int open(const std::string &shardFile) const;
+
+  mutable std::mutex mutex_;
+  mutable std::map<std::string, int> files_;
+};
+} // namespace sipai
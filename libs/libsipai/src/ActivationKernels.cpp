@@ -0,0 +1,41 @@
+#include "ActivationKernels.h"
+#include <atomic>
+#include <stdexcept>
+
+#define SIPAI_KERNELS_ISA baseline
+#include "ActivationKernelsImpl.h"
+#undef SIPAI_KERNELS_ISA
+
+using namespace sipai;
+using namespace sipai::kernels;
+
+namespace {
+std::atomic<bool> fastMath_ = false;
+
+// The instruction set versions ignore the unknown activation functions
+void checkActivation(EActivationFunction activation) {
+  if (activation < EActivationFunction::ELU ||
+      activation > EActivationFunction::Tanh) {
+    throw std::invalid_argument("Unimplemented Activation Function");
+  }
+}
+} // namespace
+
+void kernels::setFastMath(bool enable) { fastMath_ = enable; }
+
+bool kernels::isFastMath() { return fastMath_; }
+
+void kernels::activate(EActivationFunction activation, float alpha,
+                       const float *values, float *outputs, size_t n) {
+  checkActivation(activation);
+  SIPAI_KERNELS_DISPATCH(activate, activation, alpha, fastMath_, values,
+                         outputs, n)
+}
+
+void kernels::activationDerivative(EActivationFunction activation, float alpha,
+                                   const float *values, float *derivatives,
+                                   size_t n) {
+  checkActivation(activation);
+  SIPAI_KERNELS_DISPATCH(activationDerivative, activation, alpha, fastMath_,
+                         values, derivatives, n)
+}
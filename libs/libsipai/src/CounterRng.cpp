@@ -0,0 +1,68 @@
+#include "CounterRng.h"
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+using namespace sipai;
+
+namespace {
+constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+constexpr int PHILOX_ROUNDS = 10;
+
+// Uniform float in (0, 1], from the 24 high bits
+inline float toUniform(uint32_t bits) {
+  return ((float)(bits >> 8) + 1.0f) * (1.0f / 16777216.0f);
+}
+} // namespace
+
+CounterRng::Block CounterRng::operator()(Block counter) const {
+  uint32_t k0 = key_[0];
+  uint32_t k1 = key_[1];
+  for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+    const uint64_t p0 = (uint64_t)PHILOX_M0 * counter[0];
+    const uint64_t p1 = (uint64_t)PHILOX_M1 * counter[2];
+    counter = {(uint32_t)(p1 >> 32) ^ counter[1] ^ k0, (uint32_t)p1,
+               (uint32_t)(p0 >> 32) ^ counter[3] ^ k1, (uint32_t)p0};
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  return counter;
+}
+
+cv::Vec4f CounterRng::normal(const Block &counter) const {
+  // Box-Muller transform of two pairs of uniform numbers
+  const Block bits = (*this)(counter);
+  cv::Vec4f result;
+  for (int i = 0; i < 4; i += 2) {
+    const float radius = std::sqrt(-2.0f * std::log(toUniform(bits[i])));
+    const float theta =
+        2.0f * std::numbers::pi_v<float> * toUniform(bits[i + 1]);
+    result[i] = radius * std::cos(theta);
+    result[i + 1] = radius * std::sin(theta);
+  }
+  return result;
+}
+
+void CounterRng::fillNormal(cv::Mat &mat, uint32_t layer,
+                            ERngStream stream) const {
+  tbb::parallel_for(tbb::blocked_range<int>(0, mat.rows),
+                    [&](const tbb::blocked_range<int> &rows) {
+                      for (int row = rows.begin(); row < rows.end(); ++row) {
+                        auto values = mat.ptr<cv::Vec4f>(row);
+                        for (int col = 0; col < mat.cols; ++col) {
+                          values[col] = normal({(uint32_t)col, (uint32_t)row,
+                                                layer, (uint32_t)stream});
+                        }
+                      }
+                    });
+}
+
+uint64_t CounterRng::randomSeed() {
+  std::random_device device;
+  return ((uint64_t)device() << 32) | device();
+}
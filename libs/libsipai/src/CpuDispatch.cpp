@@ -0,0 +1,106 @@
+#include "CpuDispatch.h"
+#include <atomic>
+#include <cstdint>
+
+#ifdef SIPAI_KERNELS_X86
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace sipai::kernels;
+
+namespace {
+#ifdef SIPAI_KERNELS_X86
+struct CpuidRegisters {
+  uint32_t eax = 0;
+  uint32_t ebx = 0;
+  uint32_t ecx = 0;
+  uint32_t edx = 0;
+};
+
+CpuidRegisters cpuid(uint32_t leaf, uint32_t subleaf) {
+  CpuidRegisters regs;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, (int)leaf, (int)subleaf);
+  regs = {(uint32_t)info[0], (uint32_t)info[1], (uint32_t)info[2],
+          (uint32_t)info[3]};
+#else
+  __cpuid_count(leaf, subleaf, regs.eax, regs.ebx, regs.ecx, regs.edx);
+#endif
+  return regs;
+}
+
+// Registers states enabled by the OS, in XCR0
+uint64_t xgetbv() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t eax = 0;
+  uint32_t edx = 0;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+constexpr uint32_t BIT_SSE42 = 1u << 20;   // leaf 1, ecx
+constexpr uint32_t BIT_FMA = 1u << 12;     // leaf 1, ecx
+constexpr uint32_t BIT_OSXSAVE = 1u << 27; // leaf 1, ecx
+constexpr uint32_t BIT_AVX = 1u << 28;     // leaf 1, ecx
+constexpr uint32_t BIT_AVX2 = 1u << 5;     // leaf 7, ebx
+constexpr uint32_t BIT_AVX512F = 1u << 16; // leaf 7, ebx
+constexpr uint64_t XCR0_AVX = 0x6;         // SSE and AVX states
+constexpr uint64_t XCR0_AVX512 = 0xE6;     // and opmask, ZMM states
+#endif
+
+std::atomic<ECpuIsa> selectedIsa_{detectCpuIsa()};
+} // namespace
+
+ECpuIsa sipai::kernels::detectCpuIsa() {
+#ifdef SIPAI_KERNELS_X86
+  const uint32_t maxLeaf = cpuid(0, 0).eax;
+  const CpuidRegisters leaf1 = cpuid(1, 0);
+  if ((leaf1.ecx & BIT_SSE42) == 0) {
+    return ECpuIsa::Baseline;
+  }
+  if (maxLeaf < 7 || (leaf1.ecx & BIT_OSXSAVE) == 0 ||
+      (leaf1.ecx & BIT_AVX) == 0 || (leaf1.ecx & BIT_FMA) == 0) {
+    return ECpuIsa::SSE42;
+  }
+  const uint64_t xcr0 = xgetbv();
+  const CpuidRegisters leaf7 = cpuid(7, 0);
+  if ((xcr0 & XCR0_AVX) != XCR0_AVX || (leaf7.ebx & BIT_AVX2) == 0) {
+    return ECpuIsa::SSE42;
+  }
+  if ((xcr0 & XCR0_AVX512) != XCR0_AVX512 || (leaf7.ebx & BIT_AVX512F) == 0) {
+    return ECpuIsa::AVX2;
+  }
+  return ECpuIsa::AVX512;
+#else
+  return ECpuIsa::Baseline;
+#endif
+}
+
+ECpuIsa sipai::kernels::getCpuIsa() { return selectedIsa_; }
+
+void sipai::kernels::setCpuIsa(ECpuIsa isa) {
+  const ECpuIsa detected = detectCpuIsa();
+  selectedIsa_ = (int)isa <= (int)detected ? isa : detected;
+}
+
+std::string sipai::kernels::getCpuIsaStr(ECpuIsa isa) {
+  switch (isa) {
+  case ECpuIsa::AVX512:
+    return "AVX-512";
+  case ECpuIsa::AVX2:
+    return "AVX2";
+  case ECpuIsa::SSE42:
+    return "SSE4.2";
+  default:
+    return "baseline";
+  }
+}
@@ -0,0 +1,86 @@
+#include "DataPrefetcher.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace sipai;
+
+DataPrefetcher::DataPrefetcher(size_t count, size_t workers, size_t capacity,
+                               Loader loader)
+    : loader_(std::move(loader)), count_(count),
+      slots_(std::max(capacity, (size_t)1)),
+      errors_(std::max(capacity, (size_t)1)) {
+  workers = std::min(std::max(workers, (size_t)1), count_);
+  workers_.reserve(workers);
+  for (size_t i = 0; i < workers; ++i) {
+    workers_.emplace_back(&DataPrefetcher::work, this);
+  }
+}
+
+DataPrefetcher::~DataPrefetcher() {
+  {
+    std::scoped_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  used_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void DataPrefetcher::work() {
+  while (true) {
+    size_t index = 0;
+    {
+      // Wait for a data to load, and a free slot for it
+      std::unique_lock<std::mutex> lock(mutex_);
+      used_.wait(lock, [this] {
+        return stop_ || nextToLoad_ >= count_ ||
+               nextToLoad_ < nextToUse_ + slots_.size();
+      });
+      if (stop_ || nextToLoad_ >= count_) {
+        return;
+      }
+      index = nextToLoad_++;
+    }
+
+    std::shared_ptr<Data> data;
+    std::exception_ptr error;
+    try {
+      data = loader_(index);
+      if (!data) {
+        throw std::runtime_error("no data loaded");
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::scoped_lock<std::mutex> lock(mutex_);
+      slots_.at(index % slots_.size()) = std::move(data);
+      errors_.at(index % slots_.size()) = error;
+    }
+    loaded_.notify_all();
+  }
+}
+
+std::shared_ptr<Data> DataPrefetcher::next() {
+  std::shared_ptr<Data> data;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (nextToUse_ >= count_) {
+      return nullptr;
+    }
+    const size_t slot = nextToUse_ % slots_.size();
+    loaded_.wait(lock, [this, slot] {
+      return slots_.at(slot) != nullptr || errors_.at(slot) != nullptr;
+    });
+    if (errors_.at(slot)) {
+      std::rethrow_exception(errors_.at(slot));
+    }
+    data = std::move(slots_.at(slot));
+    slots_.at(slot) = nullptr;
+    nextToUse_++;
+  }
+  used_.notify_all();
+  return data;
+}
@@ -0,0 +1,63 @@
+#include "ImageCache.h"
+
+using namespace sipai;
+
+bool ImageCache::get(const std::string &key, ImageParts &input,
+                     ImageParts &target) {
+  std::scoped_lock<std::mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    statistics_.misses++;
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  input = it->second->input;
+  target = it->second->target;
+  statistics_.hits++;
+  return true;
+}
+
+void ImageCache::put(const std::string &key, const ImageParts &input,
+                     const ImageParts &target) {
+  const size_t bytes = getBytes(input) + getBytes(target);
+  std::scoped_lock<std::mutex> lock(mutex_);
+  if (bytes > limit_ || index_.contains(key)) {
+    return;
+  }
+  entries_.push_front(
+      {.key = key, .input = input, .target = target, .bytes = bytes});
+  index_[key] = entries_.begin();
+  used_ += bytes;
+  while (used_ > limit_) {
+    const auto &last = entries_.back();
+    used_ -= last.bytes;
+    index_.erase(last.key);
+    entries_.pop_back();
+    statistics_.evictions++;
+  }
+}
+
+size_t ImageCache::getBytes(const ImageParts &parts) {
+  size_t bytes = 0;
+  for (const auto &part : parts) {
+    bytes += part->data.total() * part->data.elemSize();
+  }
+  return bytes;
+}
+
+size_t ImageCache::getUsed() const {
+  std::scoped_lock<std::mutex> lock(mutex_);
+  return used_;
+}
+
+size_t ImageCache::getCount() const {
+  std::scoped_lock<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+ImageCache::Statistics ImageCache::takeStatistics() {
+  std::scoped_lock<std::mutex> lock(mutex_);
+  Statistics statistics = statistics_;
+  statistics_ = {};
+  return statistics;
+}
@@ -1,9 +1,17 @@
 #include "ImageHelper.h"
 #include "Common.h"
 #include "Data.h"
+#include "LayerKernels.h"
 #include "SimpleLogger.h"
 #include "exception/ImageHelperException.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <istream>
 #include <memory>
 #include <opencv2/core/matx.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -13,6 +21,163 @@
 
 using namespace sipai;
 
+namespace {
+struct ImageHeader {
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+};
+
+// Stream buffer reading an encoded image in memory, without copying it
+class MemoryStreamBuffer : public std::streambuf {
+public:
+  explicit MemoryStreamBuffer(const std::vector<uchar> &buffer) {
+    auto *data = reinterpret_cast<char *>(const_cast<uchar *>(buffer.data()));
+    setg(data, data, data + buffer.size());
+  }
+};
+
+uint32_t readBigEndian(const uchar *bytes, int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; i++) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+// Read the size of a 8 bits JPEG or PNG image from its header, the images
+// that can be decoded at a reduced resolution, with the channels count of the
+// decoding (the alpha channel is dropped). The size is 0 for the other images.
+ImageHeader readImageHeader(std::istream &stream) {
+  ImageHeader header;
+  uchar bytes[26];
+  if (!stream.read(reinterpret_cast<char *>(bytes), 2)) {
+    return header;
+  }
+  if (bytes[0] == 0xFF && bytes[1] == 0xD8) {
+    // JPEG: skip the segments up to the start of frame
+    while (stream.read(reinterpret_cast<char *>(bytes), 4) &&
+           bytes[0] == 0xFF) {
+      const uchar marker = bytes[1];
+      const auto length = (std::streamsize)readBigEndian(bytes + 2, 2);
+      if (length < 2) {
+        break;
+      }
+      if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+          marker != 0xC8 && marker != 0xCC) {
+        if (stream.read(reinterpret_cast<char *>(bytes), 6) &&
+            bytes[0] == 8 && (bytes[5] == 1 || bytes[5] == 3)) {
+          header.height = (int)readBigEndian(bytes + 1, 2);
+          header.width = (int)readBigEndian(bytes + 3, 2);
+          header.channels = bytes[5];
+        }
+        break;
+      }
+      stream.ignore(length - 2);
+    }
+  } else if (bytes[0] == 0x89 && bytes[1] == 'P') {
+    // PNG: the IHDR chunk comes first, with the bit depth and color type
+    // (0: gray, 2: RGB, 3: palette, 4: gray and alpha, 6: RGBA)
+    if (stream.read(reinterpret_cast<char *>(bytes) + 2, 24) &&
+        std::memcmp(bytes + 12, "IHDR", 4) == 0 && bytes[24] == 8 &&
+        bytes[25] <= 6 && bytes[25] != 1 && bytes[25] != 5) {
+      header.width = (int)readBigEndian(bytes + 16, 4);
+      header.height = (int)readBigEndian(bytes + 20, 4);
+      header.channels = bytes[25] == 0 ? 1 : 3;
+    }
+  }
+  return header;
+}
+
+// The largest reduced decoding scale keeping the parts larger than the resize
+int getReducedScale(const ImageHeader &header, size_t split, size_t resize_x,
+                    size_t resize_y) {
+  if (header.width <= 0 || header.height <= 0 || resize_x == 0 ||
+      resize_y == 0) {
+    return 1;
+  }
+  for (int scale : {8, 4, 2}) {
+    if ((size_t)header.width / split >= resize_x * scale &&
+        (size_t)header.height / split >= resize_y * scale) {
+      return scale;
+    }
+  }
+  return 1;
+}
+
+int getReadFlags(const ImageHeader &header, int scale) {
+  const bool gray = header.channels == 1;
+  switch (scale) {
+  case 2:
+    return gray ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+  case 4:
+    return gray ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+  case 8:
+    return gray ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+  default:
+    return cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH;
+  }
+}
+
+// The original image size, from the header if decoded at a reduced resolution
+cv::Size getOrigSize(const cv::Mat &mat, const ImageHeader &header,
+                     int scale) {
+  if (scale == 1) {
+    return mat.size();
+  }
+  // the EXIF orientation can rotate the decoded image
+  const int reducedWidth = (header.width + scale - 1) / scale;
+  if (mat.cols != reducedWidth && mat.rows == reducedWidth) {
+    return {header.height, header.width};
+  }
+  return {header.width, header.height};
+}
+
+// Convert an image part to BGRA floats in [0, 1], as the colors conversion
+// then the float conversion would do, in a single pass for 8 bits images
+void convertPart(const cv::Mat &part, cv::Mat dst) {
+  const int channels = part.channels();
+  if (part.depth() != CV_8U) {
+    cv::Mat bgra;
+    cv::cvtColor(part, bgra,
+                 channels == 1   ? cv::COLOR_GRAY2BGRA
+                 : channels == 3 ? cv::COLOR_RGB2BGRA
+                                 : cv::COLOR_RGBA2BGRA);
+    bgra.convertTo(dst, CV_32FC4, 1.0 / 255.0);
+    return;
+  }
+  static const auto lut = [] {
+    std::array<float, 256> values;
+    for (size_t i = 0; i < values.size(); i++) {
+      // the float product of convertTo(CV_32F, 1.0 / 255.0)
+      values[i] = (float)i * (float)(1.0 / 255.0);
+    }
+    return values;
+  }();
+  for (int y = 0; y < part.rows; y++) {
+    const uchar *src = part.ptr<uchar>(y);
+    auto *pixel = dst.ptr<cv::Vec4f>(y);
+    switch (channels) {
+    case 1:
+      for (int x = 0; x < part.cols; x++, src++) {
+        pixel[x] = {lut[src[0]], lut[src[0]], lut[src[0]], lut[255]};
+      }
+      break;
+    case 3:
+      for (int x = 0; x < part.cols; x++, src += 3) {
+        pixel[x] = {lut[src[2]], lut[src[1]], lut[src[0]], lut[255]};
+      }
+      break;
+    default:
+      for (int x = 0; x < part.cols; x++, src += 4) {
+        pixel[x] = {lut[src[2]], lut[src[1]], lut[src[0]], lut[src[3]]};
+      }
+      break;
+    }
+  }
+}
+} // namespace
+
 ImageParts ImageHelper::loadImage(const std::string &imagePath, size_t split,
                                   bool withPadding, size_t resize_x,
                                   size_t resize_y) const {
@@ -24,84 +189,100 @@ ImageParts ImageHelper::loadImage(const std::string &imagePath, size_t split,
     throw ImageHelperException("Could not find the image: " + imagePath);
   }
 
+  // Decode at a reduced resolution if much larger than the resize
+  std::ifstream stream(imagePath, std::ios::binary);
+  const auto header = readImageHeader(stream);
+  const int scale = getReducedScale(header, split, resize_x, resize_y);
+
   // Load the image
   try {
-    cv::Mat mat =
-        cv::imread(imagePath, cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+    cv::Mat mat = cv::imread(imagePath, getReadFlags(header, scale));
 
     if (mat.empty()) {
       throw ImageHelperException("Could not open the image: " + imagePath);
     }
-    Image orig{.orig_height = (size_t)mat.size().height,
-               .orig_width = (size_t)mat.size().width,
-               .orig_type = mat.type(),
-               .orig_channels = mat.channels()};
-
-    // Ensure the image is in BGR format
-    switch (mat.channels()) {
-    case 1:
-      cv::cvtColor(mat, mat, cv::COLOR_GRAY2BGRA);
-      break;
-    case 3:
-      cv::cvtColor(mat, mat, cv::COLOR_RGB2BGRA);
-      break;
-    case 4:
-      cv::cvtColor(mat, mat, cv::COLOR_RGBA2BGRA);
-      break;
-    default:
-      SimpleLogger::LOG_WARN(
-          "Non implemented image colors channels processing: ", mat.channels());
-      break;
-    }
+    return toImageParts(mat, getOrigSize(mat, header, scale), split,
+                        withPadding, resize_x, resize_y);
+  } catch (const cv::Exception &e) {
+    throw ImageHelperException("Error loading image: " + imagePath + ": " +
+                               e.what());
+  }
+}
 
-    // If the image has only 3 channels (BGR), create and merge an alpha channel
-    if (mat.channels() == 3) {
-      cv::Mat alphaMat(mat.size(), CV_8UC1, cv::Scalar(255));
-      std::vector<cv::Mat> channels{mat, alphaMat};
-      cv::Mat bgraMat;
-      cv::merge(channels, bgraMat);
-      mat = bgraMat;
-    }
+ImageParts ImageHelper::decodeImage(const std::vector<uchar> &buffer,
+                                    const std::string &imageName, size_t split,
+                                    bool withPadding, size_t resize_x,
+                                    size_t resize_y) const {
+  if (split == 0) {
+    throw ImageHelperException("internal exception: split 0.");
+  }
 
-    // Convert to floating-point range [0, 1] with 4 channels
-    mat.convertTo(mat, CV_32FC4, 1.0 / 255.0);
-    if (mat.channels() != 4) {
-      throw ImageHelperException("incorrect image channels");
-    }
+  // Decode at a reduced resolution if much larger than the resize
+  MemoryStreamBuffer streamBuffer(buffer);
+  std::istream stream(&streamBuffer);
+  const auto header = readImageHeader(stream);
+  const int scale = getReducedScale(header, split, resize_x, resize_y);
 
-    // cv::imshow("Original Image step 3", mat);
-    // cv::waitKey(1000 * 60 * 2);
-
-    ImageParts imagesParts;
-    auto matParts = splitImage(mat, split, withPadding);
-    for (auto &matPart : matParts) {
-      Image image{.data = matPart,
-                  .orig_height = orig.orig_height,
-                  .orig_width = orig.orig_width,
-                  .orig_type = orig.orig_type,
-                  .orig_channels = orig.orig_channels};
-      image.resize(resize_x, resize_y);
-      auto image_ptr = std::make_shared<Image>(image);
-      imagesParts.push_back(image_ptr);
+  try {
+    cv::Mat mat = cv::imdecode(buffer, getReadFlags(header, scale));
+    if (mat.empty()) {
+      throw ImageHelperException("Could not decode the image: " + imageName);
     }
-
-    // Rq. C++ use Return Value Optimization (RVO) to avoid the extra copy or
-    // move operation associated with the return.
-    return imagesParts;
+    return toImageParts(mat, getOrigSize(mat, header, scale), split,
+                        withPadding, resize_x, resize_y);
   } catch (const cv::Exception &e) {
-    throw ImageHelperException("Error loading image: " + imagePath + ": " +
+    throw ImageHelperException("Error decoding image: " + imageName + ": " +
                                e.what());
   }
 }
 
+ImageParts ImageHelper::toImageParts(const cv::Mat &mat, cv::Size origSize,
+                                     size_t split, bool withPadding,
+                                     size_t resize_x, size_t resize_y) const {
+  if (mat.channels() != 1 && mat.channels() != 3 && mat.channels() != 4) {
+    SimpleLogger::LOG_WARN(
+        "Non implemented image colors channels processing: ", mat.channels());
+    throw ImageHelperException("incorrect image channels");
+  }
+
+  // Split the decoded image in views, then convert each part to BGRA floats
+  // in [0, 1], padded if needed, and resize it
+  ImageParts imagesParts;
+  auto matParts = splitImage(mat, split, false);
+  const cv::Size partSize = matParts.front().size();
+  for (auto &matPart : matParts) {
+    cv::Mat data;
+    if (withPadding && matPart.size() != partSize) {
+      // padding black (cv::Scalar(0,0,0)) on the right and bottom
+      data = cv::Mat(partSize, CV_32FC4, cv::Scalar(0, 0, 0));
+      convertPart(matPart, data(cv::Rect(0, 0, matPart.cols, matPart.rows)));
+    } else {
+      data.create(matPart.size(), CV_32FC4);
+      convertPart(matPart, data);
+    }
+    Image image{.data = data,
+                .orig_height = (size_t)origSize.height,
+                .orig_width = (size_t)origSize.width,
+                .orig_type = mat.type(),
+                .orig_channels = mat.channels()};
+    image.resize(resize_x, resize_y);
+    auto image_ptr = std::make_shared<Image>(image);
+    imagesParts.push_back(image_ptr);
+  }
+
+  // Rq. C++ use Return Value Optimization (RVO) to avoid the extra copy or
+  // move operation associated with the return.
+  return imagesParts;
+}
+
 ImageParts ImageHelper::generateInputImage(const ImageParts &targetImage,
                                            size_t reduce_factor,
                                            size_t resize_x,
                                            size_t resize_y) const {
   ImageParts imagesParts;
   for (auto &targetPart : targetImage) {
-    // clone of the Target image to the Input image
-    Image inputImage = {.data = targetPart->data.clone(),
+    // the Target image data, copied by the first resize
+    Image inputImage = {.data = targetPart->data,
                         .orig_height = targetPart->orig_height,
                         .orig_width = targetPart->orig_width,
                         .orig_type = targetPart->orig_type,
@@ -119,6 +300,11 @@ ImageParts ImageHelper::generateInputImage(const ImageParts &targetImage,
     // then resize to the layer resolution
     inputImage.resize(resize_x, resize_y);
 
+    // or clone the Target image data if not resized
+    if (inputImage.data.data == targetPart->data.data) {
+      inputImage.data = inputImage.data.clone();
+    }
+
     // finally convert back to Image
     auto image = std::make_shared<Image>(inputImage);
     imagesParts.push_back(image);
@@ -149,28 +335,24 @@ std::vector<cv::Mat> ImageHelper::splitImage(const cv::Mat &inputImage,
   int splitsX = (inputImage.cols + partSizeX - 1) / partSizeX;
   int splitsY = (inputImage.rows + partSizeY - 1) / partSizeY;
 
-  cv::Mat paddedImage;
-  if (withPadding) {
-    // Calculate the size of padding to make the image size a multiple of
-    // partSize
-    int paddingX = splitsX * partSizeX - inputImage.cols;
-    int paddingY = splitsY * partSizeY - inputImage.rows;
-
-    // Create a copy of the image with padding black (cv::Scalar(0,0,0)) on the
-    // right and bottom.
-    cv::copyMakeBorder(inputImage, paddedImage, 0, paddingY, 0, paddingX,
-                       cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
-  }
-  // Loop over the image and create the smaller Region of Interest (roi) parts
+  // Loop over the image and create the smaller Region of Interest (roi) parts,
+  // as views on the image
   for (int i = 0; i < splitsY; ++i) {
     for (int j = 0; j < splitsX; ++j) {
-      int roiWidth =
-          (j == (int)split - 1) ? inputImage.cols - j * partSizeX : partSizeX;
-      int roiHeight =
-          (i == (int)split - 1) ? inputImage.rows - i * partSizeY : partSizeY;
+      int roiWidth = std::min(partSizeX, inputImage.cols - j * partSizeX);
+      int roiHeight = std::min(partSizeY, inputImage.rows - i * partSizeY);
       cv::Rect roi(j * partSizeX, i * partSizeY, roiWidth, roiHeight);
-      outputImages.push_back(withPadding ? paddedImage(roi).clone()
-                                         : inputImage(roi).clone());
+      cv::Mat part = inputImage(roi);
+      if (withPadding && (roiWidth < partSizeX || roiHeight < partSizeY)) {
+        // Only the edge parts are copied, with padding black
+        // (cv::Scalar(0,0,0)) on the right and bottom.
+        cv::Mat paddedPart;
+        cv::copyMakeBorder(part, paddedPart, 0, partSizeY - roiHeight, 0,
+                           partSizeX - roiWidth, cv::BORDER_CONSTANT,
+                           cv::Scalar(0, 0, 0));
+        part = paddedPart;
+      }
+      outputImages.push_back(part);
     }
   }
 
@@ -179,45 +361,34 @@ std::vector<cv::Mat> ImageHelper::splitImage(const cv::Mat &inputImage,
 
 void ImageHelper::saveImage(const std::string &imagePath,
                             const ImageParts &imageParts, size_t split,
-                            size_t resize_x, size_t resize_y) const {
+                            size_t resize_x, size_t resize_y,
+                            bool withPadding) const {
   if (imageParts.empty() || split == 0 ||
       (split == 1 && imageParts.size() != 1)) {
     throw ImageHelperException(
         "internal exception: invalid image parts or split number.");
   }
-  try {
-
-    auto image = split == 1 ? *imageParts.front()
-                            : joinImages(imageParts, (int)split, (int)split);
+  if (split == 1) {
+    saveImage(imagePath, *imageParts.front(), resize_x, resize_y);
+    return;
+  }
+  auto image = joinImages(imageParts, (int)split, (int)split);
+  if (withPadding) {
+    cropPadding(image, split);
+  }
+  saveImage(imagePath, image, resize_x, resize_y);
+}
 
+void ImageHelper::saveImage(const std::string &imagePath, Image image,
+                            size_t resize_x, size_t resize_y) const {
+  try {
     if (image.data.empty()) {
       throw ImageHelperException("Image data is empty.");
     }
 
     image.resize(resize_x, resize_y);
-
-    // convert back the [0,1] float range image to 255 pixel values
-    image.data.convertTo(image.data, image.orig_type, 255.0);
-
-    // Convert back to the original color format
-    cv::Mat tmp;
-    switch (image.orig_channels) {
-    case 1:
-      cv::cvtColor(image.data, tmp, cv::COLOR_BGRA2GRAY);
-      break;
-    case 3:
-      cv::cvtColor(image.data, tmp, cv::COLOR_BGRA2RGB);
-      break;
-    case 4:
-      cv::cvtColor(image.data, tmp, cv::COLOR_BGRA2RGBA);
-      break;
-    default:
-      SimpleLogger::LOG_WARN(
-          "Non implemented image colors channels processing: ",
-          image.orig_channels);
-      tmp = image.data;
-      break;
-    }
+    const cv::Mat tmp = convertFromValues(image.data, image.orig_type,
+                                          image.orig_channels);
 
     // write the image
     // std::vector<int> params;
@@ -237,6 +408,40 @@ void ImageHelper::saveImage(const std::string &imagePath,
   }
 }
 
+void ImageHelper::convertToValues(const cv::Mat &mat, cv::Mat dst) const {
+  if (dst.size() != mat.size() || dst.type() != CV_32FC4) {
+    throw ImageHelperException("internal exception: invalid values size.");
+  }
+  convertPart(mat, dst);
+}
+
+cv::Mat ImageHelper::convertFromValues(const cv::Mat &values, int orig_type,
+                                       int orig_channels) const {
+  // convert back the [0,1] float range image to 255 pixel values
+  cv::Mat pixels;
+  values.convertTo(pixels, orig_type, 255.0);
+
+  // Convert back to the original color format
+  cv::Mat tmp;
+  switch (orig_channels) {
+  case 1:
+    cv::cvtColor(pixels, tmp, cv::COLOR_BGRA2GRAY);
+    break;
+  case 3:
+    cv::cvtColor(pixels, tmp, cv::COLOR_BGRA2RGB);
+    break;
+  case 4:
+    cv::cvtColor(pixels, tmp, cv::COLOR_BGRA2RGBA);
+    break;
+  default:
+    SimpleLogger::LOG_WARN("Non implemented image colors channels processing: ",
+                           orig_channels);
+    tmp = pixels;
+    break;
+  }
+  return tmp;
+}
+
 Image ImageHelper::joinImages(const ImageParts &images, int splitsX,
                               int splitsY) const {
   if (images.empty()) {
@@ -245,27 +450,49 @@ Image ImageHelper::joinImages(const ImageParts &images, int splitsX,
   if (splitsX == 0 || splitsY == 0) {
     throw ImageHelperException("internal exception: split 0.");
   }
-  std::vector<cv::Mat> rows;
+  // Copy each part once, at its place in the whole image
+  const auto &first = images.front()->data;
+  cv::Mat result(first.rows * splitsY, first.cols * splitsX, first.type());
   for (int i = 0; i < splitsY; ++i) {
-    std::vector<cv::Mat> row;
     for (int j = 0; j < splitsX; ++j) {
-      row.push_back(images[i * splitsX + j]->data);
+      const auto &part = images.at(i * splitsX + j)->data;
+      if (part.size() != first.size() || part.type() != first.type()) {
+        throw ImageHelperException("internal exception: invalid part size.");
+      }
+      cv::Mat roi = result(
+          cv::Rect(j * first.cols, i * first.rows, first.cols, first.rows));
+      part.copyTo(roi);
     }
-    cv::Mat rowImage;
-    cv::hconcat(row, rowImage);
-    rows.push_back(rowImage);
   }
-  cv::Mat result;
-  cv::vconcat(rows, result);
 
   Image image{.data = result,
               .orig_height = images.front()->orig_height,
-              .orig_width = images.front()->orig_height,
+              .orig_width = images.front()->orig_width,
               .orig_type = images.front()->orig_type,
               .orig_channels = images.front()->orig_channels};
   return image;
 }
 
+void ImageHelper::cropPadding(Image &image, size_t split) const {
+  if (split <= 1 || image.orig_width == 0 || image.orig_height == 0) {
+    return;
+  }
+  // the joined image is the padded image of the parts, at another scale
+  const size_t partSizeX = (image.orig_width + split - 1) / split;
+  const size_t partSizeY = (image.orig_height + split - 1) / split;
+  const size_t paddedX =
+      (image.orig_width + partSizeX - 1) / partSizeX * partSizeX;
+  const size_t paddedY =
+      (image.orig_height + partSizeY - 1) / partSizeY * partSizeY;
+  const int cols = std::max(
+      (int)std::lround((double)image.data.cols * image.orig_width / paddedX),
+      1);
+  const int rows = std::max(
+      (int)std::lround((double)image.data.rows * image.orig_height / paddedY),
+      1);
+  image.data = image.data(cv::Rect(0, 0, cols, rows));
+}
+
 float ImageHelper::computeLoss(const cv::Mat &outputData,
                                const cv::Mat &targetData) const {
   if (outputData.total() != targetData.total() || outputData.total() == 0 ||
@@ -274,6 +501,23 @@ float ImageHelper::computeLoss(const cv::Mat &outputData,
                                 "sizes, or some are empty.");
   }
 
+  // Compute the number of pixels
+  size_t numPixels = outputData.total();
+
+  // Sum the squared differences in a single pass, without the temporary
+  // images, with the instruction set selected by the CPU dispatch
+  if (outputData.type() == CV_32FC4 && targetData.type() == CV_32FC4 &&
+      outputData.isContinuous() && targetData.isContinuous()) {
+    double sums[kernels::CHANNELS];
+    kernels::sumSquaredDiff(outputData.ptr<float>(), targetData.ptr<float>(),
+                            numPixels, sums);
+    float mseLoss = 0.0f;
+    for (size_t i = 0; i < kernels::CHANNELS; i++) {
+      mseLoss += static_cast<float>(sums[i]) / static_cast<float>(numPixels);
+    }
+    return mseLoss / static_cast<float>(kernels::CHANNELS);
+  }
+
   // Calculate element-wise squared differences
   cv::Mat diff;
   cv::absdiff(outputData, targetData, diff);
@@ -282,9 +526,6 @@ float ImageHelper::computeLoss(const cv::Mat &outputData,
   // Compute the sum of squared differences
   cv::Scalar sumSquaredDiff = cv::sum(diff);
 
-  // Compute the number of pixels
-  size_t numPixels = outputData.total();
-
   // Calculate the MSE loss
   float mseLoss = 0.0f;
   if (sumSquaredDiff.rows > 0) { // sumSquaredDiff is 1 col, 4 rows (rgba).
@@ -0,0 +1,427 @@
+#include "ImageStrips.h"
+#include "SimpleLogger.h"
+#include "exception/ImageHelperException.h"
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string_view>
+
+using namespace sipai;
+
+namespace {
+// TIFF field types
+constexpr uint16_t TIFF_SHORT = 3;
+constexpr uint16_t TIFF_LONG = 4;
+constexpr uint16_t TIFF_LONG8 = 16;
+constexpr uint64_t TIFF_HEADER_SIZE = 16;
+constexpr uint16_t TIFF_BYTE = 1;
+
+// A BigTIFF directory entry, its value being inline if 8 bytes at most
+struct TiffEntry {
+  uint16_t tag;
+  uint16_t type;
+  uint64_t count;
+  unsigned char value[8];
+};
+
+TiffEntry makeEntry(uint16_t tag, uint16_t type, uint64_t count,
+                    const void *value, size_t bytes) {
+  TiffEntry entry{.tag = tag, .type = type, .count = count, .value = {}};
+  std::memcpy(entry.value, value, std::min(bytes, sizeof(entry.value)));
+  return entry;
+}
+
+template <typename T>
+TiffEntry makeEntry(uint16_t tag, uint16_t type, T value) {
+  return makeEntry(tag, type, 1, &value, sizeof(value));
+}
+
+std::string toLower(std::string str) {
+  std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+  return str;
+}
+
+// Next token of a Netpbm header, skipping the whitespaces and the comments
+std::string_view nextToken(std::string_view header, size_t &pos) {
+  while (pos < header.size()) {
+    if (header[pos] == '#') {
+      pos = header.find('\n', pos);
+      pos = pos == std::string_view::npos ? header.size() : pos;
+    } else if (std::isspace((unsigned char)header[pos])) {
+      pos++;
+    } else {
+      break;
+    }
+  }
+  const size_t begin = pos;
+  while (pos < header.size() && !std::isspace((unsigned char)header[pos]) &&
+         header[pos] != '#') {
+    pos++;
+  }
+  return header.substr(begin, pos - begin);
+}
+
+// An unsigned integer of a TIFF file, in its byte order
+uint64_t readTiff(const unsigned char *bytes, size_t size, bool bigEndian) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value = bigEndian ? (value << 8) | bytes[i]
+                      : value | ((uint64_t)bytes[i] << (8 * i));
+  }
+  return value;
+}
+
+// The values of the fields of the first directory of a TIFF file, for the
+// BYTE, SHORT, LONG and LONG8 fields. Empty if not a valid TIFF file.
+std::map<uint16_t, std::vector<uint64_t>>
+readTiffFields(const unsigned char *data, size_t size) {
+  std::map<uint16_t, std::vector<uint64_t>> fields;
+  if (size < TIFF_HEADER_SIZE ||
+      (std::memcmp(data, "II", 2) != 0 && std::memcmp(data, "MM", 2) != 0)) {
+    return fields;
+  }
+  const bool bigEndian = data[0] == 'M';
+  const uint64_t version = readTiff(data + 2, 2, bigEndian);
+  if (version != 42 && version != 43) {
+    return fields;
+  }
+  // BigTIFF (43) has 8 bytes offsets and counts
+  const bool bigTiff = version == 43;
+  const size_t offsetSize = bigTiff ? 8 : 4;
+  const size_t countSize = bigTiff ? 8 : 2;
+  const size_t entrySize = bigTiff ? 20 : 12;
+  const uint64_t directory =
+      readTiff(data + (bigTiff ? 8 : 4), offsetSize, bigEndian);
+  if (directory > size - countSize) {
+    return fields;
+  }
+  const uint64_t count = readTiff(data + directory, countSize, bigEndian);
+  if (count > (size - directory - countSize) / entrySize) {
+    return fields;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    const unsigned char *entry = data + directory + countSize + i * entrySize;
+    const auto tag = (uint16_t)readTiff(entry, 2, bigEndian);
+    const auto type = (uint16_t)readTiff(entry + 2, 2, bigEndian);
+    const uint64_t values = readTiff(entry + 4, offsetSize, bigEndian);
+    const size_t valueSize = type == TIFF_BYTE    ? 1
+                             : type == TIFF_SHORT ? 2
+                             : type == TIFF_LONG  ? 4
+                             : type == TIFF_LONG8 ? 8
+                                                  : 0;
+    if (valueSize == 0 || values > size / valueSize) {
+      continue;
+    }
+    // the values are inline if they fit in the offset
+    const unsigned char *value = entry + 4 + offsetSize;
+    if (values * valueSize > offsetSize) {
+      const uint64_t offset = readTiff(value, offsetSize, bigEndian);
+      if (offset > size - values * valueSize) {
+        continue;
+      }
+      value = data + offset;
+    }
+    auto &field = fields[tag];
+    for (uint64_t k = 0; k < values; ++k) {
+      field.push_back(readTiff(value + k * valueSize, valueSize, bigEndian));
+    }
+  }
+  return fields;
+}
+} // namespace
+
+ImageStripReader::ImageStripReader(const std::string &path) {
+  if (!std::filesystem::exists(path)) {
+    throw ImageHelperException("Could not find the image: " + path);
+  }
+  if (mapNetpbm(path) || mapTiff(path)) {
+    return;
+  }
+  // OpenCV refuses to decode the images over OPENCV_IO_MAX_IMAGE_PIXELS
+  // pixels (2^30 by default), from their header
+  const std::string streamable =
+      ". The images that can't be decoded at once by OpenCV can be streamed "
+      "as binary PPM or PGM images, or as uncompressed TIFF images.";
+  try {
+    image_ = cv::imread(path, cv::IMREAD_ANYCOLOR);
+  } catch (const cv::Exception &e) {
+    throw ImageHelperException("Error loading image: " + path + ": " +
+                               e.what() + streamable);
+  }
+  if (image_.empty()) {
+    throw ImageHelperException("Could not open the image: " + path +
+                               streamable);
+  }
+  if (image_.depth() != CV_8U) {
+    image_.convertTo(image_, CV_8U);
+  }
+  width_ = image_.cols;
+  height_ = image_.rows;
+  channels_ = image_.channels();
+}
+
+bool ImageStripReader::mapNetpbm(const std::string &path) {
+  const auto extension =
+      toLower(std::filesystem::path(path).extension().string());
+  if (extension != ".ppm" && extension != ".pgm" && extension != ".pnm") {
+    return false;
+  }
+  auto file = MappedFile::map(path);
+  if (!file) {
+    return false;
+  }
+  const auto content = file->view();
+  size_t pos = 0;
+  const auto magic = nextToken(content, pos);
+  if (magic != "P5" && magic != "P6") {
+    // ASCII Netpbm images, decoded by OpenCV
+    return false;
+  }
+  int maxval = 0;
+  try {
+    width_ = std::stoi(std::string(nextToken(content, pos)));
+    height_ = std::stoi(std::string(nextToken(content, pos)));
+    maxval = std::stoi(std::string(nextToken(content, pos)));
+  } catch (const std::exception &) {
+    throw ImageHelperException("Invalid image header: " + path);
+  }
+  channels_ = magic == "P6" ? 3 : 1;
+  // a single whitespace before the pixels
+  pos++;
+  if (width_ <= 0 || height_ <= 0 || maxval <= 0 || maxval > 255 ||
+      pos > content.size() ||
+      (uint64_t)width_ * height_ * channels_ > content.size() - pos) {
+    throw ImageHelperException("Invalid or 16-bit image: " + path);
+  }
+  file_ = file;
+  pixels_ = file->data() + pos;
+  return true;
+}
+
+bool ImageStripReader::mapTiff(const std::string &path) {
+  if (!ImageStripWriter::isSupported(path)) {
+    return false;
+  }
+  auto file = MappedFile::map(path);
+  if (!file) {
+    return false;
+  }
+  auto fields = readTiffFields(file->data(), file->size());
+  auto field = [&fields](uint16_t tag, uint64_t missing) {
+    const auto &values = fields[tag];
+    return values.empty() ? missing : values.front();
+  };
+  // only the uncompressed 8-bit gray or RGB images, not tiled, with their
+  // channels contiguous, are mapped: the others are decoded by OpenCV
+  const uint64_t width = field(256, 0);
+  const uint64_t height = field(257, 0);
+  const uint64_t channels = field(277, 1);
+  const auto &bits = fields[258];
+  const auto &offsets = fields[273];
+  const auto &bytes = fields[279];
+  if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX ||
+      (channels != 1 && channels != 3) || bits.size() != channels ||
+      std::any_of(bits.begin(), bits.end(),
+                  [](uint64_t value) { return value != 8; }) ||
+      field(259, 1) != 1 || field(262, 0) != (channels == 3 ? 2 : 1) ||
+      field(284, 1) != 1 || fields.contains(322) || offsets.empty() ||
+      offsets.size() != bytes.size()) {
+    return false;
+  }
+  // and with their strips one after the other
+  uint64_t total = 0;
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    if (offsets[i] != offsets.front() + total) {
+      return false;
+    }
+    total += bytes[i];
+  }
+  if (total != width * height * channels ||
+      offsets.front() > file->size() - total) {
+    return false;
+  }
+  width_ = (int)width;
+  height_ = (int)height;
+  channels_ = (int)channels;
+  file_ = file;
+  pixels_ = file->data() + offsets.front();
+  return true;
+}
+
+cv::Mat ImageStripReader::readRows(int y, int rows) {
+  if (y < 0 || rows <= 0 || y + rows > height_) {
+    throw ImageHelperException("internal exception: invalid rows.");
+  }
+  if (!isMapped()) {
+    return image_.rowRange(y, y + rows);
+  }
+  // a view on the mapped file, in the file RGB order
+  const cv::Mat pixels(rows, width_, type(),
+                       const_cast<unsigned char *>(pixels_) +
+                           (size_t)y * width_ * channels_);
+  if (channels_ == 1) {
+    return pixels;
+  }
+  cv::cvtColor(pixels, strip_, cv::COLOR_RGB2BGR);
+  return strip_;
+}
+
+ImageStripWriter::ImageStripWriter(const std::string &path, int width,
+                                   int height, int channels)
+    : path_(path), width_(width), height_(height), channels_(channels) {
+  if (!isSupported(path)) {
+    throw ImageHelperException("Not a TIFF image path: " + path);
+  }
+  if (width <= 0 || height <= 0 || (channels != 1 && channels != 3)) {
+    throw ImageHelperException("Invalid image size or channels: " + path);
+  }
+  file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    throw ImageHelperException("Error saving image: " + path);
+  }
+  // BigTIFF header, in the machine byte order, with the directory offset
+  // written by close()
+  const char *byteOrder =
+      std::endian::native == std::endian::little ? "II" : "MM";
+  const uint16_t version = 43;
+  const uint16_t offsetBytes = 8;
+  const uint16_t reserved = 0;
+  const uint64_t directory = 0;
+  file_.write(byteOrder, 2);
+  file_.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  file_.write(reinterpret_cast<const char *>(&offsetBytes),
+              sizeof(offsetBytes));
+  file_.write(reinterpret_cast<const char *>(&reserved), sizeof(reserved));
+  file_.write(reinterpret_cast<const char *>(&directory), sizeof(directory));
+}
+
+bool ImageStripWriter::isSupported(const std::string &path) {
+  const auto extension =
+      toLower(std::filesystem::path(path).extension().string());
+  return extension == ".tif" || extension == ".tiff";
+}
+
+void ImageStripWriter::writeRows(const cv::Mat &rows) {
+  if (rows.cols != width_ || rows.type() != CV_MAKETYPE(CV_8U, channels_) ||
+      written_ + rows.rows > height_) {
+    throw ImageHelperException("internal exception: invalid rows.");
+  }
+  // TIFF color images are in the RGB order
+  if (channels_ == 3) {
+    cv::cvtColor(rows, rgb_, cv::COLOR_BGR2RGB);
+  } else {
+    rgb_ = rows.isContinuous() ? rows : rows.clone();
+  }
+  file_.write(reinterpret_cast<const char *>(rgb_.data),
+              (std::streamsize)(rgb_.total() * rgb_.elemSize()));
+  if (!file_) {
+    throw ImageHelperException("Error saving image: " + path_);
+  }
+  written_ += rows.rows;
+}
+
+void ImageStripWriter::close() {
+  if (written_ != height_) {
+    throw ImageHelperException("Incomplete image: " + path_);
+  }
+  // The rows are contiguous after the header: the strips offsets and sizes
+  // arrays, unless a single strip
+  const uint64_t rowBytes = (uint64_t)width_ * channels_;
+  const uint64_t rowsPerStrip = std::clamp<uint64_t>(
+      TIFF_STRIP_SIZE / rowBytes, 1, (uint64_t)height_);
+  const uint64_t strips = (height_ + rowsPerStrip - 1) / rowsPerStrip;
+  std::vector<uint64_t> stripOffsets(strips);
+  std::vector<uint64_t> stripBytes(strips);
+  for (uint64_t i = 0; i < strips; ++i) {
+    stripOffsets[i] = TIFF_HEADER_SIZE + i * rowsPerStrip * rowBytes;
+    stripBytes[i] =
+        std::min(rowsPerStrip, (uint64_t)height_ - i * rowsPerStrip) *
+        rowBytes;
+  }
+  uint64_t offsetsArray = stripOffsets.front();
+  uint64_t bytesArray = stripBytes.front();
+  if (strips > 1) {
+    offsetsArray = (uint64_t)file_.tellp();
+    file_.write(reinterpret_cast<const char *>(stripOffsets.data()),
+                (std::streamsize)(strips * sizeof(uint64_t)));
+    bytesArray = (uint64_t)file_.tellp();
+    file_.write(reinterpret_cast<const char *>(stripBytes.data()),
+                (std::streamsize)(strips * sizeof(uint64_t)));
+  }
+
+  // The directory, its entries sorted by tag
+  const uint16_t bitsPerSample[4] = {8, 8, 8, 8};
+  const std::vector<TiffEntry> entries = {
+      makeEntry<uint32_t>(256, TIFF_LONG, (uint32_t)width_),
+      makeEntry<uint32_t>(257, TIFF_LONG, (uint32_t)height_),
+      makeEntry(258, TIFF_SHORT, (uint64_t)channels_, bitsPerSample,
+                channels_ * sizeof(uint16_t)),
+      makeEntry<uint16_t>(259, TIFF_SHORT, 1), // no compression
+      makeEntry<uint16_t>(262, TIFF_SHORT,
+                          channels_ == 3 ? 2 : 1), // RGB or gray
+      makeEntry(273, TIFF_LONG8, strips, &offsetsArray, sizeof(uint64_t)),
+      makeEntry<uint16_t>(277, TIFF_SHORT, (uint16_t)channels_),
+      makeEntry<uint32_t>(278, TIFF_LONG, (uint32_t)rowsPerStrip),
+      makeEntry(279, TIFF_LONG8, strips, &bytesArray, sizeof(uint64_t)),
+      makeEntry<uint16_t>(284, TIFF_SHORT, 1), // contiguous channels
+  };
+  const uint64_t directory = (uint64_t)file_.tellp();
+  const uint64_t count = entries.size();
+  const uint64_t next = 0;
+  file_.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  for (const auto &entry : entries) {
+    file_.write(reinterpret_cast<const char *>(&entry.tag), sizeof(entry.tag));
+    file_.write(reinterpret_cast<const char *>(&entry.type),
+                sizeof(entry.type));
+    file_.write(reinterpret_cast<const char *>(&entry.count),
+                sizeof(entry.count));
+    file_.write(reinterpret_cast<const char *>(entry.value),
+                sizeof(entry.value));
+  }
+  file_.write(reinterpret_cast<const char *>(&next), sizeof(next));
+  file_.seekp(8);
+  file_.write(reinterpret_cast<const char *>(&directory), sizeof(directory));
+  file_.close();
+  if (!file_) {
+    throw ImageHelperException("Error saving image: " + path_);
+  }
+}
+
+int sipai::toOutputPosition(int position, int size, int outputSize) {
+  return (int)((int64_t)position * outputSize / size);
+}
+
+std::vector<float> sipai::featherWeights(int begin, int end, int halo,
+                                         int size, int outputSize) {
+  // the part of the output [from, to) of the weights ramp to 1
+  auto ramp = [](int from, int to, float position) {
+    if (from == to) {
+      return position >= (float)from ? 1.0f : 0.0f;
+    }
+    return std::clamp((position - (float)from) / (float)(to - from), 0.0f,
+                      1.0f);
+  };
+  const int outBegin =
+      toOutputPosition(std::max(begin - halo, 0), size, outputSize);
+  const int outEnd =
+      toOutputPosition(std::min(end + halo, size), size, outputSize);
+  std::vector<float> weights(outEnd - outBegin, 1.0f);
+  for (int i = outBegin; i < outEnd; ++i) {
+    const float center = (float)i + 0.5f;
+    if (begin > 0) {
+      weights[i - outBegin] *=
+          ramp(toOutputPosition(begin - halo, size, outputSize),
+               toOutputPosition(begin + halo, size, outputSize), center);
+    }
+    if (end < size) {
+      weights[i - outBegin] *=
+          1.0f - ramp(toOutputPosition(end - halo, size, outputSize),
+                      toOutputPosition(end + halo, size, outputSize), center);
+    }
+  }
+  return weights;
+}
@@ -0,0 +1,21 @@
+#include "InferenceSession.h"
+#include "exception/NeuralNetworkException.h"
+
+using namespace sipai;
+
+cv::Mat InferenceSession::forwardPropagation(const cv::Mat &inputValues) {
+  const auto &layers = network_.layers;
+  if (layers.empty() || inputValues.total() != layers.front()->total()) {
+    throw NeuralNetworkException("Invalid input values size");
+  }
+  // the image parts can be views on a larger image
+  const cv::Mat continuous =
+      inputValues.isContinuous() ? inputValues : inputValues.clone();
+  const cv::Mat outputs =
+      network_.forwardPropagationBatch(continuous.reshape(4, 1), values_);
+  return outputs.reshape(4, (int)layers.back()->size_y);
+}
+
+cv::Mat InferenceSession::forwardPropagationBatch(const cv::Mat &inputValues) {
+  return network_.forwardPropagationBatch(inputValues, values_);
+}
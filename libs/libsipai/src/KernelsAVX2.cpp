@@ -0,0 +1,9 @@
+// Compiled with the AVX2 and FMA instruction sets, see CMakeLists.txt
+#include "KernelsIsa.h"
+
+#ifdef SIPAI_KERNELS_X86
+#define SIPAI_KERNELS_ISA avx2
+#include "ActivationKernelsImpl.h"
+#include "LayerKernelsImpl.h"
+#undef SIPAI_KERNELS_ISA
+#endif
@@ -0,0 +1,9 @@
+// Compiled with the SSE4.2 instruction set, see CMakeLists.txt
+#include "KernelsIsa.h"
+
+#ifdef SIPAI_KERNELS_X86
+#define SIPAI_KERNELS_ISA sse42
+#include "ActivationKernelsImpl.h"
+#include "LayerKernelsImpl.h"
+#undef SIPAI_KERNELS_ISA
+#endif
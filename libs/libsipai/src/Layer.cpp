@@ -1,4 +1,6 @@
 #include "Layer.h"
+#include "ActivationKernels.h"
+#include "LayerKernels.h"
 #include "VulkanController.h"
 #include <algorithm>
 #include <cmath>
@@ -7,23 +9,84 @@
 
 using namespace sipai;
 
+namespace {
+// View some samples values as rows of n neurons, copying only if the matrix
+// is not continuous.
+cv::Mat asRows(const cv::Mat &mat, size_t n) {
+  if (n == 0 || mat.empty() || mat.total() % n != 0) {
+    throw NeuralNetworkException("Invalid layer values size");
+  }
+  const cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+  return continuous.reshape(4, (int)(mat.total() / n));
+}
+} // namespace
+
+void Layer::initValues(NetworkArena &arena) {
+  values = arena.allocate(size_y, size_x);
+  errors = arena.allocate(size_y, size_x);
+}
+
+void Layer::initWeights(size_t previous_size_x, size_t previous_size_y,
+                        NetworkArena &arena) {
+  // One block of the arena for all the layer weights, with 64-byte aligned
+  // rows
+  weights = arena.allocate(total(), previous_size_x * previous_size_y, true);
+
+  // Bind the neurons weights views, one row per neuron
+  for (size_t y = 0; y < size_y; ++y) {
+    for (size_t x = 0; x < size_x; ++x) {
+      neurons[y][x].weights =
+          cv::Mat((int)previous_size_y, (int)previous_size_x, CV_32FC4,
+                  weights.ptr((int)(y * size_x + x)));
+    }
+  }
+}
+
+cv::Vec4f Layer::activationFunction(const cv::Vec4f &rgba) const {
+  return dispatchActivation(eactivationFunction, [&](auto function) {
+    cv::Vec4f result;
+    for (int c = 0; c < 4; ++c) {
+      result[c] = decltype(function)::function(rgba[c], activationFunctionAlpha);
+    }
+    return result;
+  });
+}
+
+cv::Vec4f Layer::activationFunctionDerivative(const cv::Vec4f &rgba) const {
+  return dispatchActivation(eactivationFunction, [&](auto function) {
+    cv::Vec4f result;
+    for (int c = 0; c < 4; ++c) {
+      result[c] =
+          decltype(function)::derivative(rgba[c], activationFunctionAlpha);
+    }
+    return result;
+  });
+}
+
 void Layer::forwardPropagation() {
   if (previousLayer == nullptr) {
     return;
   }
+  // single sample, using a one row header on the values
+  cv::Mat outputs = values.reshape(4, 1);
+  forwardPropagation(previousLayer->values, outputs);
+}
 
-  for (size_t y = 0; y < neurons.size(); ++y) {
-    for (size_t x = 0; x < neurons[y].size(); ++x) {
-      Neuron &currentNeuron = neurons[y][x];
-      // Compute matrix multiplication between previous layer values
-      // and current neuron weights
-      cv::Mat dotProduct = previousLayer->values.mul(currentNeuron.weights);
-      // Convert the result matrix to a single value by summing all elements
-      cv::Vec4f result = cv::sum(dotProduct);
-      // Update the neuron value using the activation function
-      values.at<cv::Vec4f>((int)y, (int)x) = activationFunction(result);
-    }
+void Layer::forwardPropagation(const cv::Mat &inputs, cv::Mat &outputs) const {
+  if (previousLayer == nullptr) {
+    return;
   }
+  const size_t n_in = previousLayer->total();
+  const cv::Mat samples = asRows(inputs, n_in);
+  outputs.create(samples.rows, (int)total(), CV_32FC4);
+
+  // Compute the weighted sums of all the neurons and samples at once, and
+  // update the neurons values using the activation function
+  kernels::forwardGemm(weights.ptr<float>(), weights.step1(),
+                       samples.ptr<float>(), samples.step1(),
+                       outputs.ptr<float>(), outputs.step1(), total(), n_in,
+                       samples.rows, eactivationFunction,
+                       activationFunctionAlpha);
 }
 
 void Layer::backwardPropagation(const float &error_min,
@@ -31,33 +94,72 @@ void Layer::backwardPropagation(const float &error_min,
   if (nextLayer == nullptr) {
     return;
   }
+  // single sample, using one row headers on the values and errors
+  cv::Mat rowErrors = errors.reshape(4, 1);
+  backwardPropagation(nextLayer->errors, values.reshape(4, 1), rowErrors,
+                      error_min, error_max);
+}
 
-  for (int y = 0; y < (int)neurons.size(); ++y) {
-    for (int x = 0; x < (int)neurons[y].size(); ++x) {
-      Neuron &currentNeuron = neurons[y][x];
-      cv::Vec4f error(0.0f);
-
-      // Add next layer neurons error ponderated with weights for this neuron
-      for (const auto &nextLayerNeuronRow : nextLayer->neurons) {
-        for (const auto &nextLayerNeuron : nextLayerNeuronRow) {
-          const cv::Vec4f currentError = nextLayer->errors.at<cv::Vec4f>(
-              (int)nextLayerNeuron.index_y, (int)nextLayerNeuron.index_x);
-          const cv::Vec4f weight = nextLayerNeuron.weights.at<cv::Vec4f>(y, x);
-          error += currentError.mul(weight);
-        }
-      }
-      // Consider errors of adjacent neurons
-      for (const NeuronConnection &conn : currentNeuron.neighbors) {
-        error += conn.weight.mul(errors.at<cv::Vec4f>(
-            (int)conn.neuron->index_y, (int)conn.neuron->index_x));
-      }
-      // Use the derivative of the activation function
-      const cv::Vec4f activationDerivative =
-          activationFunctionDerivative(values.at<cv::Vec4f>(y, x));
-      const cv::Vec4f clampedError = Common::clamp4f(
-          activationDerivative.mul(error), error_min, error_max);
+void Layer::backwardPropagation(const cv::Mat &nextErrors,
+                                const cv::Mat &values, cv::Mat &errors,
+                                const float &error_min,
+                                const float &error_max) const {
+  if (nextLayer == nullptr) {
+    return;
+  }
+  const cv::Mat samples = asRows(nextErrors, nextLayer->total());
+
+  // Add next layer neurons errors ponderated with weights, for all the
+  // neurons at once, streaming each next layer weights row once
+  cv::Mat propagated(samples.rows, (int)total(), CV_32FC4);
+  kernels::backwardGemmT(nextLayer->weights.ptr<float>(),
+                         nextLayer->weights.step1(), samples.ptr<float>(),
+                         samples.step1(), propagated.ptr<float>(),
+                         propagated.step1(), nextLayer->total(), total(),
+                         samples.rows);
+
+  computeErrorsFromPropagated(propagated, values, errors, error_min,
+                              error_max);
+}
+
+void Layer::computeErrorsFromPropagated(const cv::Mat &propagated,
+                                        const cv::Mat &values,
+                                        cv::Mat &errors,
+                                        const float &error_min,
+                                        const float &error_max) const {
+  const cv::Mat samplesValues = asRows(values, total());
+  if (errors.rows != propagated.rows || errors.cols != (int)total() ||
+      errors.type() != CV_32FC4) {
+    errors.create(propagated.rows, (int)total(), CV_32FC4);
+    errors.setTo(cv::Scalar::all(0));
+  }
+
+  // Derivatives of the activation function of all the neurons values, with
+  // one vectorized call per sample
+  cv::Mat derivatives(samplesValues.rows, (int)total(), CV_32FC4);
+  kernels::activationDerivative(eactivationFunction, activationFunctionAlpha,
+                                samplesValues.ptr<float>(),
+                                derivatives.ptr<float>(),
+                                samplesValues.total() * 4);
+
+  // Consider errors of adjacent neurons, from the errors of the previous
+  // pass, applying the neighbors stencil to whole samples
+  cv::Mat neighborsErrors = propagated.clone();
+  if (!neighbors.empty()) {
+    for (int b = 0; b < propagated.rows; ++b) {
+      neighbors.accumulate(errors.ptr<cv::Vec4f>(b),
+                           neighborsErrors.ptr<cv::Vec4f>(b));
+    }
+  }
 
-      errors.at<cv::Vec4f>(y, x) = clampedError;
+  for (int b = 0; b < propagated.rows; ++b) {
+    const auto *errorRow = neighborsErrors.ptr<cv::Vec4f>(b);
+    const auto *derivativesRow = derivatives.ptr<cv::Vec4f>(b);
+    auto *errorsRow = errors.ptr<cv::Vec4f>(b);
+    for (size_t index = 0; index < total(); ++index) {
+      // Use the derivative of the activation function
+      errorsRow[index] = Common::clamp4f(
+          derivativesRow[index].mul(errorRow[index]), error_min, error_max);
     }
   }
 }
@@ -66,30 +168,51 @@ void Layer::updateWeights(float learningRate) {
   if (previousLayer == nullptr) {
     return;
   }
+  updateWeights(previousLayer->values, values, errors, learningRate);
+}
+
+void Layer::updateWeights(const cv::Mat &inputs, const cv::Mat &values,
+                          const cv::Mat &errors, float learningRate) {
+  updateWeightsAndPropagate(inputs, values, errors, learningRate, nullptr);
+}
 
-  for (int y = 0; y < (int)neurons.size(); ++y) {
-    for (int x = 0; x < (int)neurons[y].size(); ++x) {
-      Neuron &neuron = neurons[y][x];
-
-      // Get the error of current neuron, mult by the learningRate
-      const cv::Vec4f learningRateError =
-          errors.at<cv::Vec4f>(y, x) * cv::Vec4f::all(learningRate);
-
-      // Create a matrix with dimensions of neuron weights
-      // and previous learningRateError
-      cv::Mat learningRateErrorMat(neuron.weights.size(), neuron.weights.type(),
-                                   learningRateError);
-
-      // Update neuron weights that are connections weights with previous layers
-      neuron.weights -= previousLayer->values.mul(learningRateErrorMat);
-
-      // Update neighbors connections weights
-      for (NeuronConnection &conn : neuron.neighbors) {
-        conn.weight -= values
-                           .at<cv::Vec4f>((int)conn.neuron->index_y,
-                                          (int)conn.neuron->index_x)
-                           .mul(learningRateError);
-      }
+void Layer::updateWeightsAndPropagate(const cv::Mat &inputs,
+                                      const cv::Mat &values,
+                                      const cv::Mat &errors,
+                                      float learningRate,
+                                      cv::Mat *propagated) {
+  if (previousLayer == nullptr) {
+    return;
+  }
+  const cv::Mat samplesInputs = asRows(inputs, previousLayer->total());
+  const cv::Mat samplesValues = asRows(values, total());
+  const cv::Mat samplesErrors = asRows(errors, total());
+  if (samplesInputs.rows != samplesErrors.rows) {
+    throw NeuralNetworkException("Invalid samples count");
+  }
+  float *propagatedData = nullptr;
+  size_t propagatedStep = 0;
+  if (propagated != nullptr) {
+    propagated->create(samplesErrors.rows, (int)previousLayer->total(),
+                       CV_32FC4);
+    propagatedData = propagated->ptr<float>();
+    propagatedStep = propagated->step1();
+  }
+
+  // Update the connections weights with the previous layer, with the errors
+  // mult by the learningRate, propagating the errors at the same time if
+  // requested
+  kernels::fusedBackwardUpdate(
+      weights.ptr<float>(), weights.step1(), samplesErrors.ptr<float>(),
+      samplesErrors.step1(), samplesInputs.ptr<float>(), samplesInputs.step1(),
+      propagatedData, propagatedStep, learningRate, total(),
+      previousLayer->total(), samplesErrors.rows);
+
+  // Update neighbors connections weights
+  if (!neighbors.empty()) {
+    for (int b = 0; b < samplesErrors.rows; ++b) {
+      neighbors.update(samplesValues.ptr<cv::Vec4f>(b),
+                       samplesErrors.ptr<cv::Vec4f>(b), learningRate);
     }
   }
-}
\ No newline at end of file
+}
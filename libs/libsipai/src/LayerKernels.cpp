@@ -0,0 +1,197 @@
+#include "LayerKernels.h"
+#include "ActivationKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#define SIPAI_KERNELS_ISA baseline
+#include "LayerKernelsImpl.h"
+#undef SIPAI_KERNELS_ISA
+
+using namespace sipai;
+using namespace sipai::kernels;
+
+namespace {
+std::atomic<bool> sharedWeights_ = false;
+
+// Minimum multiply-adds per parallel task, to amortize its scheduling.
+constexpr size_t TASK_MIN_OPS = 16384;
+// Minimum neurons per column range of a parallel task, i.e. 1 KB segments of
+// the weights rows.
+constexpr size_t TASK_MIN_COLUMNS = 64;
+
+// Grain of a rows partition, for rows of n neurons.
+inline size_t rowsGrain(size_t n) {
+  return std::max<size_t>(1, TASK_MIN_OPS / std::max<size_t>(1, n));
+}
+
+// Grain of a columns partition, for columns of n rows.
+inline size_t columnsGrain(size_t n) {
+  return std::max(TASK_MIN_COLUMNS,
+                  TASK_MIN_OPS / std::max<size_t>(1, n));
+}
+
+// The loops of a task, with the instruction set selected by getCpuIsa()
+void forwardRows(const float *weights, size_t ldw, const float *inputs,
+                 size_t ldi, float *outputs, size_t ldo, size_t n_in,
+                 size_t batch, size_t begin, size_t end) {
+  SIPAI_KERNELS_DISPATCH(forwardRows, weights, ldw, inputs, ldi, outputs, ldo,
+                         n_in, batch, begin, end)
+}
+
+void backwardColumns(const float *weights, size_t ldw, const float *errors,
+                     size_t lde, float *propagated, size_t ldp, size_t n_out,
+                     size_t batch, size_t begin, size_t end) {
+  SIPAI_KERNELS_DISPATCH(backwardColumns, weights, ldw, errors, lde,
+                         propagated, ldp, n_out, batch, begin, end)
+}
+
+void fusedColumns(float *weights, size_t ldw, const float *errors, size_t lde,
+                  const float *inputs, size_t ldi, float *propagated,
+                  size_t ldp, float learningRate, size_t n_out, size_t batch,
+                  size_t begin, size_t end) {
+  SIPAI_KERNELS_DISPATCH(fusedColumns, weights, ldw, errors, lde, inputs, ldi,
+                         propagated, ldp, learningRate, n_out, batch, begin,
+                         end)
+}
+/**
+ * @brief The only write to the weights shared by concurrent workers, see
+ * setSharedWeights(). Hogwild tolerates the race between the workers updates,
+ * so relaxed atomics are enough: an update can be lost, but a weight is
+ * never torn nor assumed unchanged by the compiler.
+ */
+inline void sharedAdd(float &weight, float delta) {
+  std::atomic_ref<float> shared(weight);
+  shared.store(shared.load(std::memory_order_relaxed) + delta,
+               std::memory_order_relaxed);
+}
+
+// updateGemm() of a range of columns of the shared weights, with one update
+// per weight for the whole batch
+void sharedUpdateColumns(float *weights, size_t ldw, const float *errors,
+                         size_t lde, const float *inputs, size_t ldi,
+                         float learningRate, size_t n_out, size_t batch,
+                         size_t begin, size_t end) {
+  for (size_t i = 0; i < n_out; ++i) {
+    float *w = weights + i * ldw;
+    for (size_t k = begin * CHANNELS; k < end * CHANNELS; ++k) {
+      float delta = 0.0f;
+      for (size_t b = 0; b < batch; ++b) {
+        delta += errors[b * lde + i * CHANNELS + k % CHANNELS] *
+                 inputs[b * ldi + k];
+      }
+      sharedAdd(w[k], -learningRate * delta);
+    }
+  }
+}
+} // namespace
+
+void kernels::setSharedWeights(bool enable) { sharedWeights_ = enable; }
+
+bool kernels::isSharedWeights() { return sharedWeights_; }
+
+void kernels::forwardGemm(const float *weights, size_t ldw, const float *inputs,
+                          size_t ldi, float *outputs, size_t ldo, size_t n_out,
+                          size_t n_in, size_t batch) {
+  // Partition over the output neurons rows, which are independent
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_out, rowsGrain(n_in)),
+                    [&](const tbb::blocked_range<size_t> &rows) {
+                      forwardRows(weights, ldw, inputs, ldi, outputs, ldo,
+                                  n_in, batch, rows.begin(), rows.end());
+                    });
+}
+
+void kernels::forwardGemm(const float *weights, size_t ldw, const float *inputs,
+                          size_t ldi, float *outputs, size_t ldo, size_t n_out,
+                          size_t n_in, size_t batch,
+                          EActivationFunction activation, float alpha) {
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n_out, rowsGrain(n_in)),
+      [&](const tbb::blocked_range<size_t> &rows) {
+        forwardRows(weights, ldw, inputs, ldi, outputs, ldo, n_in, batch,
+                    rows.begin(), rows.end());
+        // Activate the weighted sums of the rows while they are in the cache,
+        // with one vectorized call per sample
+        for (size_t b = 0; b < batch; ++b) {
+          float *out = outputs + b * ldo + rows.begin() * CHANNELS;
+          activate(activation, alpha, out, out, rows.size() * CHANNELS);
+        }
+      });
+}
+
+void kernels::backwardGemmT(const float *weights, size_t ldw,
+                            const float *errors, size_t lde, float *propagated,
+                            size_t ldp, size_t n_out, size_t n_in,
+                            size_t batch) {
+  // Partition over the previous layer neurons columns, so that each task
+  // accumulates into its own range of the propagated errors
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n_in, columnsGrain(n_out)),
+      [&](const tbb::blocked_range<size_t> &columns) {
+        backwardColumns(weights, ldw, errors, lde, propagated, ldp, n_out,
+                        batch, columns.begin(), columns.end());
+      });
+}
+
+void kernels::updateGemm(float *weights, size_t ldw, const float *errors,
+                         size_t lde, const float *inputs, size_t ldi,
+                         float learningRate, size_t n_out, size_t n_in,
+                         size_t batch) {
+  fusedBackwardUpdate(weights, ldw, errors, lde, inputs, ldi, nullptr, 0,
+                      learningRate, n_out, n_in, batch);
+}
+
+void kernels::fusedBackwardUpdate(float *weights, size_t ldw,
+                                  const float *errors, size_t lde,
+                                  const float *inputs, size_t ldi,
+                                  float *propagated, size_t ldp,
+                                  float learningRate, size_t n_out,
+                                  size_t n_in, size_t batch) {
+  // Partition over the previous layer neurons columns: each task owns a range
+  // of the propagated errors and of every weights row
+  if (sharedWeights_) {
+    // the errors are propagated with the weights before their update, as
+    // the fused kernel, but the other workers can update them meanwhile
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, n_in, columnsGrain(n_out)),
+        [&](const tbb::blocked_range<size_t> &columns) {
+          if (propagated != nullptr) {
+            backwardColumns(weights, ldw, errors, lde, propagated, ldp, n_out,
+                            batch, columns.begin(), columns.end());
+          }
+          sharedUpdateColumns(weights, ldw, errors, lde, inputs, ldi,
+                              learningRate, n_out, batch, columns.begin(),
+                              columns.end());
+        });
+    return;
+  }
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n_in, columnsGrain(n_out)),
+      [&](const tbb::blocked_range<size_t> &columns) {
+        fusedColumns(weights, ldw, errors, lde, inputs, ldi, propagated, ldp,
+                     learningRate, n_out, batch, columns.begin(),
+                     columns.end());
+      });
+}
+
+void kernels::sumSquaredDiff(const float *a, const float *b, size_t n,
+                             double sums[CHANNELS]) {
+  SIPAI_KERNELS_DISPATCH(sumSquaredDiff, a, b, n, sums)
+}
+
+void kernels::multiplyAccumulate(const float *a, const float *b, float scale,
+                                 float *out, size_t n) {
+  SIPAI_KERNELS_DISPATCH(multiplyAccumulate, a, b, scale, out, n)
+}
+
+void kernels::updateWeights(const float *a, const float *b, float scale,
+                            float *weights, size_t n) {
+  if (!sharedWeights_) {
+    multiplyAccumulate(a, b, scale, weights, n);
+    return;
+  }
+  for (size_t k = 0; k < n; ++k) {
+    sharedAdd(weights[k], scale * a[k] * b[k]);
+  }
+}
@@ -10,34 +10,52 @@ void LayerOutput::computeErrors(const cv::Mat &expectedValues) {
     throw std::invalid_argument("Invalid expected values size");
   }
 
-  const float error_min = Manager::getConstInstance().network_params.error_min;
-  const float error_max = Manager::getConstInstance().network_params.error_max;
-  const float weightFactor = 0.5f; // Experiment with weight between 0 and 1
-
   // Create the errors matrix if not already allocated
   if (errors.empty()) {
     errors.create((int)size_y, (int)size_x, CV_32FC4);
   }
 
-  // Iterate over all neurons in the layer
-  for (int y = 0; y < (int)size_y; ++y) {
-    for (int x = 0; x < (int)size_x; ++x) {
-      const Neuron &neuron = neurons[y][x];
-      cv::Vec4f &error = errors.at<cv::Vec4f>(y, x);
+  // single sample, using one row headers on the values and errors
+  cv::Mat rowErrors = errors.reshape(4, 1);
+  computeErrors(expectedValues, values.reshape(4, 1), rowErrors);
+}
+
+void LayerOutput::computeErrors(const cv::Mat &expectedValues,
+                                const cv::Mat &values, cv::Mat &errors) const {
+  if (values.cols != (int)total() || expectedValues.total() != values.total()) {
+    throw std::invalid_argument("Invalid expected values size");
+  }
+
+  const float error_min = Manager::getConstInstance().network_params.error_min;
+  const float error_max = Manager::getConstInstance().network_params.error_max;
+  const float weightFactor = 0.5f; // Experiment with weight between 0 and 1
 
-      // Compute the weighted sum of neighboring neuron values
-      cv::Vec4f neighborSum = cv::Vec4f::all(0.0f);
-      for (const NeuronConnection &connection : neuron.neighbors) {
-        neighborSum += connection.weight.mul(values.at<cv::Vec4f>(
-            (int)connection.neuron->index_y, (int)connection.neuron->index_x));
-      }
+  const cv::Mat expectedRows =
+      (expectedValues.isContinuous() ? expectedValues : expectedValues.clone())
+          .reshape(4, values.rows);
+  errors.create(values.rows, (int)total(), CV_32FC4);
+
+  // Compute the weighted sum of neighboring neuron values of all the samples
+  cv::Mat neighborSums = cv::Mat::zeros(values.rows, (int)total(), CV_32FC4);
+  if (!neighbors.empty()) {
+    for (int b = 0; b < values.rows; ++b) {
+      neighbors.accumulate(values.ptr<cv::Vec4f>(b),
+                           neighborSums.ptr<cv::Vec4f>(b));
+    }
+  }
 
+  // Iterate over all samples and neurons in the layer
+  for (int b = 0; b < values.rows; ++b) {
+    const auto *valuesRow = values.ptr<cv::Vec4f>(b);
+    const auto *expectedRow = expectedRows.ptr<cv::Vec4f>(b);
+    const auto *neighborSumsRow = neighborSums.ptr<cv::Vec4f>(b);
+    auto *errorsRow = errors.ptr<cv::Vec4f>(b);
+    for (size_t index = 0; index < total(); ++index) {
       // Compute and update the error
-      const cv::Vec4f &currentValue = values.at<cv::Vec4f>(y, x);
-      const cv::Vec4f &expectedValue = expectedValues.at<cv::Vec4f>(y, x);
-      const cv::Vec4f newError = weightFactor * (currentValue - expectedValue) +
-                                 (1.0f - weightFactor) * neighborSum;
-      error = Common::clamp4f(newError, error_min, error_max);
+      const cv::Vec4f newError =
+          weightFactor * (valuesRow[index] - expectedRow[index]) +
+          (1.0f - weightFactor) * neighborSumsRow[index];
+      errorsRow[index] = Common::clamp4f(newError, error_min, error_max);
     }
   }
 }
\ No newline at end of file
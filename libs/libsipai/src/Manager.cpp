@@ -1,6 +1,8 @@
 #include "Manager.h"
+#include "ActivationKernels.h"
 #include "AppParams.h"
 #include "Common.h"
+#include "CpuDispatch.h"
 #include "NeuralNetwork.h"
 #include "SimpleLogger.h"
 #include "VulkanController.h"
@@ -25,6 +27,7 @@ Manager::createOrImportNetwork(std::function<void(int)> progressCallback) {
                 .createOrImport()
                 .addLayers()
                 .bindLayers()
+                .allocateArena()
                 .addNeighbors()
                 .initializeWeights()
                 .setActivationFunction()
@@ -75,15 +78,53 @@ Manager &Manager::showParameters() {
       "\noutput activation function: ",
       getActivationStr(network_params.output_activation_function),
       "\noutput activation alpha: ", network_params.output_activation_alpha,
+      "\nneighbors radius: ", network_params.neighbors_radius,
       "\ninput reduce factor: ", app_params.training_reduce_factor,
       "\noutput scale: ", app_params.output_scale,
+      "\nbatch enhancement input: ",
+      !app_params.input_folder.empty() ? app_params.input_folder
+      : !app_params.input_list.empty() ? app_params.input_list
+                                       : "none",
+      "\nbatch enhancement output folder: ",
+      app_params.output_folder.empty() ? "none" : app_params.output_folder,
       "\nimage split: ", app_params.image_split,
+      "\nstreaming enhancement tile: ",
+      app_params.stream_tile_size == 0
+          ? "none"
+          : std::to_string(app_params.stream_tile_size),
+      "\nstreaming enhancement tile halo: ", app_params.stream_tile_halo,
+      "\nbatch size: ", app_params.batch_size,
+      "\ntraining workers: ", app_params.training_workers,
+      "\nHogwild training enabled: ",
+      app_params.enable_hogwild ? "true" : "false",
       "\nimages random loading: ", app_params.random_loading ? "true" : "false",
       "\nimages bulk loading: ", app_params.bulk_loading ? "true" : "false",
+      "\nimages training shards: ",
+      app_params.training_data_shards.empty() ? "none"
+                                              : app_params.training_data_shards,
+      "\nimages shuffle buffer: ", app_params.shuffle_buffer,
+      "\nimages cache memory limit: ",
+      app_params.bulk_loading ? "no limit"
+                              : std::to_string(app_params.cache_memory_limit) +
+                                    " MB",
+      "\nimages tile cache: ",
+      app_params.tile_cache_folder.empty() ? "none"
+                                           : app_params.tile_cache_folder,
+      "\nimages loading workers: ", app_params.loading_workers,
+      "\nimages prefetch size: ", app_params.prefetch_size,
       "\nimages padding enabled: ",
       app_params.enable_padding ? "true" : "false",
+      "\nfused training enabled: ",
+      app_params.enable_fused_training ? "true" : "false",
+      "\nfast math enabled: ", app_params.enable_fast_math ? "true" : "false",
       "\nCPU parallelism enabled: ",
       app_params.enable_parallel ? "true" : "false",
+      "\nCPU threads: ",
+      app_params.threads == 0 ? "all" : std::to_string(app_params.threads),
+      "\nweights initialization seed: ",
+      app_params.seed == NO_SEED ? "random" : std::to_string(app_params.seed),
+      "\nCPU kernels instruction set: ",
+      kernels::getCpuIsaStr(kernels::getCpuIsa()),
       "\nGPU Vulkan enabled: ", app_params.enable_vulkan ? "true" : "false",
       "\nverbose logs enabled: ", app_params.verbose ? "true" : "false",
       "\ndebug logs enabled: ", app_params.verbose_debug ? "true" : "false",
@@ -117,19 +158,32 @@ void Manager::run() {
     }
   }
 
+  // Activation functions exp and tanh approximations
+  kernels::setFastMath(app_params.enable_fast_math);
+
   // Enabling CPU parallelism
   if (app_params.enable_parallel) {
     SimpleLogger::LOG_INFO("Enabling CPU parallelism...");
     try {
-      cv::setNumThreads(std::thread::hardware_concurrency());
+      const size_t threads = app_params.threads == 0
+                                 ? std::thread::hardware_concurrency()
+                                 : app_params.threads;
+      cv::setNumThreads((int)threads);
+      parallelismControl_ = std::make_unique<tbb::global_control>(
+          tbb::global_control::max_allowed_parallelism, threads);
     } catch (std::exception &ex) {
       SimpleLogger::LOG_ERROR("Enabling CPU parallelism error: ", ex.what());
       cv::setNumThreads(0);
+      parallelismControl_ = std::make_unique<tbb::global_control>(
+          tbb::global_control::max_allowed_parallelism, 1);
       app_params.enable_parallel = false;
       SimpleLogger::LOG_INFO("CPU threads parallelism disabled.");
     }
   } else {
+    // The layers kernels run in the calling thread only
     cv::setNumThreads(0);
+    parallelismControl_ = std::make_unique<tbb::global_control>(
+        tbb::global_control::max_allowed_parallelism, 1);
   }
 
   // Run with visitor
@@ -0,0 +1,56 @@
+#include "MappedFile.h"
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace sipai;
+
+std::shared_ptr<MappedFile> MappedFile::map(const std::string &path) {
+  std::shared_ptr<MappedFile> file(new MappedFile);
+#ifdef _WIN32
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream) {
+    return nullptr;
+  }
+  file->buffer_.resize((size_t)stream.tellg());
+  stream.seekg(0);
+  if (file->buffer_.empty() ||
+      !stream.read(reinterpret_cast<char *>(file->buffer_.data()),
+                   (std::streamsize)file->buffer_.size())) {
+    return nullptr;
+  }
+  file->data_ = file->buffer_.data();
+  file->size_ = file->buffer_.size();
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *addr = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+  file->data_ = static_cast<unsigned char *>(addr);
+  file->size_ = (size_t)st.st_size;
+#endif
+  return file;
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+#endif
+}
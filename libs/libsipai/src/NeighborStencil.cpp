@@ -0,0 +1,144 @@
+#include "NeighborStencil.h"
+#include "LayerKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <tuple>
+
+using namespace sipai;
+
+std::vector<NeighborOffset> NeighborStencil::getOffsets(float radius) {
+  std::vector<NeighborOffset> offsets;
+  const int r = (int)std::floor(std::max(radius, 0.0f));
+  for (int dy = -r; dy <= r; ++dy) {
+    for (int dx = -r; dx <= r; ++dx) {
+      if ((dx != 0 || dy != 0) &&
+          (float)(dx * dx + dy * dy) <= radius * radius) {
+        offsets.push_back({dx, dy});
+      }
+    }
+  }
+  // by distance, then the horizontal neighbors first, then up and down
+  std::sort(offsets.begin(), offsets.end(),
+            [](const NeighborOffset &a, const NeighborOffset &b) {
+              return std::make_tuple(a.dx * a.dx + a.dy * a.dy, std::abs(a.dy),
+                                     a.dy, a.dx) <
+                     std::make_tuple(b.dx * b.dx + b.dy * b.dy, std::abs(b.dy),
+                                     b.dy, b.dx);
+            });
+  return offsets;
+}
+
+void NeighborStencil::init(size_t size_x, size_t size_y, float radius,
+                           NetworkArena &arena) {
+  size_x_ = size_x;
+  size_y_ = size_y;
+  offsets = getOffsets(radius);
+  planes.clear();
+
+  // One allocation for all the planes
+  weights = arena.allocate(offsets.size() * size_y, size_x);
+  for (size_t k = 0; k < offsets.size(); ++k) {
+    planes.push_back(
+        weights.rowRange((int)(k * size_y), (int)((k + 1) * size_y)));
+  }
+}
+
+void NeighborStencil::randomize(const CounterRng &rng, uint32_t layer) {
+  rng.fillNormal(weights, layer, ERngStream::Neighbors);
+  // zero the weights of the connections going out of the layer
+  for (size_t k = 0; k < offsets.size(); ++k) {
+    size_t x0, x1, y0, y1;
+    inside(offsets[k], x0, x1, y0, y1);
+    x0 = std::min(x0, size_x_);
+    y0 = std::min(y0, size_y_);
+    x1 = std::max(x0, x1);
+    y1 = std::max(y0, y1);
+    planes[k].rowRange(0, (int)y0).setTo(cv::Scalar::all(0));
+    planes[k].rowRange((int)y1, (int)size_y_).setTo(cv::Scalar::all(0));
+    planes[k].colRange(0, (int)x0).setTo(cv::Scalar::all(0));
+    planes[k].colRange((int)x1, (int)size_x_).setTo(cv::Scalar::all(0));
+  }
+}
+
+size_t NeighborStencil::count(size_t x, size_t y) const {
+  size_t neighbors = 0;
+  forEach(x, y, [&neighbors](size_t, size_t, const cv::Vec4f &) {
+    neighbors++;
+  });
+  return neighbors;
+}
+
+void NeighborStencil::inside(const NeighborOffset &offset, size_t &x0,
+                             size_t &x1, size_t &y0, size_t &y1) const {
+  x0 = (size_t)std::max(0, -offset.dx);
+  y0 = (size_t)std::max(0, -offset.dy);
+  x1 = (size_t)std::max(0LL, (long long)size_x_ - std::max(0, offset.dx));
+  y1 = (size_t)std::max(0LL, (long long)size_y_ - std::max(0, offset.dy));
+}
+
+void NeighborStencil::accumulate(const cv::Vec4f *inputs,
+                                 cv::Vec4f *outputs) const {
+  // For each direction, the rows segments of the neurons having a neighbor
+  // in this direction are contiguous in the plane, the inputs and the
+  // outputs: one vectorized call per segment, without bounds checks.
+  for (size_t k = 0; k < offsets.size(); ++k) {
+    size_t x0, x1, y0, y1;
+    inside(offsets[k], x0, x1, y0, y1);
+    if (x0 >= x1) {
+      continue;
+    }
+    const long long shift =
+        (long long)offsets[k].dy * (long long)size_x_ + offsets[k].dx;
+    for (size_t y = y0; y < y1; ++y) {
+      const size_t index = y * size_x_ + x0;
+      kernels::multiplyAccumulate(
+          planes[k].ptr<float>((int)y, (int)x0),
+          reinterpret_cast<const float *>(inputs + (long long)index + shift),
+          1.0f, reinterpret_cast<float *>(outputs + index),
+          (x1 - x0) * kernels::CHANNELS);
+    }
+  }
+}
+
+void NeighborStencil::update(const cv::Vec4f *values, const cv::Vec4f *errors,
+                             float learningRate) {
+  for (size_t k = 0; k < offsets.size(); ++k) {
+    size_t x0, x1, y0, y1;
+    inside(offsets[k], x0, x1, y0, y1);
+    if (x0 >= x1) {
+      continue;
+    }
+    const long long shift =
+        (long long)offsets[k].dy * (long long)size_x_ + offsets[k].dx;
+    for (size_t y = y0; y < y1; ++y) {
+      const size_t index = y * size_x_ + x0;
+      kernels::updateWeights(
+          reinterpret_cast<const float *>(values + (long long)index + shift),
+          reinterpret_cast<const float *>(errors + index), -learningRate,
+          planes[k].ptr<float>((int)y, (int)x0),
+          (x1 - x0) * kernels::CHANNELS);
+    }
+  }
+}
+
+std::string NeighborStencil::toStringCsv(size_t x, size_t y,
+                                         size_t max_weights) const {
+  std::ostringstream oss;
+  size_t neighbors = 0;
+  forEach(x, y, [&](size_t, size_t, const cv::Vec4f &weight) {
+    for (int i = 0; i < 4; i++) {
+      oss << weight[i] << ",";
+    }
+    neighbors++;
+  });
+  // fill the lasts columns with empty ",RGBA"
+  for (size_t i = neighbors; i < max_weights; ++i) {
+    oss << ",,,,";
+  }
+  std::string str = oss.str();
+  if (!str.empty()) {
+    str.pop_back(); // remove the extra comma
+  }
+  return str;
+}
@@ -0,0 +1,71 @@
+#include "NetworkArena.h"
+#include "NeighborStencil.h"
+#include "exception/NeuralNetworkException.h"
+
+using namespace sipai;
+
+size_t NetworkArena::matBytes(size_t rows, size_t cols, bool alignRows) {
+  size_t rowStep = cols * sizeof(cv::Vec4f);
+  if (alignRows) {
+    rowStep = cv::alignSize(rowStep, ARENA_ALIGNMENT);
+  }
+  return cv::alignSize(rows * rowStep, ARENA_ALIGNMENT);
+}
+
+size_t NetworkArena::layerBytes(size_t size_x, size_t size_y,
+                                size_t previous_total,
+                                float neighbors_radius) {
+  // values and errors
+  size_t bytes = 2 * matBytes(size_y, size_x);
+  if (previous_total > 0) {
+    // weights with the previous layer, and neighbors weights
+    bytes += matBytes(size_x * size_y, previous_total, true);
+    bytes += matBytes(
+        NeighborStencil::getOffsets(neighbors_radius).size() * size_y, size_x);
+  }
+  return bytes;
+}
+
+size_t NetworkArena::networkBytes(const NeuralNetworkParams &params) {
+  const size_t input_total = params.input_size_x * params.input_size_y;
+  const size_t hidden_total = params.hidden_size_x * params.hidden_size_y;
+  size_t bytes = layerBytes(params.input_size_x, params.input_size_y, 0, 0.0f);
+  size_t previous_total = input_total;
+  for (size_t i = 0; i < params.hiddens_count; ++i) {
+    bytes += layerBytes(params.hidden_size_x, params.hidden_size_y,
+                        previous_total, params.neighbors_radius);
+    previous_total = hidden_total;
+  }
+  bytes += layerBytes(params.output_size_x, params.output_size_y,
+                      previous_total, params.neighbors_radius);
+  return bytes;
+}
+
+void NetworkArena::reserve(size_t bytes) {
+  if (data_ != nullptr) {
+    throw NeuralNetworkException("network arena already allocated");
+  }
+  // Rows of one alignment, with an extra row to align the start of the arena
+  const size_t rows = cv::alignSize(bytes, ARENA_ALIGNMENT) / ARENA_ALIGNMENT;
+  buffer_ = cv::Mat::zeros((int)rows + 1, ARENA_ALIGNMENT, CV_8U);
+  data_ = cv::alignPtr(buffer_.data, ARENA_ALIGNMENT);
+  capacity_ = rows * ARENA_ALIGNMENT;
+  used_ = 0;
+}
+
+cv::Mat NetworkArena::allocate(size_t rows, size_t cols, bool alignRows) {
+  if (rows == 0 || cols == 0) {
+    return cv::Mat();
+  }
+  const size_t bytes = matBytes(rows, cols, alignRows);
+  if (used_ + bytes > capacity_) {
+    throw NeuralNetworkException("network arena too small");
+  }
+  size_t rowStep = cols * sizeof(cv::Vec4f);
+  if (alignRows) {
+    rowStep = cv::alignSize(rowStep, ARENA_ALIGNMENT);
+  }
+  cv::Mat mat((int)rows, (int)cols, CV_32FC4, data_ + used_, rowStep);
+  used_ += bytes;
+  return mat;
+}
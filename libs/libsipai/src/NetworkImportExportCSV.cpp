@@ -1,7 +1,6 @@
 #include "Common.h"
 #include "Layer.h"
 #include "NeuralNetworkImportExportCSV.h"
-#include "NeuronConnection.h"
 #include "exception/EmptyCellException.h"
 #include "exception/ImportExportException.h"
 #include <algorithm> // for std::transform
@@ -42,8 +41,8 @@ void NeuralNetworkImportExportCSV::exportNeuronsWeights(
         // Write the neighbors connections weights
         file << layer_index << "," << neuron.weights.rows << ","
              << neuron.weights.cols << "," << row << "," << col << ","
-             << neuron.neighbors.size() << ","
-             << neuron.toNeighborsStringCsv(max_weights) << "\n";
+             << layer->neighbors.count(col, row) << ","
+             << layer->neighbors.toStringCsv(col, row, max_weights) << "\n";
       }
     }
   }
@@ -53,15 +52,24 @@ void NeuralNetworkImportExportCSV::importNeuronsWeights(
     std::unique_ptr<NeuralNetwork> &network, const AppParams &appParams,
     std::function<void(int)> progressCallback, int progressInitialValue) const {
 
-  auto split = [](const std::string &s, char delimiter) {
-    std::vector<std::optional<float>> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-      tokens.push_back(token.empty() ? std::nullopt
-                                     : std::make_optional(std::stof(token)));
+  // split a line into the fields, reusing their memory between the lines
+  auto split = [](const std::string &s, char delimiter,
+                  std::vector<std::optional<float>> &tokens) {
+    tokens.clear();
+    const char *begin = s.data();
+    const char *end = begin + s.size();
+    while (begin < end) {
+      const char *next = std::find(begin, end, delimiter);
+      if (next == begin) {
+        tokens.push_back(std::nullopt);
+      } else {
+        tokens.push_back(std::stof(std::string(begin, next)));
+      }
+      if (next == end) {
+        break;
+      }
+      begin = next + 1;
     }
-    return tokens;
   };
 
   // get the csv filename
@@ -80,10 +88,12 @@ void NeuralNetworkImportExportCSV::importNeuronsWeights(
 
   // parsing the csv
   std::string line;
+  std::vector<std::optional<float>> fields;
+  std::vector<cv::Vec4f> neighborsWeights;
   int oldProgressValue = progressInitialValue;
   for (int current_line_number = 1; std::getline(file, line);
        ++current_line_number) {
-    const auto &fields = split(line, ',');
+    split(line, ',', fields);
 
     if (fields.size() < 6) {
       throw ImportExportException("CSV parsing error at line (" +
@@ -99,8 +109,17 @@ void NeuralNetworkImportExportCSV::importNeuronsWeights(
     auto neighboors_count = fields[5];
 
     if (!neighboors_count) {
-      // add the neuron weights
-      cv::Mat weights = cv::Mat((int)weights_rows, (int)weights_cols, CV_32FC4);
+      // set the neuron weights, into its view of the layer weights
+      cv::Mat &weights = network->layers.at(layer_index)
+                             ->neurons.at(neuron_row)
+                             .at(neuron_col)
+                             .weights;
+      if (weights.rows != (int)weights_rows ||
+          weights.cols != (int)weights_cols) {
+        throw ImportExportException("CSV parsing error at line (" +
+                                    std::to_string(current_line_number) +
+                                    "): invalid weights size");
+      }
       size_t i_cols = 0;
       size_t i_rows = 0;
       for (size_t pos = 6; pos + 4 < fields.size();
@@ -120,14 +139,9 @@ void NeuralNetworkImportExportCSV::importNeuronsWeights(
           i_rows++;
         }
       }
-      network->layers.at(layer_index)
-          ->neurons.at(neuron_row)
-          .at(neuron_col)
-          .weights = weights;
     } else {
-      // add the neighboors and their weights
-      // add the neuron weights
-      std::vector<cv::Vec4f> weights;
+      // set the neighboors weights
+      neighborsWeights.clear();
       for (size_t pos = 6; pos + 4 < fields.size();
            pos += 4) { // pos start at fields[6], then increment of
                        // the length of cv::Vec4f (4)
@@ -136,20 +150,22 @@ void NeuralNetworkImportExportCSV::importNeuronsWeights(
         auto b = fields[pos + 2];
         auto a = fields[pos + 3];
         if (r && g && b && a) {
-          weights.push_back(cv::Vec4f(*r, *g, *b, *a));
+          neighborsWeights.push_back(cv::Vec4f(*r, *g, *b, *a));
         }
       }
-      auto &connections = network->layers.at(layer_index)
-                              ->neurons[neuron_row][neuron_col]
-                              .neighbors;
-      if (connections.size() != weights.size()) {
+      auto &neighbors = network->layers.at(layer_index)->neighbors;
+      if (neighbors.count(neuron_col, neuron_row) !=
+          neighborsWeights.size()) {
         throw ImportExportException("CSV parsing error at line (" +
                                     std::to_string(current_line_number) +
                                     "): invalid column numbers");
       }
-      for (size_t i = 0; i < connections.size(); i++) {
-        connections.at(i).weight = weights.at(i);
-      }
+      size_t i = 0;
+      neighbors.forEach(
+          neuron_col, neuron_row,
+          [&neighborsWeights, &i](size_t, size_t, cv::Vec4f &weight) {
+            weight = neighborsWeights.at(i++);
+          });
     }
 
     if (progressCallback) {
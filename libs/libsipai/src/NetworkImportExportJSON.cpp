@@ -67,6 +67,8 @@ void NeuralNetworkImportExportJSON::exportModel(
       json(networkParams.hidden_activation_function);
   json_network["parameters"]["output_activation_function"] =
       json(networkParams.output_activation_function);
+  json_network["parameters"]["neighbors_radius"] =
+      json(networkParams.neighbors_radius);
 
   // Write the JSON object to the file.
   // The 4 argument specifies the indentation level of the resulting string.
@@ -139,6 +141,9 @@ NeuralNetworkImportExportJSON::importModel(const AppParams &appParams,
         json_model["parameters"]["hidden_activation_function"];
     networkParams.output_activation_function =
         json_model["parameters"]["output_activation_function"];
+    // the models without neighbors radius use the 4-neighborhood
+    networkParams.neighbors_radius =
+        json_model["parameters"].value("neighbors_radius", 1.0f);
 
     network->max_weights = json_model["max_weights"];
 
@@ -18,7 +18,7 @@ cv::Mat NeuralNetwork::forwardPropagation(const cv::Mat &inputValues) {
   for (auto &layer : layers) {
     layer->forwardPropagation();
   }
-  return ((LayerOutput *)layers.back())->getOutputValues();
+  return ((LayerOutput *)layers.back())->getOutputValues().clone();
 }
 
 void NeuralNetwork::backwardPropagation(const cv::Mat &expectedValues,
@@ -37,4 +37,136 @@ void NeuralNetwork::updateWeights(float learning_rate) {
   for (auto &layer : layers) {
     layer->updateWeights(learning_rate);
   }
-}
\ No newline at end of file
+}
+
+void NeuralNetwork::backwardPropagationAndUpdateWeights(
+    const cv::Mat &expectedValues, const float &error_min,
+    const float &error_max, float learning_rate) {
+  if (layers.back()->layerType != LayerType::LayerOutput) {
+    throw NeuralNetworkException("Invalid back layer type");
+  }
+  ((LayerOutput *)layers.back())->computeErrors(expectedValues);
+  cv::Mat propagated;
+  for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+    Layer *layer = *it;
+    Layer *previousLayer = layer->previousLayer;
+    if (previousLayer == nullptr) {
+      continue;
+    }
+    // no errors to propagate to the input layer
+    const bool propagate = previousLayer->layerType != LayerType::LayerInput;
+    layer->updateWeightsAndPropagate(previousLayer->values, layer->values,
+                                     layer->errors, learning_rate,
+                                     propagate ? &propagated : nullptr);
+    if (propagate) {
+      cv::Mat previousErrors = previousLayer->errors.reshape(4, 1);
+      previousLayer->computeErrorsFromPropagated(
+          propagated, previousLayer->values, previousErrors, error_min,
+          error_max);
+    }
+  }
+}
+
+cv::Mat NeuralNetwork::forwardPropagationBatch(const cv::Mat &inputValues) {
+  return forwardPropagationBatch(inputValues, batchValues);
+}
+
+cv::Mat
+NeuralNetwork::forwardPropagationBatch(const cv::Mat &inputValues,
+                                       std::vector<cv::Mat> &values) const {
+  if (layers.front()->layerType != LayerType::LayerInput) {
+    throw NeuralNetworkException("Invalid front layer type");
+  }
+  if (layers.back()->layerType != LayerType::LayerOutput) {
+    throw NeuralNetworkException("Invalid back layer type");
+  }
+  if (inputValues.cols != (int)layers.front()->total() ||
+      inputValues.type() != CV_32FC4) {
+    throw NeuralNetworkException("Invalid input values size");
+  }
+  values.resize(layers.size());
+  values.front() = inputValues;
+  for (size_t l = 1; l < layers.size(); ++l) {
+    layers[l]->forwardPropagation(values[l - 1], values[l]);
+  }
+  return values.back();
+}
+
+void NeuralNetwork::backwardPropagationBatch(const cv::Mat &expectedValues,
+                                             const float &error_min,
+                                             const float &error_max) {
+  backwardPropagationBatch(expectedValues, batchValues, batchErrors, error_min,
+                           error_max);
+}
+
+void NeuralNetwork::backwardPropagationBatch(const cv::Mat &expectedValues,
+                                             const std::vector<cv::Mat> &values,
+                                             std::vector<cv::Mat> &errors,
+                                             const float &error_min,
+                                             const float &error_max) const {
+  if (values.size() != layers.size()) {
+    throw NeuralNetworkException("No forward propagation of a batch");
+  }
+  errors.resize(layers.size());
+  ((LayerOutput *)layers.back())
+      ->computeErrors(expectedValues, values.back(), errors.back());
+  // no errors to propagate to the input layer
+  for (size_t l = layers.size() - 2; l > 0; --l) {
+    layers[l]->backwardPropagation(errors[l + 1], values[l], errors[l],
+                                   error_min, error_max);
+  }
+}
+
+void NeuralNetwork::updateWeightsBatch(float learning_rate) {
+  updateWeightsBatch(batchValues, batchErrors, learning_rate);
+}
+
+void NeuralNetwork::updateWeightsBatch(const std::vector<cv::Mat> &values,
+                                       const std::vector<cv::Mat> &errors,
+                                       float learning_rate) {
+  if (values.size() != layers.size() || errors.size() != layers.size()) {
+    throw NeuralNetworkException("No backward propagation of a batch");
+  }
+  // average the gradients over the samples
+  const float batchLearningRate =
+      learning_rate / static_cast<float>(values.front().rows);
+  for (size_t l = 1; l < layers.size(); ++l) {
+    layers[l]->updateWeights(values[l - 1], values[l], errors[l],
+                             batchLearningRate);
+  }
+}
+
+void NeuralNetwork::backwardPropagationAndUpdateWeightsBatch(
+    const cv::Mat &expectedValues, const float &error_min,
+    const float &error_max, float learning_rate) {
+  backwardPropagationAndUpdateWeightsBatch(expectedValues, batchValues,
+                                           batchErrors, error_min, error_max,
+                                           learning_rate);
+}
+
+void NeuralNetwork::backwardPropagationAndUpdateWeightsBatch(
+    const cv::Mat &expectedValues, const std::vector<cv::Mat> &values,
+    std::vector<cv::Mat> &errors, const float &error_min,
+    const float &error_max, float learning_rate) {
+  if (values.size() != layers.size()) {
+    throw NeuralNetworkException("No forward propagation of a batch");
+  }
+  errors.resize(layers.size());
+  ((LayerOutput *)layers.back())
+      ->computeErrors(expectedValues, values.back(), errors.back());
+  // average the gradients over the samples
+  const float batchLearningRate =
+      learning_rate / static_cast<float>(values.front().rows);
+  cv::Mat propagated;
+  for (size_t l = layers.size() - 1; l > 0; --l) {
+    // no errors to propagate to the input layer
+    const bool propagate = l > 1;
+    layers[l]->updateWeightsAndPropagate(values[l - 1], values[l], errors[l],
+                                         batchLearningRate,
+                                         propagate ? &propagated : nullptr);
+    if (propagate) {
+      layers[l - 1]->computeErrorsFromPropagated(
+          propagated, values[l - 1], errors[l - 1], error_min, error_max);
+    }
+  }
+}
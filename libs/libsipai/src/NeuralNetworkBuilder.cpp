@@ -8,6 +8,7 @@
 #include "NeuralNetworkImportExportFacade.h"
 #include "SimpleLogger.h"
 #include "exception/NeuralNetworkException.h"
+#include <algorithm>
 #include <cstddef>
 #include <filesystem>
 #include <opencv2/core/matx.hpp>
@@ -102,6 +103,22 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::bindLayers() {
   return *this;
 }
 
+NeuralNetworkBuilder &NeuralNetworkBuilder::allocateArena() {
+  SimpleLogger::LOG_INFO("Allocating the neural network memory...");
+  if (!network_) {
+    throw NeuralNetworkException("neural network null");
+  }
+  if (network_->layers.empty()) {
+    throw NeuralNetworkException("empty layers");
+  }
+  // One allocation for all the layers matrices
+  network_->arena.reserve(NetworkArena::networkBytes(network_params_));
+  for (auto layer : network_->layers) {
+    layer->initValues(network_->arena);
+  }
+  return *this;
+}
+
 NeuralNetworkBuilder &NeuralNetworkBuilder::addNeighbors() {
   SimpleLogger::LOG_INFO("Adding neurons neighbors connections...");
   if (!network_) {
@@ -111,37 +128,18 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::addNeighbors() {
     throw NeuralNetworkException("empty layers");
   }
 
-  // For each possible direction (up, down, left, right), check if there
-  // is a neuron in that direction and, if so, establish a connection
-  std::vector<std::pair<int, int>> directions = {
-      {-1, 0}, {1, 0}, {0, -1}, {0, 1}};
-
-  int counter = 0;
-  for (auto layer : network_->layers) {
+  // Connect each neuron with the neurons in its neighborhood radius, if they
+  // are inside the layer: 4-neighborhood (up, down, left, right) by default
+  for (size_t i = 0; i < network_->layers.size(); ++i) {
+    auto layer = network_->layers.at(i);
     if (layer->layerType == LayerType::LayerInput) {
       continue;
     }
-    for (auto &rows : layer->neurons) {
-      for (auto &neuron : rows) {
-        size_t pos_x = neuron.index_x;
-        size_t pos_y = neuron.index_y;
-        for (auto [dx, dy] : directions) {
-          int nx = static_cast<int>(pos_x) + dx;
-          int ny = static_cast<int>(pos_y) + dy;
-
-          if (nx >= 0 && nx < static_cast<int>(layer->size_x) && ny >= 0 &&
-              ny < static_cast<int>(layer->size_y)) {
-            Neuron &neighbor = layer->neurons[ny][nx];
-
-            cv::Vec4f weight =
-                isImported ? cv::Vec4f::all(0.0) : cv::Vec4f::randn(0.0, 1.0);
-
-            neuron.neighbors.push_back(NeuronConnection(&neighbor, weight));
-          }
-        }
-      }
+    layer->neighbors.init(layer->size_x, layer->size_y,
+                          network_params_.neighbors_radius, network_->arena);
+    if (!isImported) {
+      layer->neighbors.randomize(_getRng(), (uint32_t)i);
     }
-    counter++;
   }
 
   return *this;
@@ -149,6 +147,17 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::addNeighbors() {
 
 NeuralNetworkBuilder &NeuralNetworkBuilder::initializeWeights() {
   if (isImported) {
+    // Allocate the layers weights, to be filled by the import, and update the
+    // imported max_weights for the neighbors stencil
+    for (auto layer : network_->layers) {
+      if (layer->previousLayer != nullptr) {
+        layer->initWeights(layer->previousLayer->size_x,
+                           layer->previousLayer->size_y, network_->arena);
+        network_->max_weights =
+            std::max({network_->max_weights, layer->previousLayer->total(),
+                      layer->neighbors.offsets.size()});
+      }
+    }
     NeuralNetworkImportExportFacade neuralNetworkImportExport;
     std::string filenameCsv =
         Common::getFilenameCsv(app_params_.network_to_import);
@@ -171,15 +180,17 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::initializeWeights() {
   int counter = 0;
   for (auto layer : network_->layers) {
     if (layer->previousLayer != nullptr) {
-      for (auto &rows : layer->neurons) {
-        for (auto &n : rows) {
-          n.initWeights(layer->previousLayer->size_x,
-                        layer->previousLayer->size_y);
-          size_t new_size = layer->previousLayer->total();
-          if (new_size > network_->max_weights) {
-            network_->max_weights = new_size;
-          }
-        }
+      layer->initWeights(layer->previousLayer->size_x,
+                         layer->previousLayer->size_y, network_->arena);
+      // Random initialization, keyed on the layer, neuron and weight indexes
+      _getRng().fillNormal(layer->weights, (uint32_t)counter,
+                           ERngStream::Weights);
+      // the CSV rows have the weights or the neighbors weights of a neuron,
+      // the neighbors being more than the weights with a large radius
+      size_t new_size = std::max(layer->previousLayer->total(),
+                                 layer->neighbors.offsets.size());
+      if (new_size > network_->max_weights) {
+        network_->max_weights = new_size;
       }
     }
     _incrementProgress(60 * (counter + 1) / (int)network_->layers.size());
@@ -188,6 +199,17 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::initializeWeights() {
   return *this;
 }
 
+const CounterRng &NeuralNetworkBuilder::_getRng() {
+  if (!rng_) {
+    const uint64_t seed = app_params_.seed != NO_SEED
+                              ? (uint64_t)app_params_.seed
+                              : CounterRng::randomSeed();
+    SimpleLogger::LOG_INFO("Weights initialization seed: ", seed);
+    rng_ = std::make_unique<CounterRng>(seed);
+  }
+  return *rng_;
+}
+
 NeuralNetworkBuilder &NeuralNetworkBuilder::setActivationFunction() {
   SimpleLogger::LOG_INFO("Setting neurons activation functions...");
   if (!network_) {
@@ -216,38 +238,10 @@ NeuralNetworkBuilder &NeuralNetworkBuilder::setActivationFunction() {
       continue;
     }
     // Set the activation functions
-    switch (activation_function) {
-    case EActivationFunction::ELU:
-      layer->setActivationFunction(
-          [activation_alpha](auto x) { return elu(x, activation_alpha); },
-          [activation_alpha](auto x) {
-            return eluDerivative(x, activation_alpha);
-          });
-      break;
-    case EActivationFunction::LReLU:
-      layer->setActivationFunction(leakyRelu, leakyReluDerivative);
-      break;
-    case EActivationFunction::PReLU:
-      layer->setActivationFunction(
-          [activation_alpha](auto x) {
-            return parametricRelu(x, activation_alpha);
-          },
-          [activation_alpha](auto x) {
-            return parametricReluDerivative(x, activation_alpha);
-          });
-      break;
-    case EActivationFunction::ReLU:
-      layer->setActivationFunction(relu, reluDerivative);
-      break;
-    case EActivationFunction::Sigmoid:
-      layer->setActivationFunction(sigmoid, sigmoidDerivative);
-      break;
-    case EActivationFunction::Tanh:
-      layer->setActivationFunction(tanhFunc, tanhDerivative);
-      break;
-    default:
+    if (getActivationStr(activation_function).empty()) {
       throw NeuralNetworkException("Unimplemented Activation Function");
     }
+    layer->setActivationFunction(activation_function, activation_alpha);
     counter++;
   }
 
@@ -1,13 +1,99 @@
 #include "RunnerEnhancerOpenCVVisitor.h"
+#include "DataPrefetcher.h"
 #include "ImageHelper.h"
+#include "ImageStrips.h"
+#include "InferenceSession.h"
 #include "Manager.h"
 #include "SimpleLogger.h"
+#include "csv_parser.h"
 #include "exception/RunnerVisitorException.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <memory>
+#include <set>
+#include <sstream>
+#include <tbb/global_control.h>
+#include <tbb/parallel_for.h>
 
 using namespace sipai;
 
+namespace {
+// The images of a batch enhancement, from the input folder or the input list
+std::vector<std::string> getBatchInputs(const AppParams &app_params) {
+  std::vector<std::string> inputs;
+  if (!app_params.input_folder.empty()) {
+    for (const auto &entry :
+         std::filesystem::directory_iterator(app_params.input_folder)) {
+      std::string extension = entry.path().extension().string();
+      std::transform(extension.begin(), extension.end(), extension.begin(),
+                     ::tolower);
+      if (entry.is_regular_file() && valid_extensions.contains(extension)) {
+        inputs.push_back(entry.path().string());
+      }
+    }
+    // the same order whatever the file system
+    std::sort(inputs.begin(), inputs.end());
+    return inputs;
+  }
+
+  // CSV list: the input image path in the first column, no headers
+  std::ifstream file(app_params.input_list);
+  if (!file.is_open()) {
+    throw RunnerVisitorException("Failed to open file: " +
+                                 app_params.input_list);
+  }
+  std::stringstream content;
+  content << file.rdbuf();
+  const std::string csv = content.str();
+  std::vector<std::vector<Csv::CellReference>> columns;
+  try {
+    Csv::Parser().parseTo2DVector(csv, columns);
+  } catch (const Csv::ParseError &ex) {
+    throw RunnerVisitorException("Invalid input list " +
+                                 app_params.input_list + ": " + ex.what());
+  }
+  if (!columns.empty()) {
+    for (auto &cell : columns.front()) {
+      if (auto path = cell.getCleanString(); path && !path->empty()) {
+        inputs.push_back(*path);
+      }
+    }
+  }
+  return inputs;
+}
+
+// The output images of a batch enhancement, with the input file names. Two
+// inputs can't have the same output, nor an input be overwritten by its
+// output.
+std::vector<std::string> getBatchOutputs(const std::vector<std::string> &inputs,
+                                         const std::string &outputFolder) {
+  std::vector<std::string> outputs;
+  std::set<std::string> names;
+  for (const auto &input : inputs) {
+    const auto name = std::filesystem::path(input).filename();
+    if (!names.insert(name.string()).second) {
+      throw RunnerVisitorException("Several input images named " +
+                                   name.string() +
+                                   ", with the same output. Aborting.");
+    }
+    const auto output = std::filesystem::path(outputFolder) / name;
+    if (std::filesystem::exists(output) && std::filesystem::exists(input) &&
+        std::filesystem::equivalent(input, output)) {
+      throw RunnerVisitorException("The input image " + input +
+                                   " would be overwritten. Aborting.");
+    }
+    outputs.push_back(output.string());
+  }
+  return outputs;
+}
+} // namespace
+
 void RunnerEnhancerOpenCVVisitor::visit() const {
   SimpleLogger::LOG_INFO("Image enhancement...");
   auto &manager = Manager::getInstance();
@@ -16,16 +102,29 @@ void RunnerEnhancerOpenCVVisitor::visit() const {
     throw RunnerVisitorException("No neural network. Aborting.");
   }
 
-  if (manager.app_params.input_file.empty()) {
+  const auto &app_params = manager.app_params;
+  if (!app_params.input_folder.empty() || !app_params.input_list.empty()) {
+    if (app_params.output_folder.empty()) {
+      throw RunnerVisitorException("No output folder. Aborting.");
+    }
+    _enhanceBatch();
+    return;
+  }
+
+  if (app_params.input_file.empty()) {
     throw RunnerVisitorException("No input file. Aborting.");
   }
 
-  if (manager.app_params.output_file.empty()) {
+  if (app_params.output_file.empty()) {
     throw RunnerVisitorException("No output file. Aborting.");
   }
 
+  if (app_params.stream_tile_size > 0) {
+    _enhanceStreaming();
+    return;
+  }
+
   try {
-    const auto &app_params = manager.app_params;
     const auto &network_params = manager.network_params;
 
     // Load input image parts
@@ -34,31 +133,334 @@ void RunnerEnhancerOpenCVVisitor::visit() const {
         app_params.enable_padding, network_params.input_size_x,
         network_params.input_size_y);
 
-    // Get output image parts by forward propagation
-    ImageParts outputParts;
-    for (const auto &inputPart : inputImage) {
-      const auto &outputData =
-          manager.network->forwardPropagation(inputPart->data);
-      Image output{.data = outputData,
-                   .orig_height = inputPart->orig_height,
-                   .orig_width = inputPart->orig_width,
-                   .orig_type = inputPart->orig_type,
-                   .orig_channels = inputPart->orig_channels};
-      outputParts.push_back(std::make_unique<Image>(output));
+    // Get output image parts by forward propagation, and save them as a
+    // single image
+    auto sessions = _createSessions();
+    _saveImage(app_params.output_file, _enhance(sessions, inputImage));
+
+    SimpleLogger::LOG_INFO("Image enhancement done. Image output saved in ",
+                           manager.app_params.output_file);
+
+  } catch (std::exception &ex) {
+    throw RunnerVisitorException(ex.what());
+  }
+}
+
+void RunnerEnhancerOpenCVVisitor::_enhanceBatch() const {
+  const auto &manager = Manager::getConstInstance();
+  const auto &app_params = manager.app_params;
+  const auto &network_params = manager.network_params;
+
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  try {
+    if (!app_params.input_folder.empty() &&
+        std::filesystem::exists(app_params.output_folder) &&
+        std::filesystem::equivalent(app_params.input_folder,
+                                    app_params.output_folder)) {
+      throw RunnerVisitorException(
+          "The output folder is the input folder, the input images would be "
+          "overwritten. Aborting.");
     }
+    inputs = getBatchInputs(app_params);
+    outputs = getBatchOutputs(inputs, app_params.output_folder);
+    std::filesystem::create_directories(app_params.output_folder);
+  } catch (const RunnerVisitorException &) {
+    throw;
+  } catch (std::exception &ex) {
+    throw RunnerVisitorException(ex.what());
+  }
+  SimpleLogger::LOG_INFO("Batch enhancement of ", inputs.size(),
+                         " images into ", app_params.output_folder, "...");
+  if (inputs.empty()) {
+    return;
+  }
 
-    // Save the output image parts as a single image
-    size_t outputSizeX = outputParts.front()->orig_width;
-    size_t outputSizeY = outputParts.front()->orig_height;
-    imageHelper_.saveImage(app_params.output_file, outputParts,
-                           app_params.image_split,
-                           (size_t)(outputSizeX * app_params.output_scale),
-                           (size_t)(outputSizeY * app_params.output_scale));
+  // Pipeline: the workers load the next images while the network enhances
+  // the current one, and the previous ones are saved in background
+  std::atomic<size_t> failures = 0;
+  DataPrefetcher prefetcher(
+      inputs.size(), app_params.loading_workers, app_params.prefetch_size,
+      [this, &inputs, &outputs, &app_params, &network_params,
+       &failures](size_t i) {
+        auto data = std::make_shared<Data>(
+            Data{.file_input = inputs[i], .file_output = outputs[i]});
+        try {
+          data->img_input = imageHelper_.loadImage(
+              data->file_input, app_params.image_split,
+              app_params.enable_padding, network_params.input_size_x,
+              network_params.input_size_y);
+        } catch (std::exception &ex) {
+          // skipped, without stopping the batch
+          SimpleLogger::LOG_ERROR("Failed to load ", data->file_input, ": ",
+                                  ex.what());
+          failures++;
+        }
+        return data;
+      });
+
+  auto sessions = _createSessions();
+  const size_t maxSaving = std::max(app_params.loading_workers, (size_t)1);
+  std::deque<std::future<void>> saving;
+  size_t enhanced = 0;
+  while (auto data = prefetcher.next()) {
+    if (data->img_input.empty()) {
+      continue;
+    }
+    Image output;
+    try {
+      output = _enhance(sessions, data->img_input);
+    } catch (std::exception &ex) {
+      SimpleLogger::LOG_ERROR("Failed to enhance ", data->file_input, ": ",
+                              ex.what());
+      failures++;
+      continue;
+    }
+    if (saving.size() >= maxSaving) {
+      saving.front().get();
+      saving.pop_front();
+    }
+    saving.push_back(std::async(
+        std::launch::async,
+        [this, &failures, path = data->file_output, output]() {
+          try {
+            _saveImage(path, output);
+          } catch (std::exception &ex) {
+            SimpleLogger::LOG_ERROR("Failed to save ", path, ": ", ex.what());
+            failures++;
+          }
+        }));
+    enhanced++;
+    if (app_params.verbose) {
+      SimpleLogger::LOG_INFO("Enhanced ", data->file_input, " (", enhanced,
+                             "/", inputs.size(), ")");
+    }
+  }
+  for (auto &future : saving) {
+    future.get();
+  }
+
+  if (failures > 0) {
+    throw RunnerVisitorException(std::to_string(failures) + " of " +
+                                 std::to_string(inputs.size()) +
+                                 " images could not be enhanced.");
+  }
+  SimpleLogger::LOG_INFO("Batch enhancement done. ", inputs.size(),
+                         " images output saved in ", app_params.output_folder);
+}
+
+void RunnerEnhancerOpenCVVisitor::_enhanceStreaming() const {
+  const auto &manager = Manager::getConstInstance();
+  const auto &app_params = manager.app_params;
+  if (!ImageStripWriter::isSupported(app_params.output_file)) {
+    throw RunnerVisitorException(
+        "The streaming enhancement output file must be a TIFF image: " +
+        app_params.output_file);
+  }
+  const int tileSize = (int)app_params.stream_tile_size;
+  const int halo = (int)app_params.stream_tile_halo;
+  if (2 * halo >= tileSize) {
+    throw RunnerVisitorException(
+        "The stream tile halo must be less than half the stream tile size.");
+  }
+
+  try {
+    ImageStripReader reader(app_params.input_file);
+    if (!reader.isMapped()) {
+      SimpleLogger::LOG_INFO("Input image not memory mapped, decoded in 8 "
+                             "bits before its streaming enhancement.");
+    }
+    const int width = reader.width();
+    const int height = reader.height();
+    const int outWidth = std::max((int)(width * app_params.output_scale), 1);
+    const int outHeight =
+        std::max((int)(height * app_params.output_scale), 1);
+    ImageStripWriter writer(app_params.output_file, outWidth, outHeight,
+                            reader.channels());
+
+    // Each tile is enhanced with its halo, then its output is added to the
+    // output strip with its feather weights. The rows overlapped by the next
+    // strip are carried to it, the others are written.
+    auto sessions = _createSessions();
+    const size_t tilesX = (width + tileSize - 1) / tileSize;
+    cv::Mat carried(0, outWidth, CV_32FC4);
+    int carriedY = 0; // output row of the first carried row
+    for (int y = 0; y < height; y += tileSize) {
+      const int rows = std::min(tileSize, height - y);
+      const int readY = std::max(y - halo, 0);
+      const int readEnd = std::min(y + rows + halo, height);
+      const cv::Mat strip = reader.readRows(readY, readEnd - readY);
+      const int tileOutY =
+          toOutputPosition(readY, height, outHeight) - carriedY;
+      const auto weightsY =
+          featherWeights(y, y + rows, halo, height, outHeight);
+      cv::Mat blended(toOutputPosition(readEnd, height, outHeight) - carriedY,
+                      outWidth, CV_32FC4, cv::Scalar::all(0));
+      cv::Mat carriedRows = blended.rowRange(0, carried.rows);
+      carried.copyTo(carriedRows);
+
+      // The neighbor tiles overlap: the even tiles, then the odd ones. Each
+      // worker enhances the next tiles with its own session.
+      for (size_t parity : {0, 1}) {
+        const size_t count = (tilesX + 1 - parity) / 2;
+        const size_t workers = std::min(sessions.size(), count);
+        std::atomic<size_t> next = 0;
+        tbb::parallel_for((size_t)0, workers, [&](size_t k) {
+          auto &session = sessions.at(k);
+          for (size_t i = next++; i < count; i = next++) {
+            const int x = (int)(2 * i + parity) * tileSize;
+            const int cols = std::min(tileSize, width - x);
+            const int readX = std::max(x - halo, 0);
+            const int readEndX = std::min(x + cols + halo, width);
+            const int tileOutX = toOutputPosition(readX, width, outWidth);
+            const cv::Size outputSize(
+                toOutputPosition(readEndX, width, outWidth) - tileOutX,
+                (int)weightsY.size());
+            if (outputSize.area() == 0) {
+              continue;
+            }
+            const auto weightsX =
+                featherWeights(x, x + cols, halo, width, outWidth);
+            const cv::Mat values = _enhanceTile(
+                session,
+                strip(cv::Rect(readX, 0, readEndX - readX, strip.rows)),
+                tileSize + 2 * halo, outputSize);
+            for (int r = 0; r < outputSize.height; ++r) {
+              const auto *src = values.ptr<cv::Vec4f>(r);
+              auto *dst = blended.ptr<cv::Vec4f>(tileOutY + r) + tileOutX;
+              for (int c = 0; c < outputSize.width; ++c) {
+                dst[c] += src[c] * (weightsY[r] * weightsX[c]);
+              }
+            }
+          }
+        });
+      }
+
+      // the rows before the next strip halo are complete
+      const int done =
+          y + rows < height
+              ? toOutputPosition(y + rows - halo, height, outHeight) - carriedY
+              : blended.rows;
+      if (done > 0) {
+        writer.writeRows(imageHelper_.convertFromValues(
+            blended.rowRange(0, done), reader.type(), reader.channels()));
+      }
+      carried = blended.rowRange(done, blended.rows).clone();
+      carriedY += done;
+      if (app_params.verbose) {
+        SimpleLogger::LOG_INFO("Enhanced rows ", y + rows, "/", height);
+      }
+    }
+    writer.close();
 
     SimpleLogger::LOG_INFO("Image enhancement done. Image output saved in ",
-                           manager.app_params.output_file);
+                           app_params.output_file);
 
   } catch (std::exception &ex) {
     throw RunnerVisitorException(ex.what());
   }
-}
\ No newline at end of file
+}
+
+std::vector<InferenceSession>
+RunnerEnhancerOpenCVVisitor::_createSessions() const {
+  const auto &network = *Manager::getConstInstance().network;
+  const size_t workers = tbb::global_control::active_value(
+      tbb::global_control::max_allowed_parallelism);
+  std::vector<InferenceSession> sessions;
+  sessions.reserve(workers);
+  for (size_t k = 0; k < workers; ++k) {
+    sessions.emplace_back(network);
+  }
+  return sessions;
+}
+
+Image RunnerEnhancerOpenCVVisitor::_enhance(
+    std::vector<InferenceSession> &sessions,
+    const ImageParts &inputParts) const {
+  const auto &manager = Manager::getConstInstance();
+  const auto &outputLayer = manager.network->layers.back();
+  const int partRows = (int)outputLayer->size_y;
+  const int partCols = (int)outputLayer->size_x;
+  // the parts are in rows, as split by the ImageHelper: less than image_split
+  // parts per row for the small images
+  const auto &first = inputParts.front();
+  size_t splitsX = 1;
+  if (inputParts.size() > 1) {
+    const size_t split = manager.app_params.image_split;
+    const size_t partSizeX = (first->orig_width + split - 1) / split;
+    splitsX = (first->orig_width + partSizeX - 1) / partSizeX;
+  }
+  const size_t splitsY = (inputParts.size() + splitsX - 1) / splitsX;
+
+  Image output{.data = cv::Mat((int)splitsY * partRows,
+                               (int)splitsX * partCols, CV_32FC4),
+               .orig_height = first->orig_height,
+               .orig_width = first->orig_width,
+               .orig_type = first->orig_type,
+               .orig_channels = first->orig_channels};
+
+  // Each worker propagates the next parts with its own session, into their
+  // place in the output image
+  std::atomic<size_t> next = 0;
+  const size_t workers = std::min(sessions.size(), inputParts.size());
+  tbb::parallel_for((size_t)0, workers, [&](size_t k) {
+    auto &session = sessions.at(k);
+    for (size_t i = next++; i < inputParts.size(); i = next++) {
+      cv::Mat roi = output.data(cv::Rect((int)(i % splitsX) * partCols,
+                                         (int)(i / splitsX) * partRows,
+                                         partCols, partRows));
+      session.forwardPropagation(inputParts.at(i)->data).copyTo(roi);
+    }
+  });
+  // the black padding of the right and bottom parts is not part of the image
+  if (manager.app_params.enable_padding) {
+    imageHelper_.cropPadding(output, manager.app_params.image_split);
+  }
+  return output;
+}
+
+void RunnerEnhancerOpenCVVisitor::_saveImage(const std::string &path,
+                                             const Image &output) const {
+  const auto &app_params = Manager::getConstInstance().app_params;
+  imageHelper_.saveImage(
+      path, output, (size_t)(output.orig_width * app_params.output_scale),
+      (size_t)(output.orig_height * app_params.output_scale));
+}
+
+cv::Mat RunnerEnhancerOpenCVVisitor::_enhanceTile(
+    InferenceSession &session, const cv::Mat &tile, int tileSize,
+    const cv::Size &outputSize) const {
+  const auto &manager = Manager::getConstInstance();
+  const auto &network_params = manager.network_params;
+  const bool padded = tile.cols != tileSize || tile.rows != tileSize;
+
+  // the edge tiles are padded on the right and bottom to the size of the
+  // full tiles, so that all the tiles are scaled alike to the input layer:
+  // black (cv::Scalar(0,0,0)) as the image parts if the padding is enabled,
+  // else the reflected tile border, to avoid seams at the image borders
+  Image input{.data = cv::Mat(tile.size(), CV_32FC4)};
+  imageHelper_.convertToValues(tile, input.data);
+  if (padded) {
+    cv::Mat paddedTile;
+    if (manager.app_params.enable_padding) {
+      cv::copyMakeBorder(input.data, paddedTile, 0, tileSize - tile.rows, 0,
+                         tileSize - tile.cols, cv::BORDER_CONSTANT,
+                         cv::Scalar(0, 0, 0));
+    } else {
+      cv::copyMakeBorder(input.data, paddedTile, 0, tileSize - tile.rows, 0,
+                         tileSize - tile.cols, cv::BORDER_REFLECT);
+    }
+    input.data = paddedTile;
+  }
+  input.resize(network_params.input_size_x, network_params.input_size_y);
+
+  Image output{.data = session.forwardPropagation(input.data)};
+  if (padded) {
+    // only the output of the tile, without the padding
+    output.data = output.data(cv::Rect(
+        0, 0, std::max(output.data.cols * tile.cols / tileSize, 1),
+        std::max(output.data.rows * tile.rows / tileSize, 1)));
+  }
+  output.resize(outputSize.width, outputSize.height);
+  return output.data;
+}
@@ -17,6 +17,17 @@ void RunnerEnhancerVulkanVisitor::visit() const {
     throw RunnerVisitorException("No neural network. Aborting.");
   }
 
+  if (!manager.app_params.input_folder.empty() ||
+      !manager.app_params.input_list.empty()) {
+    throw RunnerVisitorException(
+        "Batch enhancement is not implemented with Vulkan. Aborting.");
+  }
+
+  if (manager.app_params.stream_tile_size > 0) {
+    throw RunnerVisitorException(
+        "Streaming enhancement is not implemented with Vulkan. Aborting.");
+  }
+
   if (manager.app_params.input_file.empty()) {
     throw RunnerVisitorException("No input file. Aborting.");
   }
@@ -44,7 +55,7 @@ void RunnerEnhancerVulkanVisitor::visit() const {
     ImageParts outputParts;
     for (const auto &inputPart : inputImage) {
       VulkanController::getInstance().forwardEnhancer(inputPart->data);
-      Image output{.data = outputLayer->values,
+      Image output{.data = outputLayer->values.clone(),
                    .orig_height = inputPart->orig_height,
                    .orig_width = inputPart->orig_width,
                    .orig_type = inputPart->orig_type,
@@ -58,7 +69,8 @@ void RunnerEnhancerVulkanVisitor::visit() const {
     imageHelper_.saveImage(app_params.output_file, outputParts,
                            app_params.image_split,
                            (size_t)(outputSizeX * app_params.output_scale),
-                           (size_t)(outputSizeY * app_params.output_scale));
+                           (size_t)(outputSizeY * app_params.output_scale),
+                           app_params.enable_padding);
 
     SimpleLogger::LOG_INFO("Image enhancement done. Image output saved in ",
                            manager.app_params.output_file);
@@ -2,19 +2,42 @@
 #include "AppParams.h"
 #include "Common.h"
 #include "ImageHelper.h"
+#include "LayerKernels.h"
 #include "Manager.h"
 #include "SimpleLogger.h"
 #include "TrainingDataFactory.h"
 #include "exception/RunnerVisitorException.h"
+#include <algorithm>
+#include <tbb/parallel_for.h>
 #include <cstddef>
 #include <exception>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 using namespace sipai;
 
+namespace {
+// Copy an image part into a row of a mini-batch matrix.
+void copyToRow(const cv::Mat &part, cv::Mat row) {
+  if (part.total() != (size_t)row.cols || part.type() != row.type()) {
+    throw ImageHelperException("internal exception: invalid part size.");
+  }
+  const cv::Mat continuous = part.isContinuous() ? part : part.clone();
+  continuous.reshape(row.channels(), 1).copyTo(row);
+}
+
+// The weights shared by the Hogwild workers, while in scope
+struct SharedWeightsScope {
+  SharedWeightsScope() { kernels::setSharedWeights(true); }
+  ~SharedWeightsScope() { kernels::setSharedWeights(false); }
+  SharedWeightsScope(const SharedWeightsScope &) = delete;
+  void operator=(const SharedWeightsScope &) = delete;
+};
+} // namespace
+
 void RunnerTrainingOpenCVVisitor::visit() const {
   SimpleLogger::LOG_INFO(
       "Starting training monitored, press (CTRL+C) to stop at anytime...");
@@ -128,6 +151,14 @@ void RunnerTrainingOpenCVVisitor::visit() const {
 float RunnerTrainingOpenCVVisitor::training(size_t epoch,
                                             TrainingPhase phase) const {
 
+  const auto &app_params = Manager::getConstInstance().app_params;
+  if (app_params.training_workers > 1) {
+    return parallelTraining(epoch, phase);
+  }
+  if (app_params.batch_size > 1) {
+    return batchTraining(epoch, phase);
+  }
+
   // Initialize the total loss to 0
   float loss = 0.0f;
   size_t lossComputed = 0;
@@ -135,7 +166,6 @@ float RunnerTrainingOpenCVVisitor::training(size_t epoch,
   bool isLossFrequency = false;
   auto &trainingDataFactory = TrainingDataFactory::getInstance();
   trainingDataFactory.resetCounters();
-  const auto &app_params = Manager::getConstInstance().app_params;
 
   // Compute the frequency at which the loss should be computed
   size_t lossFrequency = std::max(
@@ -239,7 +269,17 @@ float RunnerTrainingOpenCVVisitor::_training(size_t epoch,
 
     // If backward propagation and weight update should be performed, perform
     // them
-    if (phase == TrainingPhase::Training) {
+    if (phase == TrainingPhase::Training &&
+        manager.app_params.enable_fused_training) {
+      if (manager.app_params.verbose_debug) {
+        SimpleLogger::LOG_DEBUG("fused backward propagation and weights "
+                                "update part ",
+                                i + 1, "/", data->img_input.size(), "...");
+      }
+      manager.network->backwardPropagationAndUpdateWeights(
+          targetPart->data, error_min, error_max,
+          manager.network_params.learning_rate);
+    } else if (phase == TrainingPhase::Training) {
       if (manager.app_params.verbose_debug) {
         SimpleLogger::LOG_DEBUG("backward propagation part ", i + 1, "/",
                                 data->img_input.size(), "...");
@@ -266,3 +306,274 @@ float RunnerTrainingOpenCVVisitor::_training(size_t epoch,
   }
   return (partsLoss / static_cast<float>(partsLossComputed));
 }
+
+float RunnerTrainingOpenCVVisitor::batchTraining(size_t epoch,
+                                                 TrainingPhase phase) const {
+  auto &manager = Manager::getInstance();
+  const auto &app_params = manager.app_params;
+  const auto &layers = manager.network->layers;
+  PartsFeeder feeder(epoch, phase);
+
+  // The mini-batch of parts, possibly from different images, one row per part
+  BatchBuffers batch(app_params.batch_size, layers.front()->total(),
+                     layers.back()->total());
+
+  while (!stopTrainingNow && feeder.fill(batch) > 0) {
+    _batchTraining(batch, phase, true);
+  }
+  return batch.averageLoss();
+}
+
+float RunnerTrainingOpenCVVisitor::parallelTraining(size_t epoch,
+                                                    TrainingPhase phase) const {
+  auto &manager = Manager::getInstance();
+  const auto &app_params = manager.app_params;
+  const auto &layers = manager.network->layers;
+  PartsFeeder feeder(epoch, phase);
+
+  // Each worker owns its mini-batch, and its layers values and errors buffers
+  std::vector<BatchBuffers> workers;
+  workers.reserve(app_params.training_workers);
+  for (size_t k = 0; k < app_params.training_workers; ++k) {
+    workers.emplace_back(app_params.batch_size, layers.front()->total(),
+                         layers.back()->total());
+  }
+
+  if (app_params.enable_hogwild) {
+    // Lock-free: each worker updates the shared weights on its own, without
+    // waiting for the other workers, see kernels::setSharedWeights()
+    SharedWeightsScope sharedWeights;
+    tbb::parallel_for((size_t)0, workers.size(), [&](size_t k) {
+      auto &worker = workers.at(k);
+      while (!stopTrainingNow && feeder.fill(worker) > 0) {
+        _batchTraining(worker, phase, true);
+      }
+    });
+  } else {
+    // Synchronous: the workers propagate their mini-batches concurrently, then
+    // the weights are updated once with the gradients averaged over all of
+    // them. The layers values and errors of all the workers are in one matrix
+    // per layer, each worker owning a range of rows, so that the update reads
+    // them without copies.
+    const int batchSize = (int)app_params.batch_size;
+    const int allRows = batchSize * (int)workers.size();
+    std::vector<cv::Mat> values(layers.size());
+    std::vector<cv::Mat> errors(layers.size());
+    // no errors for the input layer
+    for (size_t l = 0; l < layers.size(); ++l) {
+      values.at(l).create(allRows, (int)layers.at(l)->total(), CV_32FC4);
+      if (l > 0) {
+        errors.at(l).create(allRows, (int)layers.at(l)->total(), CV_32FC4);
+      }
+    }
+    for (size_t k = 0; k < workers.size(); ++k) {
+      workers.at(k).inputs = values.front().rowRange(
+          (int)k * batchSize, ((int)k + 1) * batchSize);
+    }
+    std::vector<cv::Mat> batchValues(layers.size());
+    std::vector<cv::Mat> batchErrors(layers.size());
+    while (!stopTrainingNow) {
+      // the workers rows are contiguous, as only the last mini-batch of a
+      // phase is not full
+      size_t active = 0;
+      int rows = 0;
+      while (active < workers.size()) {
+        auto &worker = workers.at(active);
+        const int parts = (int)feeder.fill(worker);
+        if (parts == 0) {
+          break;
+        }
+        // the layers outputs are created in place, having the batch size
+        worker.values.resize(layers.size());
+        worker.errors.resize(layers.size());
+        for (size_t l = 1; l < layers.size(); ++l) {
+          worker.values.at(l) = values.at(l).rowRange(rows, rows + parts);
+          worker.errors.at(l) = errors.at(l).rowRange(rows, rows + parts);
+        }
+        rows += parts;
+        active++;
+        if (parts < batchSize) {
+          break;
+        }
+      }
+      if (active == 0) {
+        break;
+      }
+      tbb::parallel_for((size_t)0, active, [&](size_t k) {
+        _batchTraining(workers.at(k), phase, false);
+      });
+      if (stopTrainingNow || phase != TrainingPhase::Training) {
+        continue;
+      }
+      for (size_t l = 0; l < layers.size(); ++l) {
+        batchValues.at(l) = values.at(l).rowRange(0, rows);
+        if (l > 0) {
+          batchErrors.at(l) = errors.at(l).rowRange(0, rows);
+        }
+      }
+      if (app_params.verbose_debug) {
+        SimpleLogger::LOG_DEBUG("weights update of ", active,
+                                " workers batches...");
+      }
+      manager.network->updateWeightsBatch(batchValues, batchErrors,
+                                          manager.network_params.learning_rate);
+    }
+  }
+
+  // Return the average loss over all images for which the loss was computed
+  float loss = 0.0f;
+  size_t lossComputed = 0;
+  for (const auto &worker : workers) {
+    loss += worker.loss;
+    lossComputed += worker.lossComputed;
+  }
+  if (lossComputed == 0) {
+    return 0;
+  }
+  return (loss / static_cast<float>(lossComputed));
+}
+
+void RunnerTrainingOpenCVVisitor::_batchTraining(BatchBuffers &batch,
+                                                 TrainingPhase phase,
+                                                 bool updateWeights) const {
+  auto &manager = Manager::getInstance();
+  const auto &error_min = manager.network_params.error_min;
+  const auto &error_max = manager.network_params.error_max;
+  const int rows = (int)batch.lossWeights.size();
+  const cv::Mat inputs = batch.inputs.rowRange(0, rows);
+  const cv::Mat targets = batch.targets.rowRange(0, rows);
+
+  // Perform forward propagation of all the parts at once
+  if (manager.app_params.verbose_debug) {
+    SimpleLogger::LOG_DEBUG("forward propagation of a batch of ", rows,
+                            " parts...");
+  }
+  const auto &outputData =
+      manager.network->forwardPropagationBatch(inputs, batch.values);
+
+  // Compute the loss of the parts of the images for which it should be
+  // computed, weighted to average it per image
+  for (int b = 0; b < rows; b++) {
+    if (batch.lossWeights.at(b) > 0.0f) {
+      batch.loss += batch.lossWeights.at(b) *
+                    imageHelper_.computeLoss(outputData.row(b), targets.row(b));
+    }
+  }
+  if (stopTrainingNow || phase != TrainingPhase::Training) {
+    return;
+  }
+
+  // Perform backward propagation, and one weights update for all the parts
+  if (updateWeights && manager.app_params.enable_fused_training) {
+    if (manager.app_params.verbose_debug) {
+      SimpleLogger::LOG_DEBUG("fused backward propagation and weights update "
+                              "of the batch...");
+    }
+    manager.network->backwardPropagationAndUpdateWeightsBatch(
+        targets, batch.values, batch.errors, error_min, error_max,
+        manager.network_params.learning_rate);
+    return;
+  }
+  if (manager.app_params.verbose_debug) {
+    SimpleLogger::LOG_DEBUG("backward propagation of the batch...");
+  }
+  manager.network->backwardPropagationBatch(targets, batch.values, batch.errors,
+                                            error_min, error_max);
+  if (stopTrainingNow || !updateWeights) {
+    return;
+  }
+  if (manager.app_params.verbose_debug) {
+    SimpleLogger::LOG_DEBUG("weights update of the batch...");
+  }
+  manager.network->updateWeightsBatch(batch.values, batch.errors,
+                                      manager.network_params.learning_rate);
+}
+
+RunnerTrainingOpenCVVisitor::BatchBuffers::BatchBuffers(size_t batchSize,
+                                                        size_t inputTotal,
+                                                        size_t outputTotal)
+    : inputs((int)batchSize, (int)inputTotal, CV_32FC4),
+      targets((int)batchSize, (int)outputTotal, CV_32FC4) {
+  lossWeights.reserve(batchSize);
+}
+
+float RunnerTrainingOpenCVVisitor::BatchBuffers::averageLoss() const {
+  if (lossComputed == 0) {
+    return 0;
+  }
+  return (loss / static_cast<float>(lossComputed));
+}
+
+RunnerTrainingOpenCVVisitor::PartsFeeder::PartsFeeder(size_t epoch,
+                                                      TrainingPhase phase)
+    : epoch_(epoch), phase_(phase) {
+  auto &trainingDataFactory = TrainingDataFactory::getInstance();
+  trainingDataFactory.resetCounters();
+  // Compute the frequency at which the loss should be computed
+  lossFrequency_ = std::max(
+      static_cast<size_t>(std::sqrt(trainingDataFactory.getSize(phase))),
+      (size_t)1);
+}
+
+size_t RunnerTrainingOpenCVVisitor::PartsFeeder::fill(BatchBuffers &batch) {
+  auto &trainingDataFactory = TrainingDataFactory::getInstance();
+  const auto &app_params = Manager::getConstInstance().app_params;
+  batch.lossWeights.clear();
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (batch.lossWeights.size() < (size_t)batch.inputs.rows &&
+         !stopTrainingNow) {
+    // Get the next image when all the parts of the current one are used
+    if (!data_ || part_ >= data_->img_input.size()) {
+      if (loaded_.empty()) {
+        // Load it without the lock, the other workers using the current
+        // image parts or loading their own image meanwhile
+        const auto loader = trainingDataFactory.nextLoader(phase_);
+        if (!loader) {
+          break;
+        }
+        lock.unlock();
+        auto data = loader();
+        lock.lock();
+        if (data) {
+          loaded_.push_back(std::move(data));
+        }
+        continue;
+      }
+      data_ = loaded_.front();
+      loaded_.pop_front();
+      part_ = 0;
+      if (data_->img_input.size() != data_->img_target.size()) {
+        throw ImageHelperException("internal exception: input and target "
+                                   "parts have different sizes.");
+      }
+      counter_++;
+      if (app_params.verbose) {
+        SimpleLogger::LOG_INFO("Epoch: ", epoch_ + 1, ", ",
+                               Common::getTrainingPhaseStr(phase_), ": ",
+                               "image ", counter_, "/",
+                               trainingDataFactory.getSize(phase_), "...");
+      }
+      // Check if the loss should be computed for the current image parts
+      isLossFrequency_ = counter_ % lossFrequency_ == 0 ? true : false;
+    }
+
+    // Add the image part to the mini-batch, copied without the lock
+    const auto data = data_;
+    const size_t part = part_++;
+    const int row = (int)batch.lossWeights.size();
+    if (isLossFrequency_) {
+      batch.lossWeights.push_back(1.0f / (float)data->img_input.size());
+      if (part == 0) {
+        batch.lossComputed++;
+      }
+    } else {
+      batch.lossWeights.push_back(0.0f);
+    }
+    lock.unlock();
+    copyToRow(data->img_input.at(part)->data, batch.inputs.row(row));
+    copyToRow(data->img_target.at(part)->data, batch.targets.row(row));
+    lock.lock();
+  }
+  return batch.lossWeights.size();
+}
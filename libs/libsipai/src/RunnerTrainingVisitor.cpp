@@ -1,6 +1,7 @@
 #include "RunnerTrainingVisitor.h"
 #include "Manager.h"
 #include "SimpleLogger.h"
+#include "TrainingDataFactory.h"
 
 using namespace sipai;
 
@@ -88,6 +89,7 @@ void RunnerTrainingVisitor::logTrainingProgress(
   SimpleLogger::LOG_INFO(
       "Epoch: ", epoch + 1, ", Train Loss: ", trainingLoss * 100.0f,
       "%, Validation Loss: ", validationLoss * 100.0f, "%", delta.str());
+  TrainingDataFactory::getInstance().logCacheStatistics();
 }
 
 void RunnerTrainingVisitor::saveNetwork(bool &hasLastEpochBeenSaved) const {
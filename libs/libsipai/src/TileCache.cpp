@@ -0,0 +1,158 @@
+#include "TileCache.h"
+#include "MappedFile.h"
+#include "SimpleLogger.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using namespace sipai;
+
+namespace {
+constexpr size_t TILE_ALIGNMENT = 64;
+
+// FNV-1a 64-bit hash
+uint64_t hashString(const std::string &str, uint64_t hash) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+} // namespace
+
+TileCache::TileCache(const std::string &folder) : folder_(folder) {
+  std::filesystem::create_directories(folder_);
+}
+
+std::string TileCache::getPath(const std::vector<std::string> &images,
+                               const std::string &params) const {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const auto &image : images) {
+    if (!std::filesystem::exists(image)) {
+      return "";
+    }
+    std::ostringstream oss;
+    oss << image << '|' << std::filesystem::file_size(image) << '|'
+        << std::filesystem::last_write_time(image).time_since_epoch().count()
+        << '|';
+    hash = hashString(oss.str(), hash);
+  }
+  hash = hashString(params, hash);
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << hash << ".tiles";
+  return (std::filesystem::path(folder_) / name.str()).string();
+}
+
+bool TileCache::load(const std::string &path, ImageParts &input,
+                     ImageParts &target) const {
+  // The tiles file content, kept alive by the parts using it
+  auto file = MappedFile::map(path);
+  if (!file || file->size() < sizeof(TileFileHeader)) {
+    return false;
+  }
+  TileFileHeader fileHeader;
+  std::memcpy(&fileHeader, file->data(), sizeof(fileHeader));
+  const uint64_t count = fileHeader.input_count + fileHeader.target_count;
+  if (std::memcmp(fileHeader.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      count > (file->size() - sizeof(TileFileHeader)) / sizeof(TileHeader)) {
+    return false;
+  }
+
+  ImageParts parts;
+  for (uint64_t i = 0; i < count; ++i) {
+    TileHeader header;
+    std::memcpy(&header,
+                file->data() + sizeof(TileFileHeader) + i * sizeof(TileHeader),
+                sizeof(header));
+    if (header.rows <= 0 || header.cols <= 0 ||
+        header.offset % TILE_ALIGNMENT != 0 || header.offset > file->size() ||
+        header.bytes > file->size() - header.offset ||
+        header.bytes != (uint64_t)header.rows * header.cols *
+                            CV_ELEM_SIZE(header.type)) {
+      return false;
+    }
+    // A view on the mapped file, that the image keeps alive
+    cv::Mat data(header.rows, header.cols, header.type,
+                 file->data() + header.offset);
+    parts.push_back(std::make_shared<Image>(
+        Image{.data = data,
+              .orig_height = header.orig_height,
+              .orig_width = header.orig_width,
+              .orig_type = header.orig_type,
+              .orig_channels = header.orig_channels,
+              .storage = file}));
+  }
+  input.assign(parts.begin(), parts.begin() + fileHeader.input_count);
+  target.assign(parts.begin() + fileHeader.input_count, parts.end());
+  return true;
+}
+
+void TileCache::save(const std::string &path, const ImageParts &input,
+                     const ImageParts &target) const {
+  TileFileHeader fileHeader{};
+  std::memcpy(fileHeader.magic, MAGIC, sizeof(MAGIC));
+  fileHeader.input_count = input.size();
+  fileHeader.target_count = target.size();
+
+  std::vector<TileHeader> headers;
+  std::vector<cv::Mat> datas;
+  uint64_t offset = sizeof(TileFileHeader) +
+                    (input.size() + target.size()) * sizeof(TileHeader);
+  for (const auto *parts : {&input, &target}) {
+    for (const auto &part : *parts) {
+      const cv::Mat data =
+          part->data.isContinuous() ? part->data : part->data.clone();
+      offset = cv::alignSize(offset, TILE_ALIGNMENT);
+      const uint64_t bytes = data.total() * data.elemSize();
+      headers.push_back({.rows = data.rows,
+                         .cols = data.cols,
+                         .type = data.type(),
+                         .orig_type = part->orig_type,
+                         .orig_channels = part->orig_channels,
+                         .reserved = 0,
+                         .orig_height = part->orig_height,
+                         .orig_width = part->orig_width,
+                         .offset = offset,
+                         .bytes = bytes});
+      datas.push_back(data);
+      offset += bytes;
+    }
+  }
+
+  // Unique temporary name, as several loading workers can save files
+  std::ostringstream tmp;
+  tmp << path << "."
+      << std::hash<std::thread::id>{}(std::this_thread::get_id()) << ".tmp";
+  {
+    std::ofstream stream(tmp.str(), std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char *>(&fileHeader),
+                 sizeof(fileHeader));
+    stream.write(reinterpret_cast<const char *>(headers.data()),
+                 (std::streamsize)(headers.size() * sizeof(TileHeader)));
+    const char padding[TILE_ALIGNMENT] = {};
+    for (size_t i = 0; i < datas.size(); ++i) {
+      const auto position = (uint64_t)stream.tellp();
+      stream.write(padding, (std::streamsize)(headers[i].offset - position));
+      stream.write(reinterpret_cast<const char *>(datas[i].data),
+                   (std::streamsize)headers[i].bytes);
+    }
+    if (!stream) {
+      SimpleLogger::LOG_WARN("Could not write the tiles file: ", tmp.str());
+      stream.close();
+      std::filesystem::remove(tmp.str());
+      return;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp.str(), path, error);
+  if (error) {
+    SimpleLogger::LOG_WARN("Could not write the tiles file: ", path, ": ",
+                           error.message());
+    std::filesystem::remove(tmp.str(), error);
+  }
+}
@@ -4,9 +4,11 @@
 #include "SimpleLogger.h"
 #include "exception/TrainingDataFactoryException.h"
 #include <filesystem>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <optional>
+#include <sstream>
 
 using namespace sipai;
 
@@ -28,30 +30,61 @@ void TrainingDataFactory::loadData() {
     SimpleLogger::LOG_INFO("Loading images paths...");
   }
 
-  std::vector<Data> datas;
+  std::vector<DataEntry> datas;
+  auto &paths = dataList_.paths;
   // load images paths
-  if (!app_params.training_data_file.empty()) {
-    datas = trainingDataReader_.loadTrainingDataPaths();
+  if (!app_params.training_data_shards.empty()) {
+    bool withInputs = false;
+    datas = trainingDataReader_.loadTrainingDataShards(paths, withInputs);
+    dataListType_ = withInputs ? DataListType::INPUT_TARGET
+                               : DataListType::TARGET_FOLDER;
+    shardReader_ = std::make_unique<TrainingShardReader>();
+  } else if (!app_params.training_data_file.empty()) {
+    datas = trainingDataReader_.loadTrainingDataPaths(paths);
     dataListType_ = DataListType::INPUT_TARGET;
   } else if (!app_params.training_data_folder.empty()) {
-    datas = trainingDataReader_.loadTrainingDataFolder();
+    datas = trainingDataReader_.loadTrainingDataFolder(paths);
     dataListType_ = DataListType::TARGET_FOLDER;
   } else {
     throw TrainingDataFactoryException(
         "Invalid training data file or data folder");
   }
   if (app_params.random_loading) {
-    std::shuffle(datas.begin(), datas.end(), gen_);
+    if (shardReader_) {
+      TrainingShardReader::shuffle(datas, app_params.shuffle_buffer, gen_);
+    } else {
+      std::shuffle(datas.begin(), datas.end(), gen_);
+    }
   }
   // split datas
   size_t split_index =
       static_cast<size_t>(datas.size() * app_params.training_split_ratio);
-  for (size_t i = 0; i < datas.size(); ++i) {
-    if (i < split_index) {
-      dataList_.data_training.push_back(datas[i]);
-    } else {
-      dataList_.data_validation.push_back(datas[i]);
-    }
+  dataList_.data_training.assign(datas.begin(),
+                                 datas.begin() + (long)split_index);
+  dataList_.data_validation.assign(datas.begin() + (long)split_index,
+                                   datas.end());
+
+  // bulk loading keeps all the loaded images in memory
+  const size_t cacheLimit =
+      app_params.bulk_loading
+          ? std::numeric_limits<size_t>::max()
+          : app_params.cache_memory_limit * 1024 * 1024;
+  if (cacheLimit > 0) {
+    imageCache_ = std::make_unique<ImageCache>(cacheLimit);
+  }
+
+  if (!app_params.tile_cache_folder.empty()) {
+    // The tiles depend on the images and on their preprocessing parameters
+    const auto &network_params = Manager::getConstInstance().network_params;
+    std::ostringstream params;
+    params << (int)dataListType_ << "," << app_params.image_split << ","
+           << app_params.enable_padding << ","
+           << app_params.training_reduce_factor << ","
+           << network_params.input_size_x << "," << network_params.input_size_y
+           << "," << network_params.output_size_x << ","
+           << network_params.output_size_y;
+    tileCacheParams_ = params.str();
+    tileCache_ = std::make_unique<TileCache>(app_params.tile_cache_folder);
   }
 
   isLoaded_ = true;
@@ -64,19 +97,26 @@ void TrainingDataFactory::loadData() {
 }
 
 std::shared_ptr<Data> TrainingDataFactory::next(const TrainingPhase &phase) {
-  const auto &manager = Manager::getConstInstance();
-  const auto &app_params = manager.app_params;
-  const auto &network_params = manager.network_params;
+  const auto loader = nextLoader(phase);
+  return loader ? loader() : nullptr;
+}
+
+std::function<std::shared_ptr<Data>()>
+TrainingDataFactory::nextLoader(const TrainingPhase &phase) {
+  const auto &app_params = Manager::getConstInstance().app_params;
   size_t *index = nullptr;
-  std::vector<Data> *datas = nullptr;
+  std::vector<DataEntry> *datas = nullptr;
+  std::unique_ptr<DataPrefetcher> *prefetcher = nullptr;
   switch (phase) {
   case TrainingPhase::Training:
     index = &currentTrainingIndex_;
     datas = &dataList_.data_training;
+    prefetcher = &trainingPrefetcher_;
     break;
   case TrainingPhase::Validation:
     index = &currentValidationIndex_;
     datas = &dataList_.data_validation;
+    prefetcher = &validationPrefetcher_;
     break;
   default:
     throw TrainingDataFactoryException("Unimplemented TrainingPhase");
@@ -86,20 +126,90 @@ std::shared_ptr<Data> TrainingDataFactory::next(const TrainingPhase &phase) {
     // No more training data
     return nullptr;
   }
-  auto &data = datas->at(*index);
-  // check if bulk_loading and already loaded
-  if (app_params.bulk_loading && data.img_input.size() > 0 &&
-      data.img_output.size() > 0) {
-    return std::make_shared<Data>(data);
+
+  std::function<std::shared_ptr<Data>()> loader;
+  if (app_params.loading_workers == 0) {
+    loader = [this, datas, index = *index] { return load(*datas, index); };
+  } else {
+    if (!*prefetcher) {
+      // Start the background loading of the next images, in the collection
+      // order
+      const size_t first = *index;
+      *prefetcher = std::make_unique<DataPrefetcher>(
+          datas->size() - first, app_params.loading_workers,
+          app_params.prefetch_size,
+          [this, datas, first](size_t i) { return load(*datas, first + i); });
+    }
+    loader = [next = prefetcher->get()] { return next->next(); };
+  }
+  (*index)++;
+  return loader;
+}
+
+std::shared_ptr<Data>
+TrainingDataFactory::load(const std::vector<DataEntry> &datas,
+                          size_t index) const {
+  const auto &manager = Manager::getConstInstance();
+  const auto &app_params = manager.app_params;
+  const auto &network_params = manager.network_params;
+  const auto &data = datas.at(index);
+  const auto &paths = dataList_.paths;
+  const std::string file_input(paths.get(data.file_input));
+  const std::string file_target(paths.get(data.file_target));
+
+  // get the already loaded images parts, if in memory
+  ImageParts targetImageParts;
+  ImageParts inputImageParts;
+  const std::string key = file_input + "|" + file_target;
+  if (imageCache_ &&
+      imageCache_->get(key, inputImageParts, targetImageParts)) {
+    return makeData(file_input, file_target, inputImageParts,
+                    targetImageParts);
+  }
+
+  // map the already preprocessed images parts, if cached on disk
+  std::string tilesPath;
+  if (tileCache_ && shardReader_) {
+    tilesPath = tileCache_->getPath(
+        {std::string(paths.get(data.shard_file))},
+        tileCacheParams_ + "," + std::to_string(data.shard_offset));
+  } else if (tileCache_) {
+    std::vector<std::string> images{file_target};
+    if (dataListType_ == DataListType::INPUT_TARGET) {
+      images.push_back(file_input);
+    }
+    tilesPath = tileCache_->getPath(images, tileCacheParams_);
+  }
+  if (!tilesPath.empty() &&
+      tileCache_->load(tilesPath, inputImageParts, targetImageParts)) {
+    if (imageCache_) {
+      imageCache_->put(key, inputImageParts, targetImageParts);
+    }
+    return makeData(file_input, file_target, inputImageParts,
+                    targetImageParts);
+  }
+
+  // read the images files, if packed in shards
+  std::vector<uchar> inputBuffer;
+  std::vector<uchar> targetBuffer;
+  if (shardReader_) {
+    shardReader_->read(data, paths, inputBuffer, targetBuffer);
   }
 
   // load the target image
-  ImageParts targetImageParts = imageHelper_.loadImage(
-      data.file_target, app_params.image_split, app_params.enable_padding,
-      network_params.output_size_x, network_params.output_size_y);
+  targetImageParts =
+      shardReader_
+          ? imageHelper_.decodeImage(targetBuffer, file_target,
+                                     app_params.image_split,
+                                     app_params.enable_padding,
+                                     network_params.output_size_x,
+                                     network_params.output_size_y)
+          : imageHelper_.loadImage(file_target, app_params.image_split,
+                                   app_params.enable_padding,
+                                   network_params.output_size_x,
+                                   network_params.output_size_y);
 
   // generate or load the input image
-  ImageParts inputImageParts;
   switch (dataListType_) {
   case DataListType::TARGET_FOLDER:
     inputImageParts = imageHelper_.generateInputImage(
@@ -107,40 +217,97 @@ std::shared_ptr<Data> TrainingDataFactory::next(const TrainingPhase &phase) {
         network_params.input_size_x, network_params.input_size_y);
     break;
   case DataListType::INPUT_TARGET:
-    inputImageParts = imageHelper_.loadImage(
-        data.file_input, app_params.image_split, app_params.enable_padding,
-        network_params.input_size_x, network_params.input_size_y);
+    inputImageParts =
+        shardReader_
+            ? imageHelper_.decodeImage(inputBuffer, file_input,
+                                       app_params.image_split,
+                                       app_params.enable_padding,
+                                       network_params.input_size_x,
+                                       network_params.input_size_y)
+            : imageHelper_.loadImage(file_input, app_params.image_split,
+                                     app_params.enable_padding,
+                                     network_params.input_size_x,
+                                     network_params.input_size_y);
     break;
   default:
     throw TrainingDataFactoryException("Unimplemented DataListType");
   }
 
-  (*index)++;
+  if (!tilesPath.empty()) {
+    tileCache_->save(tilesPath, inputImageParts, targetImageParts);
+  }
+  if (imageCache_) {
+    imageCache_->put(key, inputImageParts, targetImageParts);
+  }
+  return makeData(file_input, file_target, inputImageParts,
+                  targetImageParts);
+}
+
+std::shared_ptr<Data>
+TrainingDataFactory::makeData(const std::string &file_input,
+                              const std::string &file_target,
+                              const ImageParts &inputImageParts,
+                              const ImageParts &targetImageParts) const {
+  return std::make_shared<Data>(Data{
+      .file_input = file_input,
+      .file_target = file_target,
+      .img_input = inputImageParts,
+      .img_target = targetImageParts,
+  });
+}
+
+void TrainingDataFactory::logCacheStatistics() {
+  if (!imageCache_) {
+    return;
+  }
+  const auto statistics = imageCache_->takeStatistics();
+  const size_t requests = statistics.hits + statistics.misses;
+  constexpr float MB = 1024.0f * 1024.0f;
+  SimpleLogger::LOG_INFO(
+      "Images cache: ", statistics.hits, " hits, ", statistics.misses,
+      " misses (",
+      requests == 0 ? 0.0f : 100.0f * statistics.hits / (float)requests,
+      "% hits), ", statistics.evictions, " evictions, ",
+      imageCache_->getCount(), " images in ", imageCache_->getUsed() / MB,
+      " MB");
+}
 
-  if (app_params.bulk_loading) {
-    data.img_input = inputImageParts;
-    data.img_target = targetImageParts;
-    return std::make_shared<Data>(data);
+void TrainingDataFactory::shuffle(TrainingPhase phase) {
+  const auto &app_params = Manager::getConstInstance().app_params;
+  std::vector<DataEntry> *datas = nullptr;
+  switch (phase) {
+  case TrainingPhase::Training:
+    trainingPrefetcher_.reset();
+    datas = &dataList_.data_training;
+    break;
+  case TrainingPhase::Validation:
+    validationPrefetcher_.reset();
+    datas = &dataList_.data_validation;
+    break;
+  default:
+    return;
+  }
+  if (shardReader_) {
+    TrainingShardReader::shuffle(*datas, app_params.shuffle_buffer, gen_);
   } else {
-    return std::make_shared<Data>(Data{
-        .file_input = data.file_input,
-        .file_target = data.file_target,
-        .file_output = data.file_output,
-        .img_input = inputImageParts,
-        .img_target = targetImageParts,
-        .img_output = data.img_output,
-    });
+    std::shuffle(datas->begin(), datas->end(), gen_);
   }
 }
 
 void TrainingDataFactory::resetCounters() {
+  trainingPrefetcher_.reset();
+  validationPrefetcher_.reset();
   currentTrainingIndex_ = 0;
   currentValidationIndex_ = 0;
 }
 
 void TrainingDataFactory::clear() {
+  resetCounters();
   dataList_.data_training.clear();
   dataList_.data_validation.clear();
-  resetCounters();
+  dataList_.paths.clear();
+  tileCache_.reset();
+  imageCache_.reset();
+  shardReader_.reset();
   isLoaded_ = false;
 }
\ No newline at end of file
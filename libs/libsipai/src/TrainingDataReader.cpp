@@ -1,76 +1,205 @@
 #include "TrainingDataReader.h"
 #include "Manager.h"
+#include "MappedFile.h"
 #include "SimpleLogger.h"
+#include "TrainingShard.h"
 #include "csv_parser.h"
 #include "exception/FileReaderException.h"
+#include <algorithm>
 #include <filesystem>
-#include <fstream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <utility>
 
 // for csv_parser doc, see https://github.com/ashaduri/csv-parser
 
 constexpr int MAX_ERRORS = 5;
 
+// Size of the parts of the CSV file parsed in parallel
+constexpr size_t CSV_CHUNK_SIZE = 4 * 1024 * 1024;
+
 using namespace sipai;
 
-std::vector<Data> TrainingDataReader::loadTrainingDataPaths() {
+namespace {
+// A part of whole lines of the CSV file, with its own paths pool
+struct CsvChunk {
+  std::string_view text;
+  StringPool paths;
+  std::vector<DataEntry> datas;
+  size_t lines = 0;
+  // the first invalid line, from the chunk first line
+  std::optional<std::pair<size_t, std::string>> invalidLine;
+  // the parsing errors, with their lines from the chunk first line
+  std::vector<std::pair<size_t, std::string>> errors;
+};
+
+std::vector<CsvChunk> splitChunks(std::string_view text) {
+  std::vector<CsvChunk> chunks;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.size();
+    if (begin + CSV_CHUNK_SIZE < text.size()) {
+      const size_t newline = text.find('\n', begin + CSV_CHUNK_SIZE - 1);
+      end = newline == std::string_view::npos ? text.size() : newline + 1;
+    }
+    chunks.emplace_back();
+    chunks.back().text = text.substr(begin, end - begin);
+    begin = end;
+  }
+  return chunks;
+}
+
+// Parse some lines with two columns, the input and target paths, adding them
+// to the chunk. Throws Csv::ParseError.
+void parseRows(const Csv::Parser &csvParser, std::string_view text,
+               size_t firstLine, CsvChunk &chunk) {
+  std::string_view cells[2];
+  std::string cleanCells[2];
+  size_t columns = 0;
+  size_t row = 0;
+  auto endRow = [&]() {
+    if (columns == 0 || (columns == 1 && cells[0].empty())) {
+      // empty line
+    } else if (columns != 2) {
+      if (!chunk.invalidLine) {
+        chunk.invalidLine = {firstLine + row, "invalid column numbers"};
+      }
+    } else if (cells[0].empty() || cells[1].empty()) {
+      if (!chunk.invalidLine) {
+        chunk.invalidLine = {firstLine + row, "empty image path"};
+      }
+    } else {
+      chunk.datas.push_back({.file_input = chunk.paths.add(cells[0]),
+                             .file_target = chunk.paths.add(cells[1])});
+    }
+    columns = 0;
+  };
+  csvParser.parse(text, [&](size_t cellRow, size_t column,
+                            std::string_view cell, Csv::CellTypeHint hint) {
+    if (cellRow != row) {
+      endRow();
+      row = cellRow;
+    }
+    if (column < 2) {
+      // the cells are views on the mapped file, unless unescaped
+      if (hint == Csv::CellTypeHint::StringWithEscapedQuotes) {
+        cleanCells[column] = Csv::cleanString(cell);
+        cell = cleanCells[column];
+      }
+      cells[column] = cell;
+    }
+    columns = column + 1;
+  });
+  endRow();
+}
+
+void parseChunk(const Csv::Parser &csvParser, CsvChunk &chunk) {
+  chunk.lines = (size_t)std::count(chunk.text.begin(), chunk.text.end(), '\n');
+  if (!chunk.text.empty() && chunk.text.back() != '\n') {
+    chunk.lines++;
+  }
+  try {
+    parseRows(csvParser, chunk.text, 0, chunk);
+    return;
+  } catch (const Csv::ParseError &) {
+    chunk.paths.clear();
+    chunk.datas.clear();
+    chunk.invalidLine.reset();
+  }
+  // Parse the lines one by one, to skip the invalid ones
+  size_t begin = 0;
+  for (size_t line = 0; begin < chunk.text.size(); line++) {
+    size_t end = chunk.text.find('\n', begin);
+    end = end == std::string_view::npos ? chunk.text.size() : end + 1;
+    try {
+      parseRows(csvParser, chunk.text.substr(begin, end - begin), line, chunk);
+    } catch (const Csv::ParseError &ex) {
+      chunk.errors.emplace_back(line, ex.what());
+    }
+    begin = end;
+  }
+}
+} // namespace
+
+std::vector<DataEntry>
+TrainingDataReader::loadTrainingDataPaths(StringPool &paths) {
   const auto &training_data_file =
       Manager::getInstance().app_params.training_data_file;
   if (training_data_file.empty()) {
     throw FileReaderException("empty file path");
   }
+  if (!std::filesystem::is_regular_file(training_data_file)) {
+    throw FileReaderException("Failed to open file: " + training_data_file);
+  }
+  if (std::filesystem::file_size(training_data_file) == 0) {
+    return {};
+  }
 
-  // Create a file stream object using RAII (Resource Acquisition Is
-  // Initialization)
-  std::ifstream file(training_data_file);
-  if (!file.is_open()) {
+  // Map the file in memory, and parse it by chunks of lines in parallel
+  const auto file = MappedFile::map(training_data_file);
+  if (!file) {
     throw FileReaderException("Failed to open file: " + training_data_file);
   }
+  auto chunks = splitChunks(file->view());
+  const Csv::Parser csvParser;
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size(), 1),
+                    [&chunks, &csvParser](const tbb::blocked_range<size_t> &r) {
+                      for (size_t i = r.begin(); i < r.end(); ++i) {
+                        parseChunk(csvParser, chunks[i]);
+                      }
+                    });
 
-  std::vector<Data> datas;
-  Csv::Parser csvParser;
-  std::vector<std::vector<Csv::CellReference>> cell_refs;
-  std::string line;
-  int lineNumber = 1;
+  // Merge the chunks, in the file order
+  size_t total = 0;
+  size_t totalPaths = 0;
+  for (const auto &chunk : chunks) {
+    total += chunk.datas.size();
+    totalPaths += chunk.paths.size();
+  }
+  std::vector<DataEntry> datas;
+  datas.reserve(total);
+  paths.reserve(paths.size() + totalPaths);
+  size_t lineNumber = 1;
   int totalErrors = 0;
-  while (std::getline(file, line)) {
-    try {
-      if (line.empty()) {
-        continue;
-      }
-      std::string_view str_view(line);
-      csvParser.parseTo2DVector(str_view, cell_refs);
-      if (cell_refs.empty() || cell_refs.size() != 2) {
-        throw FileReaderException("invalid column numbers, at line " +
-                                  std::to_string(lineNumber));
-      }
-      Data data;
-      data.file_input = cell_refs[0][0].getCleanString().value();
-      data.file_target = cell_refs[1][0].getCleanString().value();
-      datas.push_back(data);
-      lineNumber++;
-    } catch (Csv::ParseError &ex) {
+  for (auto &chunk : chunks) {
+    for (const auto &[line, error] : chunk.errors) {
       totalErrors++;
       if (totalErrors < MAX_ERRORS) {
-        SimpleLogger::LOG_ERROR("CSV parsing error at line (", lineNumber,
-                                "): ", ex.what());
+        SimpleLogger::LOG_ERROR("CSV parsing error at line (",
+                                lineNumber + line, "): ", error);
       } else {
         throw FileReaderException("Too many parsing errors.");
       }
     }
+    if (chunk.invalidLine) {
+      throw FileReaderException(
+          chunk.invalidLine->second + ", at line " +
+          std::to_string(lineNumber + chunk.invalidLine->first));
+    }
+    const auto base = paths.append(chunk.paths);
+    for (const auto &data : chunk.datas) {
+      datas.push_back({.file_input = data.file_input + base,
+                       .file_target = data.file_target + base});
+    }
+    lineNumber += chunk.lines;
+    chunk.paths.clear();
   }
   return datas;
 }
 
-std::vector<Data> TrainingDataReader::loadTrainingDataFolder() {
+std::vector<DataEntry>
+TrainingDataReader::loadTrainingDataFolder(StringPool &paths) {
   const auto &training_data_folder =
       Manager::getInstance().app_params.training_data_folder;
   if (training_data_folder.empty()) {
     throw FileReaderException("empty folder path");
   }
 
-  std::vector<Data> datas;
+  std::vector<DataEntry> datas;
   // Add images paths from the folder
   for (const auto &entry :
        std::filesystem::directory_iterator(training_data_folder)) {
@@ -81,11 +210,21 @@ std::vector<Data> TrainingDataReader::loadTrainingDataFolder() {
                      ::tolower);
       // Check if the file is an image by checking its extension
       if (valid_extensions.find(extension) != valid_extensions.end()) {
-        Data data;
-        data.file_target = entry.path().string();
-        datas.push_back(data);
+        datas.push_back({.file_target = paths.add(entry.path().string())});
       }
     }
   }
   return datas;
+}
+
+std::vector<DataEntry>
+TrainingDataReader::loadTrainingDataShards(StringPool &paths,
+                                           bool &withInputs) {
+  const auto &training_data_shards =
+      Manager::getInstance().app_params.training_data_shards;
+  if (training_data_shards.empty()) {
+    throw FileReaderException("empty file path");
+  }
+  return TrainingShardReader::loadIndex(training_data_shards, paths,
+                                        withInputs);
 }
\ No newline at end of file
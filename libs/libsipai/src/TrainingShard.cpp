@@ -0,0 +1,276 @@
+#include "TrainingShard.h"
+#include "SimpleLogger.h"
+#include "exception/FileReaderException.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace sipai;
+
+namespace {
+constexpr char RECORD_MAGIC[4] = {'S', 'I', 'P', 'R'};
+constexpr const char *INDEX_HEADER = "SIPAI-SHARDS";
+constexpr int INDEX_VERSION = 1;
+
+std::vector<char> readFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw FileReaderException("Failed to open file: " + path);
+  }
+  std::vector<char> content((size_t)file.tellg());
+  file.seekg(0);
+  if (!file.read(content.data(), (std::streamsize)content.size())) {
+    throw FileReaderException("Failed to read file: " + path);
+  }
+  return content;
+}
+
+std::vector<std::string> splitTabs(const std::string &line) {
+  std::vector<std::string> fields;
+  std::istringstream stream(line);
+  std::string field;
+  while (std::getline(stream, field, '\t')) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+} // namespace
+
+void TrainingShardWriter::pack(const std::vector<DataEntry> &datas,
+                               const StringPool &paths, bool withInputs,
+                               const std::string &indexPath,
+                               size_t shardBytes) const {
+  const std::filesystem::path index(indexPath);
+  if (index.has_parent_path()) {
+    std::filesystem::create_directories(index.parent_path());
+  }
+  std::ofstream indexFile(indexPath, std::ios::trunc);
+  if (!indexFile) {
+    throw FileReaderException("Failed to create file: " + indexPath);
+  }
+  indexFile << INDEX_HEADER << '\t' << INDEX_VERSION << '\t'
+            << (withInputs ? 1 : 0) << '\n';
+
+  std::ofstream shard;
+  std::string shardName;
+  size_t shardCount = 0;
+  uint64_t offset = 0;
+  for (const auto &data : datas) {
+    // start a new shard when the current one is full
+    if (!shard.is_open() || offset >= shardBytes) {
+      if (shard.is_open()) {
+        shard.close();
+      }
+      std::ostringstream name;
+      name << index.stem().string() << "-" << std::setw(5)
+           << std::setfill('0') << shardCount++ << ".shard";
+      shardName = name.str();
+      shard.open(index.parent_path() / shardName,
+                 std::ios::binary | std::ios::trunc);
+      if (!shard) {
+        throw FileReaderException("Failed to create file: " + shardName);
+      }
+      offset = 0;
+      SimpleLogger::LOG_INFO("Packing shard ", shardName, "...");
+    }
+
+    const std::string file_input(paths.get(data.file_input));
+    const std::string file_target(paths.get(data.file_target));
+    const auto input = withInputs ? readFile(file_input) : std::vector<char>();
+    const auto target = readFile(file_target);
+    ShardRecordHeader header{};
+    std::memcpy(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    header.name_size = (uint32_t)file_target.size();
+    header.input_size = input.size();
+    header.target_size = target.size();
+    shard.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    shard.write(file_target.data(), header.name_size);
+    shard.write(input.data(), (std::streamsize)input.size());
+    shard.write(target.data(), (std::streamsize)target.size());
+    if (!shard) {
+      throw FileReaderException("Failed to write file: " + shardName);
+    }
+    indexFile << shardName << '\t' << offset << '\t' << file_target << '\t'
+              << (withInputs ? file_input : "") << '\n';
+    offset += sizeof(header) + header.name_size + input.size() + target.size();
+  }
+  if (!indexFile) {
+    throw FileReaderException("Failed to write file: " + indexPath);
+  }
+  SimpleLogger::LOG_INFO("Packed ", datas.size(), " images pairs in ",
+                         shardCount, " shards.");
+}
+
+TrainingShardReader::~TrainingShardReader() { close(); }
+
+std::vector<DataEntry>
+TrainingShardReader::loadIndex(const std::string &indexPath, StringPool &paths,
+                               bool &withInputs) {
+  std::ifstream file(indexPath);
+  if (!file.is_open()) {
+    throw FileReaderException("Failed to open file: " + indexPath);
+  }
+  std::string line;
+  std::getline(file, line);
+  const auto header = splitTabs(line);
+  if (header.size() != 3 || header[0] != INDEX_HEADER ||
+      header[1] != std::to_string(INDEX_VERSION)) {
+    throw FileReaderException("Invalid shards index file: " + indexPath);
+  }
+  withInputs = header[2] == "1";
+
+  const auto folder = std::filesystem::path(indexPath).parent_path();
+  std::map<std::string, StringPool::Offset> shards;
+  std::vector<DataEntry> datas;
+  int lineNumber = 1;
+  while (std::getline(file, line)) {
+    lineNumber++;
+    if (line.empty()) {
+      continue;
+    }
+    const auto fields = splitTabs(line);
+    if (fields.size() < 3) {
+      throw FileReaderException("invalid shards index, at line " +
+                                std::to_string(lineNumber));
+    }
+    auto shard = shards.find(fields[0]);
+    if (shard == shards.end()) {
+      shard = shards
+                  .emplace(fields[0],
+                           paths.add((folder / fields[0]).string()))
+                  .first;
+    }
+    datas.push_back(
+        {.file_input = fields.size() > 3 ? paths.add(fields[3]) : 0,
+         .file_target = paths.add(fields[2]),
+         .shard_file = shard->second,
+         .shard_offset = std::stoull(fields[1])});
+  }
+  return datas;
+}
+
+int TrainingShardReader::open(const std::string &shardFile) const {
+#ifdef _WIN32
+  return -1;
+#else
+  std::scoped_lock<std::mutex> lock(mutex_);
+  if (auto it = files_.find(shardFile); it != files_.end()) {
+    return it->second;
+  }
+  const int fd = ::open(shardFile.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw FileReaderException("Failed to open file: " + shardFile);
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  files_[shardFile] = fd;
+  return fd;
+#endif
+}
+
+void TrainingShardReader::read(const DataEntry &data, const StringPool &paths,
+                               std::vector<uchar> &input,
+                               std::vector<uchar> &target) const {
+  const std::string shardFile(paths.get(data.shard_file));
+  ShardRecordHeader header{};
+  std::string name;
+#ifdef _WIN32
+  std::ifstream file(shardFile, std::ios::binary);
+  file.seekg((std::streamoff)data.shard_offset);
+  auto readAt = [&file](void *buffer, size_t size, uint64_t) {
+    return (bool)file.read(static_cast<char *>(buffer), (std::streamsize)size);
+  };
+#else
+  const int fd = open(shardFile);
+  auto readAt = [fd](void *buffer, size_t size, uint64_t offset) {
+    auto bytes = static_cast<char *>(buffer);
+    while (size > 0) {
+      const ssize_t done = pread(fd, bytes, size, (off_t)offset);
+      if (done <= 0) {
+        return false;
+      }
+      bytes += done;
+      size -= (size_t)done;
+      offset += (uint64_t)done;
+    }
+    return true;
+  };
+#endif
+  uint64_t offset = data.shard_offset;
+  if (!readAt(&header, sizeof(header), offset) ||
+      std::memcmp(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0) {
+    throw FileReaderException("Invalid shard record in " + shardFile);
+  }
+  offset += sizeof(header);
+  name.resize(header.name_size);
+  input.resize(header.input_size);
+  target.resize(header.target_size);
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+  // let the system read the next records in background
+  const uint64_t end =
+      offset + header.name_size + header.input_size + header.target_size;
+  posix_fadvise(fd, (off_t)end, (off_t)SHARD_READAHEAD, POSIX_FADV_WILLNEED);
+#endif
+  if (!readAt(name.data(), name.size(), offset) ||
+      !readAt(input.data(), input.size(), offset + name.size()) ||
+      !readAt(target.data(), target.size(),
+              offset + name.size() + input.size())) {
+    throw FileReaderException("Truncated shard record in " + shardFile);
+  }
+  if (name != paths.get(data.file_target)) {
+    throw FileReaderException("Shard record mismatch in " + shardFile + ": " +
+                              name);
+  }
+}
+
+void TrainingShardReader::shuffle(std::vector<DataEntry> &datas,
+                                  size_t buffer, std::mt19937 &gen) {
+  // back to the shards order, each shard path being added once to the pool
+  std::sort(datas.begin(), datas.end(),
+            [](const DataEntry &a, const DataEntry &b) {
+              return std::tie(a.shard_file, a.shard_offset) <
+                     std::tie(b.shard_file, b.shard_offset);
+            });
+  // shuffle the shards order
+  std::vector<std::pair<size_t, size_t>> shards; // [begin, end) records
+  for (size_t i = 0; i < datas.size(); ++i) {
+    if (i == 0 || datas[i].shard_file != datas[i - 1].shard_file) {
+      shards.emplace_back(i, i);
+    }
+    shards.back().second = i + 1;
+  }
+  std::shuffle(shards.begin(), shards.end(), gen);
+  std::vector<DataEntry> shuffled;
+  shuffled.reserve(datas.size());
+  for (const auto &[begin, end] : shards) {
+    std::move(datas.begin() + (long)begin, datas.begin() + (long)end,
+              std::back_inserter(shuffled));
+  }
+  // shuffle the records within a sliding window
+  buffer = std::max(buffer, (size_t)1);
+  for (size_t i = 0; i < shuffled.size(); ++i) {
+    std::uniform_int_distribution<size_t> pick(
+        i, std::min(i + buffer, shuffled.size()) - 1);
+    std::swap(shuffled[i], shuffled[pick(gen)]);
+  }
+  datas = std::move(shuffled);
+}
+
+void TrainingShardReader::close() {
+  std::scoped_lock<std::mutex> lock(mutex_);
+#ifndef _WIN32
+  for (const auto &[file, fd] : files_) {
+    ::close(fd);
+  }
+#endif
+  files_.clear();
+}
@@ -16,6 +16,27 @@
 
 using namespace sipai;
 
+namespace
+{
+// A connection of a neuron with a neighbor, in the order of the shader
+// neighbors
+struct NeighborConnection
+{
+  size_t index_x;
+  size_t index_y;
+  cv::Vec4f *weight;
+};
+
+std::vector<NeighborConnection> getNeighbors(Layer *layer, size_t x, size_t y)
+{
+  std::vector<NeighborConnection> connections;
+  layer->neighbors.forEach(
+      x, y, [&connections](size_t nx, size_t ny, cv::Vec4f &weight)
+      { connections.push_back({nx, ny, &weight}); });
+  return connections;
+}
+} // namespace
+
 std::unique_ptr<VulkanController> VulkanController::controllerInstance_ =
     nullptr;
 
@@ -41,6 +62,17 @@ bool VulkanController::initialize()
     return false;
   }
 
+  for (const auto &layer : manager.network->layers)
+  {
+    if (layer->neighbors.offsets.size() > (size_t)MAX_NEIGHBORS)
+    {
+      SimpleLogger::LOG_ERROR(
+          "The current Vulkan shader is limited to the 4-neighborhood, i.e. "
+          "a neighbors radius of 1.");
+      return false;
+    }
+  }
+
   vulkan_->maxSizeX =
       std::max({manager.network_params.input_size_x, manager.network_params.hidden_size_x,
                 manager.network_params.output_size_x});
@@ -381,6 +413,7 @@ void VulkanController::_readHiddenLayer1()
       }
 
       // Get neighbors
+      const auto &neighbors = getNeighbors(hiddenLayer, x, y);
       int neighbors_padding = 8; // check with RenderDoc
       offset += neighbors_padding;
       for (int i = 0; i < MAX_NEIGHBORS; i++)
@@ -393,15 +426,15 @@ void VulkanController::_readHiddenLayer1()
             getDataFromBuffer<uint32_t>(bufferHiddenLayer.data, offset);
 
         // Some checks
-        if (isUsed &&
-            (dstNeuron.neighbors[i].neuron->index_x != neigh_index_x ||
-             dstNeuron.neighbors[i].neuron->index_y != neigh_index_y))
+        if (isUsed && (i + 1 > (int)neighbors.size() ||
+                       neighbors[i].index_x != neigh_index_x ||
+                       neighbors[i].index_y != neigh_index_y))
         {
           builder_.unmapBufferMemory(bufferHiddenLayer);
           throw VulkanControllerException("Invalid data buffer memory");
         }
-        if (((isUsed > 0) && (i + 1 > (int)dstNeuron.neighbors.size())) ||
-            ((isUsed <= 0) && (i + 1 < (int)dstNeuron.neighbors.size())))
+        if (((isUsed > 0) && (i + 1 > (int)neighbors.size())) ||
+            ((isUsed <= 0) && (i + 1 < (int)neighbors.size())))
         {
           builder_.unmapBufferMemory(bufferHiddenLayer);
           throw VulkanControllerException("Invalid data buffer memory");
@@ -416,7 +449,7 @@ void VulkanController::_readHiddenLayer1()
                       getDataFromBuffer<float>(bufferHiddenLayer.data, offset));
         if (isUsed > 0)
         {
-          dstNeuron.neighbors[i].weight = weight;
+          *neighbors[i].weight = weight;
         }
       }
     } // end for (size_t x ...
@@ -528,6 +561,7 @@ void VulkanController::_readOutputLayer()
       }
 
       // Get neighbors
+      const auto &neighbors = getNeighbors(outputLayer, x, y);
       int neighbors_padding = 8; // check with RenderDoc
       offset += neighbors_padding;
       for (int i = 0; i < MAX_NEIGHBORS; i++)
@@ -540,15 +574,15 @@ void VulkanController::_readOutputLayer()
             getDataFromBuffer<uint32_t>(bufferOutputLayer.data, offset);
 
         // Some checks
-        if (isUsed &&
-            (dstNeuron.neighbors[i].neuron->index_x != neigh_index_x ||
-             dstNeuron.neighbors[i].neuron->index_y != neigh_index_y))
+        if (isUsed && (i + 1 > (int)neighbors.size() ||
+                       neighbors[i].index_x != neigh_index_x ||
+                       neighbors[i].index_y != neigh_index_y))
         {
           builder_.unmapBufferMemory(bufferOutputLayer);
           throw VulkanControllerException("Invalid data buffer memory");
         }
-        if (((isUsed > 0) && (i + 1 > (int)dstNeuron.neighbors.size())) ||
-            ((isUsed <= 0) && (i + 1 < (int)dstNeuron.neighbors.size())))
+        if (((isUsed > 0) && (i + 1 > (int)neighbors.size())) ||
+            ((isUsed <= 0) && (i + 1 < (int)neighbors.size())))
         {
           builder_.unmapBufferMemory(bufferOutputLayer);
           throw VulkanControllerException("Invalid data buffer memory");
@@ -563,7 +597,7 @@ void VulkanController::_readOutputLayer()
                       getDataFromBuffer<float>(bufferOutputLayer.data, offset));
         if (isUsed > 0)
         {
-          dstNeuron.neighbors[i].weight = weight;
+          *neighbors[i].weight = weight;
         }
       }
     } // end for (size_t x ...
@@ -749,24 +783,26 @@ void VulkanController::_writeOutputLayer()
         }
 
         // neighbors
+        const auto &neighbors =
+            getNeighbors(outputLayer, neuron.index_x, neuron.index_y);
         int neighbors_padding = 8; // check with RenderDoc
         bufferPtr += neighbors_padding;
         uint32_t isUsed = 0;
         for (int i = 0; i < MAX_NEIGHBORS; i++)
         {
-          if (i < (int)neuron.neighbors.size())
+          if (i < (int)neighbors.size())
           {
             isUsed = 1;
             bufferPtr = copyToBuffer<uint32_t>(bufferPtr, isUsed);
             bufferPtr = copyToBuffer<uint32_t>(
-                bufferPtr, (uint32_t)neuron.neighbors[i].neuron->index_x);
+                bufferPtr, (uint32_t)neighbors[i].index_x);
             bufferPtr = copyToBuffer<uint32_t>(
-                bufferPtr, (uint32_t)neuron.neighbors[i].neuron->index_y);
+                bufferPtr, (uint32_t)neighbors[i].index_y);
             bufferPtr += 4; // padding, check with RenderDoc
             for (int k = 0; k < 4; k++)
             {
               bufferPtr =
-                  copyToBuffer<float>(bufferPtr, neuron.neighbors[i].weight[k]);
+                  copyToBuffer<float>(bufferPtr, (*neighbors[i].weight)[k]);
             }
           }
           else
@@ -867,24 +903,26 @@ void VulkanController::_writeHiddenLayer1()
         }
 
         // neighbors
+        const auto &neighbors =
+            getNeighbors(hiddenLayer1, neuron.index_x, neuron.index_y);
         int neighbors_padding = 8; // check with RenderDoc
         bufferPtr += neighbors_padding;
         uint32_t isUsed = 0;
         for (int i = 0; i < MAX_NEIGHBORS; i++)
         {
-          if (i < (int)neuron.neighbors.size())
+          if (i < (int)neighbors.size())
           {
             isUsed = 1;
             bufferPtr = copyToBuffer<uint32_t>(bufferPtr, isUsed);
             bufferPtr = copyToBuffer<uint32_t>(
-                bufferPtr, (uint32_t)neuron.neighbors[i].neuron->index_x);
+                bufferPtr, (uint32_t)neighbors[i].index_x);
             bufferPtr = copyToBuffer<uint32_t>(
-                bufferPtr, (uint32_t)neuron.neighbors[i].neuron->index_y);
+                bufferPtr, (uint32_t)neighbors[i].index_y);
             bufferPtr += 4; // padding, check with RenderDoc
             for (int k = 0; k < 4; k++)
             {
               bufferPtr =
-                  copyToBuffer<float>(bufferPtr, neuron.neighbors[i].weight[k]);
+                  copyToBuffer<float>(bufferPtr, (*neighbors[i].weight)[k]);
             }
           }
           else
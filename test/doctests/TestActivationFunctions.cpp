@@ -1,4 +1,5 @@
 #include "ActivationFunctions.h"
+#include "ActivationKernels.h"
 #include "LayerHidden.h"
 #include "NeuralNetwork.h"
 #include "NeuralNetworkBuilder.h"
@@ -8,6 +9,7 @@
 #include <cstddef>
 #include <memory>
 #include <opencv2/core/matx.hpp>
+#include <vector>
 
 using namespace sipai;
 
@@ -153,6 +155,8 @@ TEST_CASE("Testing the Activation Functions") {
     };
     builder.with(networkParams);
     CHECK_NOTHROW(builder.setActivationFunction());
+    CHECK(hlayer->eactivationFunction == activ);
+    CHECK(hlayer->activationFunctionAlpha == alpha);
     testActivationFunction(*hlayer, activ);
   }
   CHECK((hasAF.hasElu && hasAF.hasLRelu && hasAF.hasPRelu && hasAF.hasRelu &&
@@ -166,4 +170,42 @@ TEST_CASE("Testing the Activation Functions") {
   // cleaning
   networkParams = {};
   builder.with(networkParams);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Testing the Activation Kernels") {
+  const size_t n = 1027; // not a multiple of the SIMD width
+  std::vector<float> values(n);
+  for (size_t k = 0; k < n; ++k) {
+    values[k] = -6.0f + 12.0f * (float)k / (float)n;
+  }
+  std::vector<float> outputs(n);
+  const float alpha = 0.1f;
+  for (bool fastMath : {false, true}) {
+    // the exact kernels give the libm results, to the float rounding
+    const float eps = fastMath ? 1e-6f : 2e-7f;
+    kernels::setFastMath(fastMath);
+    CHECK(kernels::isFastMath() == fastMath);
+    for (auto activ : {EActivationFunction::ELU, EActivationFunction::LReLU,
+                       EActivationFunction::PReLU, EActivationFunction::ReLU,
+                       EActivationFunction::Sigmoid,
+                       EActivationFunction::Tanh}) {
+      dispatchActivation(activ, [&](auto function) {
+        using Activation = decltype(function);
+        kernels::activate(activ, alpha, values.data(), outputs.data(), n);
+        for (size_t k = 0; k < n; ++k) {
+          CHECK(outputs[k] == doctest::Approx(Activation::function(
+                                                  values[k], alpha))
+                                  .epsilon(eps));
+        }
+        kernels::activationDerivative(activ, alpha, values.data(),
+                                      outputs.data(), n);
+        for (size_t k = 0; k < n; ++k) {
+          CHECK(outputs[k] == doctest::Approx(Activation::derivative(
+                                                  values[k], alpha))
+                                  .epsilon(eps));
+        }
+      });
+    }
+  }
+  kernels::setFastMath(false);
+}
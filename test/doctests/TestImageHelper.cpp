@@ -1,8 +1,15 @@
+#include "CpuDispatch.h"
 #include "ImageHelper.h"
 #include "doctest.h"
+#include <cmath>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <opencv2/core/matx.hpp>
 #include <opencv2/core/types.hpp>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace sipai;
 
@@ -108,4 +115,166 @@ TEST_CASE("Testing ImageHelper") {
     float loss = imageHelper.computeLoss(outputData, targetData);
     CHECK(loss == doctest::Approx(0.16));
   }
-}
\ No newline at end of file
+
+  SUBCASE("Testing computeLoss method with the CPU instruction sets") {
+    ImageHelper imageHelper;
+    cv::Mat outputData(67, 53, CV_32FC4);
+    cv::Mat targetData(67, 53, CV_32FC4);
+    cv::randu(outputData, 0, 1);
+    cv::randu(targetData, 0, 1);
+    // A non-continuous region of interest takes the OpenCV path
+    cv::Mat roiOutput = outputData(cv::Rect(1, 0, 52, 67));
+    cv::Mat roiTarget = targetData(cv::Rect(1, 0, 52, 67));
+    float roiLoss = imageHelper.computeLoss(roiOutput, roiTarget);
+    float kernelLoss =
+        imageHelper.computeLoss(roiOutput.clone(), roiTarget.clone());
+    CHECK(kernelLoss == doctest::Approx(roiLoss));
+    const auto detected = kernels::detectCpuIsa();
+    float baseLoss = 0.0f;
+    for (int isa = 0; isa <= (int)detected; isa++) {
+      kernels::setCpuIsa((kernels::ECpuIsa)isa);
+      float loss = imageHelper.computeLoss(outputData, targetData);
+      // E[(u - v)^2] = 1/6 for independent uniform values
+      CHECK(loss == doctest::Approx(1.0 / 6.0).epsilon(0.05));
+      if (isa == 0) {
+        baseLoss = loss;
+      }
+      CHECK(loss == doctest::Approx(baseLoss));
+    }
+    kernels::setCpuIsa(detected);
+  }
+
+  SUBCASE("Test splitImage") {
+    ImageHelper imageHelper;
+    cv::Mat image(10, 11, CV_32FC4);
+    cv::randu(image, 0, 1);
+
+    // the parts are views on the image
+    const auto parts = imageHelper.splitImage(image, 2, false);
+    REQUIRE(parts.size() == 4);
+    for (const auto &part : parts) {
+      CHECK(part.datastart == image.datastart);
+    }
+    CHECK(parts[1].size() == cv::Size(5, 5));
+    CHECK(cv::norm(parts[3], image(cv::Rect(6, 5, 5, 5)), cv::NORM_INF) ==
+          0);
+
+    // only the right edge parts are padded
+    const auto padded = imageHelper.splitImage(image, 2, true);
+    REQUIRE(padded.size() == 4);
+    CHECK(padded[0].datastart == image.datastart);
+    CHECK(padded[1].datastart != image.datastart);
+    CHECK(padded[1].size() == cv::Size(6, 5));
+    CHECK(cv::norm(padded[1](cv::Rect(0, 0, 5, 5)),
+                   image(cv::Rect(6, 0, 5, 5)), cv::NORM_INF) == 0);
+    CHECK(cv::norm(padded[1].col(5), cv::NORM_INF) == 0);
+
+    // less parts than the split
+    const auto small = imageHelper.splitImage(image(cv::Rect(0, 0, 5, 5)), 4,
+                                              false);
+    REQUIRE(small.size() == 9);
+    CHECK(small.back().size() == cv::Size(1, 1));
+
+    // the image data is resized to a new Mat, or kept if at the size
+    Image resized{.data = parts[0]};
+    resized.resize(6, 5);
+    CHECK(resized.data.data == parts[0].data);
+    resized.resize(3, 3);
+    CHECK(resized.data.size() == cv::Size(3, 3));
+    CHECK(resized.data.datastart != image.datastart);
+
+    // the parts are joined at their place, in rows of splitsX parts
+    ImageParts equalParts;
+    for (int i = 0; i < 6; i++) {
+      cv::Mat part(2, 3, CV_32FC4, cv::Scalar::all(i));
+      equalParts.push_back(std::make_shared<Image>(Image{
+          .data = part, .orig_height = 20, .orig_width = 30}));
+    }
+    const auto joined = imageHelper.joinImages(equalParts, 3, 2);
+    CHECK(joined.data.size() == cv::Size(9, 4));
+    CHECK(joined.orig_width == 30);
+    CHECK(joined.orig_height == 20);
+    CHECK(joined.data.at<cv::Vec4f>(0, 3)[0] == 1.0f);
+    CHECK(joined.data.at<cv::Vec4f>(3, 8)[0] == 5.0f);
+
+    // the padding of the joined padded parts is cropped out
+    ImageParts paddedParts;
+    for (const auto &part : padded) {
+      paddedParts.push_back(std::make_shared<Image>(
+          Image{.data = part, .orig_height = 10, .orig_width = 11}));
+    }
+    auto cropped = imageHelper.joinImages(paddedParts, 2, 2);
+    CHECK(cropped.data.size() == cv::Size(12, 10));
+    imageHelper.cropPadding(cropped, 2);
+    CHECK(cropped.data.size() == image.size());
+    CHECK(cv::norm(cropped.data, image, cv::NORM_INF) == 0);
+  }
+
+  SUBCASE("Test reduced decoding") {
+    ImageHelper imageHelper;
+    const std::string path = "../data/images/target/009b.jpg";
+    // 640x442 decoded at 1/8, then resized
+    const auto image = imageHelper.loadImage(path, 1, false, 50, 40);
+    REQUIRE(image.size() == 1);
+    CHECK(image[0]->data.size() == cv::Size(50, 40));
+    CHECK(image[0]->data.type() == CV_32FC4);
+    CHECK(image[0]->orig_width == 640);
+    CHECK(image[0]->orig_height == 442);
+
+    // close to the full resolution decoding
+    cv::Mat full = cv::imread(path, cv::IMREAD_ANYCOLOR | cv::IMREAD_ANYDEPTH);
+    cv::cvtColor(full, full, cv::COLOR_RGB2BGRA);
+    full.convertTo(full, CV_32FC4, 1.0 / 255.0);
+    cv::resize(full, full, cv::Size(50, 40));
+    const cv::Scalar reducedMean = cv::mean(image[0]->data);
+    const cv::Scalar fullMean = cv::mean(full);
+    for (int c = 0; c < 4; c++) {
+      CHECK(std::abs(reducedMean[c] - fullMean[c]) < 0.03);
+    }
+
+    // same parts from a file content in memory
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uchar> buffer((std::istreambuf_iterator<char>(file)), {});
+    const auto decoded = imageHelper.decodeImage(buffer, path, 1, false, 50, 40);
+    REQUIRE(decoded.size() == 1);
+    CHECK(cv::norm(decoded[0]->data, image[0]->data, cv::NORM_INF) == 0);
+
+    // the 8 bits conversion matches the OpenCV conversions
+    const std::vector<std::pair<int, int>> conversions{
+        {CV_8UC1, cv::COLOR_GRAY2BGRA},
+        {CV_8UC3, cv::COLOR_RGB2BGRA}};
+    for (const auto &[type, code] : conversions) {
+      cv::Mat pixels(16, 16, type);
+      cv::randu(pixels, 0, 256);
+      std::vector<uchar> png;
+      REQUIRE(cv::imencode(".png", pixels, png));
+      const auto parts = imageHelper.decodeImage(png, "pixels.png", 1, false);
+      REQUIRE(parts.size() == 1);
+      cv::Mat expected;
+      cv::cvtColor(pixels, expected, code);
+      expected.convertTo(expected, CV_32FC4, 1.0 / 255.0);
+      CHECK(cv::norm(parts[0]->data, expected, cv::NORM_INF) == 0);
+    }
+  }
+
+  SUBCASE("Test RGBA image") {
+    ImageHelper imageHelper;
+    // the alpha channel is dropped by the decoding, at a reduced resolution
+    // or not, as IMREAD_ANYCOLOR does
+    cv::Mat pixels(128, 96, CV_8UC4, cv::Scalar(10, 20, 30, 128));
+    const std::string path = "tmpRGBA.png";
+    REQUIRE(cv::imwrite(path, pixels));
+    for (size_t resize : {8, 64}) {
+      const auto image = imageHelper.loadImage(path, 2, false, resize, resize);
+      REQUIRE(image.size() == 4);
+      CHECK(image[0]->orig_channels == 3);
+      CHECK(image[0]->orig_type == CV_8UC3);
+      CHECK(image[0]->orig_width == 96);
+      CHECK(image[0]->orig_height == 128);
+      const cv::Scalar mean = cv::mean(image[0]->data);
+      CHECK(mean[0] == doctest::Approx(30.0 / 255.0));
+      CHECK(mean[3] == doctest::Approx(1.0));
+    }
+    std::filesystem::remove(path);
+  }
+}
@@ -1,9 +1,18 @@
+#include "CounterRng.h"
+#include "InferenceSession.h"
 #include "Layer.h"
 #include "LayerHidden.h"
+#include "LayerKernels.h"
 #include "Manager.h"
+#include "NeighborStencil.h"
 #include "doctest.h"
+#include "exception/NeuralNetworkException.h"
+#include <cmath>
 #include <cstddef>
 #include <memory>
+#include <tbb/global_control.h>
+#include <thread>
+#include <vector>
 
 using namespace sipai;
 
@@ -61,4 +70,708 @@ TEST_CASE("Testing Layer")
 
     manager.network.reset();
   }
+
+  SUBCASE("Test forwardPropagation")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 5,
+        .input_size_y = 3,
+        .hidden_size_x = 4,
+        .hidden_size_y = 3,
+        .output_size_x = 3,
+        .output_size_y = 2,
+        .hiddens_count = 1,
+    };
+    manager.network_params.hidden_activation_function =
+        EActivationFunction::Sigmoid;
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    auto &hiddenLayer = manager.network->layers.at(1);
+    cv::randu(hiddenLayer->previousLayer->values, 0, 1);
+    hiddenLayer->forwardPropagation();
+
+    // compare with the per neuron weighted sum
+    for (size_t i = 0; i < hiddenLayer->total(); i++)
+    {
+      const auto &neuron = hiddenLayer->getNeuron(i);
+      cv::Vec4f sum =
+          cv::sum(hiddenLayer->previousLayer->values.mul(neuron.weights));
+      cv::Vec4f expected = hiddenLayer->activationFunction(sum);
+      cv::Vec4f value =
+          hiddenLayer->values.at<cv::Vec4f>((int)neuron.index_y,
+                                            (int)neuron.index_x);
+      for (int c = 0; c < 4; c++)
+      {
+        CHECK(value[c] == doctest::Approx(expected[c]).epsilon(1e-4));
+      }
+    }
+
+    // a batch of samples gives the same values than one sample at a time
+    cv::Mat inputs(2, (int)hiddenLayer->previousLayer->total(), CV_32FC4);
+    cv::randu(inputs, 0, 1);
+    cv::Mat outputs;
+    hiddenLayer->forwardPropagation(inputs, outputs);
+    CHECK(outputs.rows == 2);
+    CHECK(outputs.cols == (int)hiddenLayer->total());
+    for (int b = 0; b < 2; b++)
+    {
+      cv::Mat single;
+      hiddenLayer->forwardPropagation(inputs.row(b), single);
+      CHECK(cv::norm(single - outputs.row(b), cv::NORM_L1) < 1e-6);
+    }
+
+    manager.network.reset();
+    manager.network_params = {};
+  }
+
+  SUBCASE("Test backwardPropagation")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 4,
+        .hidden_size_y = 3,
+        .output_size_x = 3,
+        .output_size_y = 2,
+        .hiddens_count = 1,
+    };
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    auto &hiddenLayer = manager.network->layers.at(1);
+    auto &outputLayer = manager.network->layers.back();
+    cv::randu(hiddenLayer->values, 0, 1);
+    cv::randu(outputLayer->errors, -1, 1);
+    cv::randu(hiddenLayer->errors, -1, 1);
+    const cv::Mat previous = hiddenLayer->errors.clone();
+    cv::Mat expected = hiddenLayer->errors.clone();
+    const float error_min = manager.network_params.error_min;
+    const float error_max = manager.network_params.error_max;
+
+    // per neuron gather of the next layer errors
+    for (int y = 0; y < (int)hiddenLayer->size_y; y++)
+    {
+      for (int x = 0; x < (int)hiddenLayer->size_x; x++)
+      {
+        cv::Vec4f error(0.0f);
+        for (const auto &row : outputLayer->neurons)
+        {
+          for (const auto &nextNeuron : row)
+          {
+            error += outputLayer->errors
+                         .at<cv::Vec4f>((int)nextNeuron.index_y,
+                                        (int)nextNeuron.index_x)
+                         .mul(nextNeuron.weights.at<cv::Vec4f>(y, x));
+          }
+        }
+        // the adjacent neurons errors of the previous pass
+        hiddenLayer->neighbors.forEach(
+            x, y,
+            [&](size_t nx, size_t ny, const cv::Vec4f &weight)
+            { error += weight.mul(previous.at<cv::Vec4f>((int)ny, (int)nx)); });
+        const cv::Vec4f derivative = hiddenLayer->activationFunctionDerivative(
+            hiddenLayer->values.at<cv::Vec4f>(y, x));
+        expected.at<cv::Vec4f>(y, x) =
+            Common::clamp4f(derivative.mul(error), error_min, error_max);
+      }
+    }
+
+    hiddenLayer->backwardPropagation(error_min, error_max);
+    for (int y = 0; y < (int)hiddenLayer->size_y; y++)
+    {
+      for (int x = 0; x < (int)hiddenLayer->size_x; x++)
+      {
+        for (int c = 0; c < 4; c++)
+        {
+          CHECK(hiddenLayer->errors.at<cv::Vec4f>(y, x)[c] ==
+                doctest::Approx(expected.at<cv::Vec4f>(y, x)[c])
+                    .epsilon(1e-4));
+        }
+      }
+    }
+
+    manager.network.reset();
+  }
+
+  SUBCASE("Test fused backward propagation and weights update")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+    };
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    auto &network = manager.network;
+    const float error_min = manager.network_params.error_min;
+    const float error_max = manager.network_params.error_max;
+    const float learning_rate = 0.1f;
+
+    cv::Mat input(2, 2, CV_32FC4);
+    cv::Mat target(3, 3, CV_32FC4);
+    cv::randu(input, 0, 1);
+    cv::randu(target, 0, 1);
+    network->forwardPropagation(input);
+
+    // save the network state
+    std::vector<cv::Mat> savedWeights;
+    std::vector<cv::Mat> savedErrors;
+    std::vector<cv::Mat> savedNeighbors;
+    for (const auto &layer : network->layers)
+    {
+      savedWeights.push_back(layer->weights.clone());
+      savedErrors.push_back(layer->errors.clone());
+      savedNeighbors.push_back(layer->neighbors.weights.clone());
+    }
+    auto restore = [&]()
+    {
+      for (size_t l = 0; l < network->layers.size(); l++)
+      {
+        auto &layer = network->layers.at(l);
+        savedWeights.at(l).copyTo(layer->weights);
+        savedErrors.at(l).copyTo(layer->errors);
+        savedNeighbors.at(l).copyTo(layer->neighbors.weights);
+      }
+    };
+
+    // two passes
+    network->backwardPropagation(target, error_min, error_max);
+    network->updateWeights(learning_rate);
+    std::vector<cv::Mat> twoPassWeights;
+    std::vector<cv::Mat> twoPassErrors;
+    for (const auto &layer : network->layers)
+    {
+      twoPassWeights.push_back(layer->weights.clone());
+      twoPassErrors.push_back(layer->errors.clone());
+    }
+
+    // fused
+    restore();
+    network->backwardPropagationAndUpdateWeights(target, error_min, error_max,
+                                                 learning_rate);
+    for (size_t l = 1; l < network->layers.size(); l++)
+    {
+      const auto &layer = network->layers.at(l);
+      CHECK(cv::norm(layer->weights - twoPassWeights.at(l), cv::NORM_L1) <
+            1e-4);
+      CHECK(cv::norm(layer->errors - twoPassErrors.at(l), cv::NORM_L1) <
+            1e-4);
+    }
+
+    manager.network.reset();
+  }
+
+  SUBCASE("Test mini-batch training")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+    };
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    auto &network = manager.network;
+    const float error_min = manager.network_params.error_min;
+    const float error_max = manager.network_params.error_max;
+    const float learning_rate = 0.1f;
+
+    // save the network weights
+    std::vector<cv::Mat> savedWeights;
+    std::vector<cv::Mat> savedNeighbors;
+    for (const auto &layer : network->layers)
+    {
+      savedWeights.push_back(layer->weights.clone());
+      savedNeighbors.push_back(layer->neighbors.weights.clone());
+    }
+    auto trainBatch = [&](const cv::Mat &inputs, const cv::Mat &targets,
+                          bool fused)
+    {
+      for (size_t l = 0; l < network->layers.size(); l++)
+      {
+        auto &layer = network->layers.at(l);
+        savedWeights.at(l).copyTo(layer->weights);
+        savedNeighbors.at(l).copyTo(layer->neighbors.weights);
+      }
+      network->batchErrors.clear();
+      network->forwardPropagationBatch(inputs);
+      if (fused)
+      {
+        network->backwardPropagationAndUpdateWeightsBatch(
+            targets, error_min, error_max, learning_rate);
+      }
+      else
+      {
+        network->backwardPropagationBatch(targets, error_min, error_max);
+        network->updateWeightsBatch(learning_rate);
+      }
+      std::vector<cv::Mat> weights;
+      for (const auto &layer : network->layers)
+      {
+        weights.push_back(layer->weights.clone());
+      }
+      return weights;
+    };
+
+    // a batch of the same sample twice averages to the one sample gradient
+    cv::Mat input(1, 4, CV_32FC4);
+    cv::Mat target(1, 9, CV_32FC4);
+    cv::randu(input, 0, 1);
+    cv::randu(target, 0, 1);
+    const auto single = trainBatch(input, target, false);
+    cv::Mat inputs;
+    cv::Mat targets;
+    cv::repeat(input, 2, 1, inputs);
+    cv::repeat(target, 2, 1, targets);
+    const auto twice = trainBatch(inputs, targets, false);
+    CHECK(network->batchValues.back().rows == 2);
+    for (size_t l = 1; l < network->layers.size(); l++)
+    {
+      CHECK(cv::norm(single.at(l) - twice.at(l), cv::NORM_L1) < 1e-4);
+    }
+
+    // the fused mini-batch step gives the same weights than the two passes
+    cv::randu(inputs, 0, 1);
+    cv::randu(targets, 0, 1);
+    const auto twoPass = trainBatch(inputs, targets, false);
+    const auto fused = trainBatch(inputs, targets, true);
+    for (size_t l = 1; l < network->layers.size(); l++)
+    {
+      CHECK(cv::norm(twoPass.at(l) - fused.at(l), cv::NORM_L1) < 1e-4);
+    }
+
+    manager.network.reset();
+  }
+
+  SUBCASE("Test contiguous weights")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 1,
+    };
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    CHECK(manager.network->layers.front()->weights.empty());
+    for (size_t l = 1; l < manager.network->layers.size(); l++)
+    {
+      const auto &layer = manager.network->layers.at(l);
+      CHECK(layer->weights.rows == (int)layer->total());
+      CHECK(layer->weights.cols == (int)layer->previousLayer->total());
+      CHECK(layer->weights.type() == CV_32FC4);
+      CHECK((size_t)layer->weights.data % WEIGHTS_ALIGNMENT == 0);
+      CHECK(layer->weights.step[0] % WEIGHTS_ALIGNMENT == 0);
+      for (size_t i = 0; i < layer->total(); i++)
+      {
+        // the neuron weights is a view on the layer weights row
+        const auto &neuron = layer->getNeuron(i);
+        CHECK(neuron.weights.data == layer->weights.ptr((int)i));
+        CHECK(neuron.weights.rows == (int)layer->previousLayer->size_y);
+        CHECK(neuron.weights.cols == (int)layer->previousLayer->size_x);
+      }
+    }
+    // an update through the layer is seen by the neuron
+    auto &outputLayer = manager.network->layers.back();
+    outputLayer->weights.at<cv::Vec4f>(1, 2) = cv::Vec4f::all(42.0f);
+    CHECK(outputLayer->getNeuron(1).weights.at<cv::Vec4f>(0, 2) ==
+          cv::Vec4f::all(42.0f));
+
+    // all the layers matrices are in the network arena, sized from the
+    // parameters
+    const auto &arena = manager.network->arena;
+    CHECK(arena.capacity() ==
+          NetworkArena::networkBytes(manager.network_params));
+    CHECK(arena.used() == arena.capacity());
+    const uchar *begin = manager.network->layers.front()->values.data;
+    const uchar *end = begin + arena.capacity();
+    auto inArena = [begin, end](const cv::Mat &mat)
+    { return mat.datastart >= begin && mat.dataend <= end; };
+    for (const auto &layer : manager.network->layers)
+    {
+      CHECK(inArena(layer->values));
+      CHECK(inArena(layer->errors));
+      if (layer->previousLayer != nullptr)
+      {
+        CHECK(inArena(layer->weights));
+        CHECK(inArena(layer->neighbors.weights));
+      }
+    }
+    NetworkArena small;
+    small.reserve(NetworkArena::matBytes(2, 2));
+    CHECK_NOTHROW(small.allocate(2, 2));
+    CHECK_THROWS_AS(small.allocate(1, 1), NeuralNetworkException);
+    CHECK_THROWS_AS(small.reserve(64), NeuralNetworkException);
+
+    manager.network.reset();
+  }
+
+  SUBCASE("Test weights initialization seed")
+  {
+    // Philox4x32-10 known answers
+    CHECK(CounterRng(0)({0, 0, 0, 0}) ==
+          CounterRng::Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+    CHECK(CounterRng(0x299f31d0a4093822)(
+              {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}) ==
+          CounterRng::Block{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1});
+
+    // the same seed gives the same network, with one thread or all of them
+    auto &manager = Manager::getInstance();
+    std::vector<cv::Mat> weights[3];
+    const size_t seeds[3] = {42, 42, 43};
+    for (int pass = 0; pass < 3; pass++)
+    {
+      std::unique_ptr<tbb::global_control> serial;
+      if (pass == 0)
+      {
+        serial = std::make_unique<tbb::global_control>(
+            tbb::global_control::max_allowed_parallelism, 1);
+      }
+      manager.network.reset();
+      manager.network_params = {
+          .input_size_x = 4,
+          .input_size_y = 3,
+          .hidden_size_x = 5,
+          .hidden_size_y = 4,
+          .output_size_x = 3,
+          .output_size_y = 3,
+          .hiddens_count = 2,
+      };
+      manager.app_params.network_to_import = "";
+      manager.app_params.seed = seeds[pass];
+      manager.createOrImportNetwork();
+      for (const auto &layer : manager.network->layers)
+      {
+        if (layer->previousLayer != nullptr)
+        {
+          weights[pass].push_back(layer->weights.clone());
+          weights[pass].push_back(layer->neighbors.weights.clone());
+        }
+      }
+    }
+    REQUIRE(weights[0].size() == weights[1].size());
+    bool differs = false;
+    for (size_t i = 0; i < weights[0].size(); i++)
+    {
+      CHECK(cv::norm(weights[0][i] - weights[1][i], cv::NORM_INF) == 0);
+      differs |= cv::norm(weights[0][i] - weights[2][i], cv::NORM_INF) > 0;
+    }
+    CHECK(differs);
+    // roughly a standard normal distribution
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(weights[0][0].reshape(1), mean, stddev);
+    CHECK(std::abs(mean[0]) < 0.3);
+    CHECK(std::abs(stddev[0] - 1.0) < 0.3);
+
+    manager.app_params.seed = NO_SEED;
+    manager.network.reset();
+  }
+
+  SUBCASE("Test parallel kernels")
+  {
+    // the rows and columns partitions give the same results than one thread
+    const size_t n_out = 96;
+    const size_t n_in = 1536;
+    const size_t batch = 2;
+    cv::Mat weights((int)n_out, (int)n_in, CV_32FC4);
+    cv::Mat inputs((int)batch, (int)n_in, CV_32FC4);
+    cv::Mat errors((int)batch, (int)n_out, CV_32FC4);
+    cv::randn(weights, cv::Vec4f::all(0), cv::Vec4f::all(1));
+    cv::randu(inputs, 0, 1);
+    cv::randu(errors, -1, 1);
+    cv::Mat outputs[2];
+    cv::Mat propagated[2];
+    cv::Mat updated[2];
+    for (int pass = 0; pass < 2; pass++)
+    {
+      std::unique_ptr<tbb::global_control> serial;
+      if (pass == 0)
+      {
+        serial = std::make_unique<tbb::global_control>(
+            tbb::global_control::max_allowed_parallelism, 1);
+      }
+      outputs[pass].create((int)batch, (int)n_out, CV_32FC4);
+      propagated[pass].create((int)batch, (int)n_in, CV_32FC4);
+      updated[pass] = weights.clone();
+      kernels::forwardGemm(updated[pass].ptr<float>(), updated[pass].step1(),
+                           inputs.ptr<float>(), inputs.step1(),
+                           outputs[pass].ptr<float>(), outputs[pass].step1(),
+                           n_out, n_in, batch);
+      kernels::fusedBackwardUpdate(
+          updated[pass].ptr<float>(), updated[pass].step1(),
+          errors.ptr<float>(), errors.step1(), inputs.ptr<float>(),
+          inputs.step1(), propagated[pass].ptr<float>(),
+          propagated[pass].step1(), 0.01f, n_out, n_in, batch);
+    }
+    CHECK(cv::norm(outputs[0] - outputs[1], cv::NORM_INF) == 0);
+    CHECK(cv::norm(propagated[0] - propagated[1], cv::NORM_INF) == 0);
+    CHECK(cv::norm(updated[0] - updated[1], cv::NORM_INF) == 0);
+  }
+
+  SUBCASE("Test neighbors stencil")
+  {
+    // a fresh arena for each init, kept alive with the stencil weights
+    std::vector<std::unique_ptr<NetworkArena>> arenas;
+    auto initStencil = [&arenas](NeighborStencil &stencil, size_t size_x,
+                                 size_t size_y, float radius)
+    {
+      arenas.push_back(std::make_unique<NetworkArena>());
+      arenas.back()->reserve(NetworkArena::matBytes(
+          NeighborStencil::getOffsets(radius).size() * size_y, size_x));
+      stencil.init(size_x, size_y, radius, *arenas.back());
+    };
+    NeighborStencil stencil;
+    initStencil(stencil, 5, 4, 0.0f);
+    CHECK(stencil.empty());
+    initStencil(stencil, 5, 4, 1.0f);
+    CHECK(stencil.offsets.size() == 4);
+    CHECK(stencil.count(0, 0) == 2);
+    CHECK(stencil.count(1, 0) == 3);
+    CHECK(stencil.count(2, 2) == 4);
+    initStencil(stencil, 5, 4, 1.5f);
+    CHECK(stencil.offsets.size() == 8);
+    CHECK(stencil.count(0, 0) == 3);
+
+    // the stencil gives the same results than a per neuron gather, with the
+    // borders of the layer
+    for (float radius : {1.0f, 1.5f, 2.0f, 3.0f})
+    {
+      const size_t size_x = 7;
+      const size_t size_y = 5;
+      initStencil(stencil, size_x, size_y, radius);
+      stencil.randomize(CounterRng(7), 1);
+      cv::Mat values((int)size_y, (int)size_x, CV_32FC4);
+      cv::Mat errors((int)size_y, (int)size_x, CV_32FC4);
+      cv::randu(values, -1, 1);
+      cv::randu(errors, -1, 1);
+      cv::Mat sums = cv::Mat::zeros((int)size_y, (int)size_x, CV_32FC4);
+      stencil.accumulate(values.ptr<cv::Vec4f>(), sums.ptr<cv::Vec4f>());
+      const cv::Mat weights = stencil.weights.clone();
+      const float learningRate = 0.1f;
+      stencil.update(values.ptr<cv::Vec4f>(), errors.ptr<cv::Vec4f>(),
+                     learningRate);
+      for (size_t y = 0; y < size_y; y++)
+      {
+        for (size_t x = 0; x < size_x; x++)
+        {
+          cv::Vec4f sum = cv::Vec4f::all(0.0f);
+          size_t k = 0;
+          for (const auto &offset : stencil.offsets)
+          {
+            const int nx = (int)x + offset.dx;
+            const int ny = (int)y + offset.dy;
+            const cv::Vec4f weight = weights.at<cv::Vec4f>(
+                (int)(k * size_y + y), (int)x);
+            const cv::Vec4f updated =
+                stencil.planes[k].at<cv::Vec4f>((int)y, (int)x);
+            if (nx < 0 || ny < 0 || nx >= (int)size_x || ny >= (int)size_y)
+            {
+              CHECK(weight == cv::Vec4f::all(0.0f));
+              CHECK(updated == cv::Vec4f::all(0.0f));
+            }
+            else
+            {
+              const cv::Vec4f value = values.at<cv::Vec4f>(ny, nx);
+              sum += weight.mul(value);
+              const cv::Vec4f expected =
+                  weight - value.mul(errors.at<cv::Vec4f>((int)y, (int)x)) *
+                               learningRate;
+              for (int c = 0; c < 4; c++)
+              {
+                CHECK(updated[c] == doctest::Approx(expected[c]));
+              }
+            }
+            k++;
+          }
+          for (int c = 0; c < 4; c++)
+          {
+            CHECK(sums.at<cv::Vec4f>((int)y, (int)x)[c] ==
+                  doctest::Approx(sum[c]));
+          }
+        }
+      }
+    }
+  }
+
+  SUBCASE("Test CPU instruction sets")
+  {
+    // every instruction set supported by the CPU gives the baseline results,
+    // to the rounding of the fused multiply-adds
+    const size_t n_out = 37;
+    const size_t n_in = 531;
+    const size_t batch = 3;
+    cv::Mat weights((int)n_out, (int)n_in, CV_32FC4);
+    cv::Mat inputs((int)batch, (int)n_in, CV_32FC4);
+    cv::Mat errors((int)batch, (int)n_out, CV_32FC4);
+    cv::randn(weights, cv::Vec4f::all(0), cv::Vec4f::all(1));
+    cv::randu(inputs, 0, 1);
+    cv::randu(errors, -1, 1);
+    cv::Mat baseOutputs;
+    cv::Mat basePropagated;
+    cv::Mat baseUpdated;
+    const auto detected = kernels::detectCpuIsa();
+    for (int isa = 0; isa <= (int)detected; isa++)
+    {
+      kernels::setCpuIsa((kernels::ECpuIsa)isa);
+      CHECK(kernels::getCpuIsa() == (kernels::ECpuIsa)isa);
+      cv::Mat outputs((int)batch, (int)n_out, CV_32FC4);
+      cv::Mat propagated((int)batch, (int)n_in, CV_32FC4);
+      cv::Mat updated = weights.clone();
+      kernels::forwardGemm(updated.ptr<float>(), updated.step1(),
+                           inputs.ptr<float>(), inputs.step1(),
+                           outputs.ptr<float>(), outputs.step1(), n_out, n_in,
+                           batch, EActivationFunction::Sigmoid, 0.0f);
+      kernels::fusedBackwardUpdate(
+          updated.ptr<float>(), updated.step1(), errors.ptr<float>(),
+          errors.step1(), inputs.ptr<float>(), inputs.step1(),
+          propagated.ptr<float>(), propagated.step1(), 0.01f, n_out, n_in,
+          batch);
+      if (isa == 0)
+      {
+        baseOutputs = outputs;
+        basePropagated = propagated;
+        baseUpdated = updated;
+        continue;
+      }
+      CHECK(cv::norm(outputs - baseOutputs, cv::NORM_INF) < 1e-5);
+      CHECK(cv::norm(propagated - basePropagated, cv::NORM_INF) < 1e-4);
+      CHECK(cv::norm(updated - baseUpdated, cv::NORM_INF) < 1e-6);
+    }
+    kernels::setCpuIsa(detected);
+    CHECK(kernels::getCpuIsa() == detected);
+  }
+
+  SUBCASE("Test shared weights updates")
+  {
+    // the Hogwild updates of the shared weights give the vectorized updates
+    // results, to the rounding of the batch sums
+    const size_t n_out = 37;
+    const size_t n_in = 531;
+    const size_t batch = 3;
+    cv::Mat weights((int)n_out, (int)n_in, CV_32FC4);
+    cv::Mat inputs((int)batch, (int)n_in, CV_32FC4);
+    cv::Mat errors((int)batch, (int)n_out, CV_32FC4);
+    cv::randn(weights, cv::Vec4f::all(0), cv::Vec4f::all(1));
+    cv::randu(inputs, 0, 1);
+    cv::randu(errors, -1, 1);
+    cv::Mat propagated[2];
+    cv::Mat updated[2];
+    cv::Mat stencil[2];
+    for (int shared = 0; shared < 2; shared++)
+    {
+      kernels::setSharedWeights(shared == 1);
+      CHECK(kernels::isSharedWeights() == (shared == 1));
+      propagated[shared].create((int)batch, (int)n_in, CV_32FC4);
+      updated[shared] = weights.clone();
+      kernels::fusedBackwardUpdate(
+          updated[shared].ptr<float>(), updated[shared].step1(),
+          errors.ptr<float>(), errors.step1(), inputs.ptr<float>(),
+          inputs.step1(), propagated[shared].ptr<float>(),
+          propagated[shared].step1(), 0.01f, n_out, n_in, batch);
+      stencil[shared] = weights.row(0).clone();
+      kernels::updateWeights(inputs.ptr<float>(0), inputs.ptr<float>(1),
+                             -0.1f, stencil[shared].ptr<float>(),
+                             n_in * kernels::CHANNELS);
+    }
+    kernels::setSharedWeights(false);
+    CHECK(cv::norm(propagated[1] - propagated[0], cv::NORM_INF) < 1e-5);
+    CHECK(cv::norm(updated[1] - updated[0], cv::NORM_INF) < 1e-6);
+    CHECK(cv::norm(stencil[1] - stencil[0], cv::NORM_INF) < 1e-6);
+  }
+
+  SUBCASE("Test inference sessions")
+  {
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+    };
+    manager.app_params.network_to_import = "";
+    manager.createOrImportNetwork();
+    const auto &network = *manager.network;
+
+    // the expected outputs, from the network layers values
+    constexpr int count = 16;
+    std::vector<cv::Mat> inputs;
+    std::vector<cv::Mat> expected;
+    for (int i = 0; i < count; i++)
+    {
+      cv::Mat input(2, 2, CV_32FC4);
+      cv::randu(input, 0, 1);
+      inputs.push_back(input);
+      expected.push_back(manager.network->forwardPropagation(input).clone());
+    }
+
+    // concurrent sessions on the same network
+    std::vector<std::vector<cv::Mat>> outputs(4);
+    std::vector<std::thread> threads;
+    for (auto &threadOutputs : outputs)
+    {
+      threads.emplace_back(
+          [&network, &inputs, &threadOutputs]()
+          {
+            InferenceSession session(network);
+            for (int pass = 0; pass < 10; pass++)
+            {
+              threadOutputs.clear();
+              for (const auto &input : inputs)
+              {
+                threadOutputs.push_back(
+                    session.forwardPropagation(input).clone());
+              }
+            }
+          });
+    }
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+    for (const auto &threadOutputs : outputs)
+    {
+      REQUIRE(threadOutputs.size() == (size_t)count);
+      for (int i = 0; i < count; i++)
+      {
+        CHECK(threadOutputs[i].rows == 3);
+        CHECK(threadOutputs[i].cols == 3);
+        CHECK(cv::norm(threadOutputs[i], expected[i], cv::NORM_INF) < 1e-6);
+      }
+    }
+
+    // an input view on a larger image
+    cv::Mat image(4, 4, CV_32FC4);
+    cv::randu(image, 0, 1);
+    const cv::Mat view = image(cv::Rect(1, 1, 2, 2));
+    InferenceSession session(network);
+    CHECK(cv::norm(session.forwardPropagation(view),
+                   manager.network->forwardPropagation(view.clone()),
+                   cv::NORM_INF) < 1e-6);
+    CHECK_THROWS_AS(session.forwardPropagation(image), NeuralNetworkException);
+
+    manager.network.reset();
+  }
 }
\ No newline at end of file
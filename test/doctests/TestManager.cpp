@@ -6,8 +6,11 @@
 #include "Layer.h"
 #include "Manager.h"
 #include "doctest.h"
+#include <algorithm>
 #include <cstddef>
 #include <filesystem>
+#include <fstream>
+#include <set>
 
 using namespace sipai;
 
@@ -49,15 +52,15 @@ TEST_CASE("Testing the Manager class") {
 
     const auto &inputLayer = network->layers.front();
     CHECK(inputLayer->total() == (np.input_size_x * np.input_size_y));
-    CHECK(inputLayer->neurons.at(0).at(0).neighbors.size() == 0);
+    CHECK(inputLayer->neighbors.count(0, 0) == 0);
 
     const auto &hiddenLayer = network->layers.at(1);
     CHECK(hiddenLayer->total() == (np.hidden_size_x * np.hidden_size_y));
-    CHECK(hiddenLayer->neurons.at(0).at(0).neighbors.size() == 2);
+    CHECK(hiddenLayer->neighbors.count(0, 0) == 2);
 
     const auto &outputLayer = network->layers.back();
     CHECK(outputLayer->total() == (np.output_size_x * np.output_size_y));
-    CHECK(outputLayer->neurons.at(0).at(0).neighbors.size() == 2);
+    CHECK(outputLayer->neighbors.count(0, 0) == 2);
 
     manager.network.reset();
   }
@@ -122,14 +125,67 @@ TEST_CASE("Testing the Manager class") {
     CHECK(nn->layers.front()->total() == 4);
     CHECK(nn->layers.at(1)->total() == 6);
     CHECK(nn->layers.back()->total() == 9);
-    CHECK(nn->layers.front()->neurons.at(0).at(0).neighbors.size() == 0);
-    CHECK(nn->layers.back()->neurons.at(0).at(0).neighbors.size() == 2);
+    CHECK(nn->layers.front()->neighbors.count(0, 0) == 0);
+    CHECK(nn->layers.back()->neighbors.count(0, 0) == 2);
 
     std::filesystem::remove(ap.network_to_export);
     std::filesystem::remove(network_csv);
     manager.network.reset();
   }
 
+  SUBCASE("Test import/export network with a large neighbors radius") {
+    // the output neurons have more neighbors than weights with the previous
+    // layer: the CSV rows still have the same width, and are imported back
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    auto &np = manager.network_params;
+    np.input_size_x = 2;
+    np.input_size_y = 2;
+    np.hidden_size_x = 5;
+    np.hidden_size_y = 5;
+    np.output_size_x = 6;
+    np.output_size_y = 6;
+    np.hiddens_count = 1;
+    np.neighbors_radius = 3.0f;
+    ap.network_to_import = "";
+    ap.network_to_export = "tmpNetwork.json";
+    const std::string network_csv = "tmpNetwork.csv";
+    manager.createOrImportNetwork();
+    const size_t neighbors = NeighborStencil::getOffsets(3.0f).size();
+    CHECK(neighbors > 25);
+    CHECK(manager.network->max_weights == neighbors);
+    const cv::Mat weights = manager.network->layers.back()->weights.clone();
+    const cv::Mat neighborsWeights =
+        manager.network->layers.back()->neighbors.weights.clone();
+    manager.exportNetwork();
+
+    std::ifstream file(network_csv);
+    std::set<long> widths;
+    std::string line;
+    while (std::getline(file, line)) {
+      widths.insert(std::count(line.begin(), line.end(), ','));
+    }
+    file.close();
+    CHECK(widths.size() == 1);
+
+    manager.network.reset();
+    manager.network_params = {};
+    ap.network_to_import = "tmpNetwork.json";
+    manager.createOrImportNetwork();
+    CHECK(np.neighbors_radius == 3.0f);
+    CHECK(manager.network->max_weights == neighbors);
+    const auto &outputLayer = manager.network->layers.back();
+    CHECK(cv::norm(outputLayer->weights, weights, cv::NORM_INF) < 1e-4);
+    CHECK(cv::norm(outputLayer->neighbors.weights, neighborsWeights,
+                   cv::NORM_INF) < 1e-4);
+
+    std::filesystem::remove(ap.network_to_export);
+    std::filesystem::remove(network_csv);
+    manager.network.reset();
+    manager.network_params = {};
+    ap.network_to_import = "";
+  }
+
   SUBCASE("Testing runWithVisitor call") {
     auto &manager = Manager::getInstance();
     manager.app_params.training_data_file = "images-test1.csv";
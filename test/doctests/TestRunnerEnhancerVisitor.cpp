@@ -1,9 +1,13 @@
+#include "ImageHelper.h"
+#include "ImageStrips.h"
+#include "InferenceSession.h"
 #include "Manager.h"
 #include "NeuralNetwork.h"
 #include "RunnerEnhancerOpenCVVisitor.h"
 #include "doctest.h"
 #include "exception/RunnerVisitorException.h"
 #include <filesystem>
+#include <fstream>
 #include <memory>
 
 using namespace sipai;
@@ -53,9 +57,269 @@ TEST_CASE("Testing RunnerEnhancerVisitor") {
     CHECK_NOTHROW(visitor.visit());
     CHECK(std::filesystem::exists(manager.app_params.output_file));
 
+    // the parts are enhanced concurrently, into the whole output image
+    manager.app_params.image_split = 3;
+    CHECK_NOTHROW(visitor.visit());
+    const auto input = cv::imread(manager.app_params.input_file);
+    const auto output = cv::imread(manager.app_params.output_file);
+    CHECK(output.size() == input.size());
+    manager.app_params.image_split = AppParams().image_split;
+
     if (std::filesystem::exists(manager.app_params.output_file)) {
       std::filesystem::remove(manager.app_params.output_file);
     }
     manager.network.reset();
   }
-}
\ No newline at end of file
+
+  SUBCASE("Test batch enhancement") {
+    RunnerEnhancerOpenCVVisitor visitor;
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+    };
+    manager.app_params.network_to_import = "";
+    manager.app_params.enable_vulkan = false;
+    manager.createOrImportNetwork();
+    auto &ap = manager.app_params;
+    ap.input_file = "";
+    ap.output_file = "";
+    const std::string folder = "tmpBatchOutput";
+    std::filesystem::remove_all(folder);
+
+    // no output folder
+    ap.input_folder = "../data/images/input";
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+
+    // the input folder as output folder
+    ap.output_folder = "../data/images/input/";
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+
+    // input folder
+    ap.output_folder = folder;
+    CHECK_NOTHROW(visitor.visit());
+    for (const auto &entry :
+         std::filesystem::directory_iterator(ap.input_folder)) {
+      CHECK(std::filesystem::exists(std::filesystem::path(folder) /
+                                    entry.path().filename()));
+    }
+    std::filesystem::remove_all(folder);
+
+    // input list, with a missing image that does not stop the others
+    const std::string list = "tmpBatchList.csv";
+    {
+      std::ofstream csv(list);
+      csv << "\"../data/images/input/001a.png\"\n"
+          << "../data/images/input/missing.png\n"
+          << "../data/images/input/003a.jpg\n";
+    }
+    ap.input_folder = "";
+    ap.input_list = list;
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+    CHECK(std::filesystem::exists(folder + "/001a.png"));
+    CHECK(std::filesystem::exists(folder + "/003a.jpg"));
+    CHECK_FALSE(std::filesystem::exists(folder + "/missing.png"));
+
+    // two inputs with the same output, nothing enhanced
+    std::filesystem::remove_all(folder);
+    {
+      std::ofstream csv(list);
+      csv << "../data/images/input/001a.png\n"
+          << "../data/images/output/../input/001a.png\n";
+    }
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+    CHECK_FALSE(std::filesystem::exists(folder + "/001a.png"));
+
+    ap.input_list = "";
+    ap.output_folder = "";
+    std::filesystem::remove(list);
+    std::filesystem::remove_all(folder);
+    manager.network.reset();
+  }
+
+  SUBCASE("Test streaming enhancement") {
+    RunnerEnhancerOpenCVVisitor visitor;
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+    };
+    manager.app_params.network_to_import = "";
+    manager.app_params.enable_vulkan = false;
+    manager.createOrImportNetwork();
+    auto &ap = manager.app_params;
+    const auto input = cv::imread("../data/images/input/001a.png");
+    const std::string ppm = "tmpStreamInput.ppm";
+    cv::imwrite(ppm, input);
+
+    // the PPM strips are memory mapped
+    ImageStripReader reader(ppm);
+    CHECK(reader.isMapped());
+    CHECK(reader.width() == input.cols);
+    CHECK(reader.height() == input.rows);
+    CHECK(cv::norm(reader.readRows(3, 5), input.rowRange(3, 8),
+                   cv::NORM_INF) == 0);
+
+    // not a TIFF output
+    ap.input_file = ppm;
+    ap.output_file = "tmpStreamOutput.png";
+    ap.stream_tile_size = 7;
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+
+    // edge tiles smaller than the tile size, with or without padding
+    ap.output_file = "tmpStreamOutput.tif";
+    for (bool padding : {false, true}) {
+      ap.enable_padding = padding;
+      CHECK_NOTHROW(visitor.visit());
+      const auto output = cv::imread(ap.output_file);
+      CHECK(output.size() == input.size());
+    }
+    ap.enable_padding = false;
+
+    // the output TIFF is memory mapped when streamed back
+    {
+      ImageStripReader tiff(ap.output_file);
+      CHECK(tiff.isMapped());
+      CHECK(tiff.channels() == 3);
+      CHECK(cv::norm(tiff.readRows(0, tiff.height()),
+                     cv::imread(ap.output_file), cv::NORM_INF) == 0);
+    }
+
+    // without halo, each tile is enhanced on its own, then placed: the edge
+    // tiles padded by reflection to the tile size, then cropped
+    {
+      CHECK_NOTHROW(visitor.visit());
+      ImageHelper imageHelper;
+      InferenceSession session(*manager.network);
+      cv::Mat expected(input.size(), input.type());
+      for (int y = 0; y < input.rows; y += 7) {
+        for (int x = 0; x < input.cols; x += 7) {
+          const cv::Rect rect(x, y, std::min(7, input.cols - x),
+                              std::min(7, input.rows - y));
+          Image tile{.data = cv::Mat(rect.size(), CV_32FC4)};
+          imageHelper.convertToValues(input(rect), tile.data);
+          cv::copyMakeBorder(tile.data, tile.data, 0, 7 - rect.height, 0,
+                             7 - rect.width, cv::BORDER_REFLECT);
+          tile.resize(2, 2);
+          Image output{.data = session.forwardPropagation(tile.data)};
+          output.data = output.data(
+              cv::Rect(0, 0, std::max(output.data.cols * rect.width / 7, 1),
+                       std::max(output.data.rows * rect.height / 7, 1)));
+          output.resize(rect.width, rect.height);
+          cv::Mat roi = expected(rect);
+          imageHelper.convertFromValues(output.data, input.type(), 3)
+              .copyTo(roi);
+        }
+      }
+      CHECK(cv::norm(cv::imread(ap.output_file), expected, cv::NORM_INF) ==
+            0);
+    }
+
+    // overlapped tiles, feather blended, and a halo too large for the tiles
+    ap.stream_tile_halo = 2;
+    CHECK_NOTHROW(visitor.visit());
+    CHECK(cv::imread(ap.output_file).size() == input.size());
+    ap.stream_tile_halo = 4;
+    CHECK_THROWS_AS(visitor.visit(), RunnerVisitorException);
+    ap.stream_tile_halo = 2;
+
+    // decoded input, and output scale
+    ap.input_file = "../data/images/input/001a.png";
+    ap.output_scale = 2.0f;
+    CHECK_NOTHROW(visitor.visit());
+    const auto output = cv::imread(ap.output_file);
+    CHECK(output.cols == input.cols * 2);
+    CHECK(output.rows == input.rows * 2);
+
+    ap.output_scale = AppParams().output_scale;
+    ap.stream_tile_size = 0;
+    ap.stream_tile_halo = 0;
+    ap.input_file = "";
+    ap.output_file = "";
+    std::filesystem::remove(ppm);
+    std::filesystem::remove("tmpStreamOutput.tif");
+    manager.network.reset();
+  }
+
+  SUBCASE("Test streaming blending") {
+    // the feather weights of the overlapping tiles sum to 1, whatever the
+    // output scale
+    for (int outputSize : {20, 37, 50, 83}) {
+      for (int halo : {0, 1, 3}) {
+        std::vector<float> sums(outputSize, 0.0f);
+        for (int x = 0; x < 50; x += 8) {
+          const auto weights =
+              featherWeights(x, std::min(x + 8, 50), halo, 50, outputSize);
+          const int begin =
+              toOutputPosition(std::max(x - halo, 0), 50, outputSize);
+          for (size_t i = 0; i < weights.size(); i++) {
+            sums[begin + i] += weights[i];
+          }
+        }
+        for (float sum : sums) {
+          CHECK(sum == doctest::Approx(1.0f));
+        }
+      }
+    }
+
+    // a network with a constant output, 0.5 by the sigmoid of its null
+    // weights: no seam between the blended tiles
+    RunnerEnhancerOpenCVVisitor visitor;
+    auto &manager = Manager::getInstance();
+    manager.network.reset();
+    manager.network_params = {
+        .input_size_x = 2,
+        .input_size_y = 2,
+        .hidden_size_x = 3,
+        .hidden_size_y = 2,
+        .output_size_x = 3,
+        .output_size_y = 3,
+        .hiddens_count = 2,
+        .output_activation_function = EActivationFunction::Sigmoid,
+    };
+    manager.app_params.network_to_import = "";
+    manager.app_params.enable_vulkan = false;
+    manager.createOrImportNetwork();
+    for (auto &layer : manager.network->layers) {
+      layer->weights.setTo(cv::Scalar::all(0));
+    }
+    auto &ap = manager.app_params;
+    const std::string ppm = "tmpStreamConstant.ppm";
+    cv::imwrite(ppm, cv::Mat(41, 53, CV_8UC3, cv::Scalar(100, 150, 200)));
+    ap.input_file = ppm;
+    ap.output_file = "tmpStreamConstant.tif";
+    ap.stream_tile_size = 7;
+    ap.stream_tile_halo = 3;
+    ap.output_scale = 1.5f;
+    CHECK_NOTHROW(visitor.visit());
+    const auto output = cv::imread(ap.output_file);
+    CHECK(output.size() == cv::Size(79, 61));
+    double minValue = 0;
+    double maxValue = 0;
+    cv::minMaxLoc(output.reshape(1), &minValue, &maxValue);
+    // 127.5, rounded either way by the float sums of the weights
+    CHECK(minValue >= 127);
+    CHECK(maxValue <= 128);
+
+    ap.output_scale = AppParams().output_scale;
+    ap.stream_tile_size = 0;
+    ap.stream_tile_halo = 0;
+    ap.input_file = "";
+    ap.output_file = "";
+    std::filesystem::remove(ppm);
+    std::filesystem::remove("tmpStreamConstant.tif");
+    manager.network.reset();
+  }
+}
@@ -1,12 +1,22 @@
+#include "DataPrefetcher.h"
+#include "ImageCache.h"
 #include "Manager.h"
 #include "NeuralNetwork.h"
 #include "RunnerTrainingOpenCVVisitor.h"
+#include "TileCache.h"
 #include "TrainingDataFactory.h"
+#include "TrainingShard.h"
 #include "doctest.h"
+#include "exception/FileReaderException.h"
 #include "exception/RunnerVisitorException.h"
 #include "exception/TrainingDataFactoryException.h"
 #include <filesystem>
+#include <fstream>
 #include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace sipai;
 
@@ -62,4 +72,435 @@ TEST_CASE("Testing RunnerTrainingOpenCVVisitor") {
     manager.network.reset();
     TrainingDataFactory::getInstance().clear();
   }
-}
\ No newline at end of file
+
+  SUBCASE("Test mini-batch run") {
+    RunnerTrainingOpenCVVisitor visitor;
+    TrainingDataFactory::getInstance().clear();
+    auto &manager = Manager::getInstance();
+
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.max_epochs = 2;
+    ap.run_mode = ERunMode::Training;
+    ap.network_to_export = "tempNetwork.json";
+    ap.network_to_import = "";
+    ap.enable_vulkan = false;
+    ap.random_loading = true;
+    ap.batch_size = 3;
+
+    auto &np = manager.network_params;
+    np.input_size_x = 2;
+    np.input_size_y = 2;
+    np.hidden_size_x = 3;
+    np.hidden_size_y = 2;
+    np.output_size_x = 3;
+    np.output_size_y = 3;
+    np.hiddens_count = 1;
+
+    manager.createOrImportNetwork();
+    CHECK_NOTHROW(visitor.visit());
+    CHECK(manager.network->batchValues.front().rows <= 3);
+
+    ap.batch_size = 1;
+    manager.network.reset();
+    TrainingDataFactory::getInstance().clear();
+  }
+
+  SUBCASE("Test mini-batch loss") {
+    // the loss is averaged per image whatever the mini-batches, the images
+    // having different parts counts
+    RunnerTrainingOpenCVVisitor visitor;
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.training_split_ratio = 0.5f;
+    ap.random_loading = false;
+    ap.image_split = 30;
+    ap.network_to_import = "";
+    ap.enable_vulkan = false;
+
+    auto &np = manager.network_params;
+    np.input_size_x = 2;
+    np.input_size_y = 2;
+    np.hidden_size_x = 3;
+    np.hidden_size_y = 2;
+    np.output_size_x = 3;
+    np.output_size_y = 3;
+    np.hiddens_count = 1;
+
+    manager.createOrImportNetwork();
+    auto &factory = TrainingDataFactory::getInstance();
+    factory.clear();
+    factory.loadData();
+    REQUIRE(factory.getSize(TrainingPhase::Validation) > 1);
+    const float loss = visitor.training(0, TrainingPhase::Validation);
+    CHECK(loss > 0.0f);
+    for (size_t workers : {1, 3}) {
+      ap.batch_size = 4;
+      ap.training_workers = workers;
+      CHECK(visitor.training(0, TrainingPhase::Validation) ==
+            doctest::Approx(loss).epsilon(1e-4));
+    }
+
+    ap.batch_size = 1;
+    ap.training_workers = 1;
+    ap.image_split = AppParams().image_split;
+    ap.training_split_ratio = AppParams().training_split_ratio;
+    manager.network.reset();
+    factory.clear();
+  }
+
+  SUBCASE("Test training workers run") {
+    RunnerTrainingOpenCVVisitor visitor;
+    auto &manager = Manager::getInstance();
+
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.max_epochs = 2;
+    ap.run_mode = ERunMode::Training;
+    ap.network_to_export = "tempNetwork.json";
+    ap.network_to_import = "";
+    ap.enable_vulkan = false;
+    ap.random_loading = true;
+    ap.batch_size = 2;
+    ap.training_workers = 3;
+
+    auto &np = manager.network_params;
+    np.input_size_x = 2;
+    np.input_size_y = 2;
+    np.hidden_size_x = 3;
+    np.hidden_size_y = 2;
+    np.output_size_x = 3;
+    np.output_size_y = 3;
+    np.hiddens_count = 1;
+
+    for (bool hogwild : {false, true}) {
+      TrainingDataFactory::getInstance().clear();
+      ap.enable_hogwild = hogwild;
+      manager.createOrImportNetwork();
+      CHECK_NOTHROW(visitor.visit());
+      manager.network.reset();
+    }
+
+    ap.batch_size = 1;
+    ap.training_workers = 1;
+    ap.enable_hogwild = false;
+    TrainingDataFactory::getInstance().clear();
+  }
+
+  SUBCASE("Test prefetched loading") {
+    // the data are given in the collection order, whatever the workers
+    // loading order, and the workers errors are rethrown
+    DataPrefetcher prefetcher(10, 3, 2, [](size_t index) {
+      if (index == 7) {
+        throw TrainingDataFactoryException("test");
+      }
+      return std::make_shared<Data>(Data{.file_input = std::to_string(index)});
+    });
+    for (size_t i = 0; i < 7; i++) {
+      auto data = prefetcher.next();
+      REQUIRE(data != nullptr);
+      CHECK(data->file_input == std::to_string(i));
+    }
+    CHECK_THROWS_AS(prefetcher.next(), TrainingDataFactoryException);
+
+    // the same images with or without loading workers, restarting from the
+    // first one after a counters reset
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.training_split_ratio = 1.0f;
+    ap.random_loading = false;
+    auto &factory = TrainingDataFactory::getInstance();
+    factory.clear();
+    factory.loadData();
+    REQUIRE(factory.getSize(TrainingPhase::Training) > 1);
+    std::vector<std::string> files[2];
+    for (size_t workers : {0, 3}) {
+      ap.loading_workers = workers;
+      auto &loaded = files[workers == 0 ? 0 : 1];
+      factory.resetCounters();
+      CHECK(factory.next(TrainingPhase::Training) != nullptr);
+      factory.resetCounters();
+      while (auto data = factory.next(TrainingPhase::Training)) {
+        CHECK_FALSE(data->img_input.empty());
+        loaded.push_back(data->file_target);
+      }
+    }
+    CHECK(files[0].size() == factory.getSize(TrainingPhase::Training));
+    CHECK(files[0] == files[1]);
+
+    ap.loading_workers = AppParams().loading_workers;
+    ap.training_split_ratio = AppParams().training_split_ratio;
+    factory.clear();
+  }
+
+  SUBCASE("Test tile cache") {
+    const std::string folder = "tempTileCache";
+    std::filesystem::remove_all(folder);
+    TileCache cache(folder);
+    CHECK(std::filesystem::exists(folder));
+    CHECK(cache.getPath({"missing.png"}, "").empty());
+
+    // save and map back some parts
+    ImageParts input;
+    ImageParts target;
+    for (int i = 0; i < 3; i++) {
+      cv::Mat data(2 + i, 3, CV_32FC4);
+      cv::randu(data, 0, 1);
+      auto &parts = i < 2 ? input : target;
+      parts.push_back(std::make_shared<Image>(Image{.data = data,
+                                                    .orig_height = 10,
+                                                    .orig_width = 20,
+                                                    .orig_type = CV_8UC3,
+                                                    .orig_channels = 3}));
+    }
+    const std::string path = folder + "/test.tiles";
+    ImageParts mappedInput;
+    ImageParts mappedTarget;
+    CHECK_FALSE(cache.load(path, mappedInput, mappedTarget));
+    cache.save(path, input, target);
+    REQUIRE(cache.load(path, mappedInput, mappedTarget));
+    REQUIRE(mappedInput.size() == 2);
+    REQUIRE(mappedTarget.size() == 1);
+    for (const auto &[parts, mapped] :
+         {std::make_pair(input, mappedInput),
+          std::make_pair(target, mappedTarget)}) {
+      for (size_t i = 0; i < parts.size(); i++) {
+        CHECK(mapped[i]->data.size() == parts[i]->data.size());
+        CHECK(mapped[i]->orig_width == 20);
+        CHECK(mapped[i]->orig_channels == 3);
+        CHECK((size_t)mapped[i]->data.data % 64 == 0);
+        CHECK(cv::norm(mapped[i]->data - parts[i]->data, cv::NORM_INF) == 0);
+      }
+    }
+    // an update of a mapped part does not change the file
+    mappedTarget[0]->data.setTo(cv::Scalar::all(2));
+    ImageParts reloadedInput;
+    ImageParts reloadedTarget;
+    REQUIRE(cache.load(path, reloadedInput, reloadedTarget));
+    CHECK(cv::norm(reloadedTarget[0]->data - target[0]->data, cv::NORM_INF) ==
+          0);
+
+    // the same training images with the tile cache, from the first epoch
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.training_split_ratio = 1.0f;
+    ap.random_loading = false;
+    auto &factory = TrainingDataFactory::getInstance();
+    std::vector<std::shared_ptr<Data>> datas[3];
+    for (int pass = 0; pass < 3; pass++) {
+      ap.tile_cache_folder = pass == 0 ? "" : folder;
+      factory.clear();
+      factory.loadData();
+      while (auto data = factory.next(TrainingPhase::Training)) {
+        datas[pass].push_back(data);
+      }
+    }
+    REQUIRE(datas[0].size() == datas[1].size());
+    REQUIRE(datas[0].size() == datas[2].size());
+    for (size_t i = 0; i < datas[0].size(); i++) {
+      REQUIRE(datas[0][i]->img_input.size() == datas[2][i]->img_input.size());
+      for (size_t p = 0; p < datas[0][i]->img_input.size(); p++) {
+        CHECK(datas[2][i]->img_input[p]->storage != nullptr);
+        CHECK(cv::norm(datas[0][i]->img_input[p]->data -
+                           datas[2][i]->img_input[p]->data,
+                       cv::NORM_INF) == 0);
+        CHECK(cv::norm(datas[0][i]->img_target[p]->data -
+                           datas[2][i]->img_target[p]->data,
+                       cv::NORM_INF) == 0);
+      }
+    }
+
+    ap.tile_cache_folder = "";
+    ap.training_split_ratio = AppParams().training_split_ratio;
+    factory.clear();
+    std::filesystem::remove_all(folder);
+  }
+
+  SUBCASE("Test images cache") {
+    // 3 parts of 2x2 RGBA floats: 192 bytes per entry
+    auto makeParts = []() {
+      ImageParts parts;
+      for (int i = 0; i < 3; i++) {
+        parts.push_back(std::make_shared<Image>(
+            Image{.data = cv::Mat::zeros(2, 2, CV_32FC4)}));
+      }
+      return parts;
+    };
+    ImageCache cache(2 * 192);
+    ImageParts input;
+    ImageParts target;
+    CHECK_FALSE(cache.get("a", input, target));
+    cache.put("a", makeParts(), {});
+    cache.put("b", makeParts(), {});
+    CHECK(cache.getUsed() == 2 * 192);
+    CHECK(cache.get("a", input, target));
+    CHECK(input.size() == 3);
+    CHECK(target.empty());
+    // b is the least recently used
+    cache.put("c", makeParts(), {});
+    CHECK(cache.getCount() == 2);
+    CHECK(cache.getUsed() == 2 * 192);
+    CHECK_FALSE(cache.get("b", input, target));
+    CHECK(cache.get("c", input, target));
+    // larger than the limit
+    cache.put("d", makeParts(), makeParts());
+    CHECK_FALSE(cache.get("d", input, target));
+    const auto statistics = cache.takeStatistics();
+    CHECK(statistics.hits == 2);
+    CHECK(statistics.misses == 3);
+    CHECK(statistics.evictions == 1);
+    CHECK(cache.takeStatistics().hits == 0);
+
+    // the second epoch hits the cache, with the same images
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.training_split_ratio = 1.0f;
+    ap.random_loading = false;
+    ap.cache_memory_limit = 64;
+    auto &factory = TrainingDataFactory::getInstance();
+    factory.clear();
+    factory.loadData();
+    std::vector<std::shared_ptr<Data>> datas[2];
+    for (auto &epoch : datas) {
+      factory.resetCounters();
+      while (auto data = factory.next(TrainingPhase::Training)) {
+        epoch.push_back(data);
+      }
+    }
+    REQUIRE(datas[0].size() == datas[1].size());
+    for (size_t i = 0; i < datas[0].size(); i++) {
+      CHECK(datas[0][i]->img_input == datas[1][i]->img_input);
+      CHECK(datas[0][i]->img_target == datas[1][i]->img_target);
+    }
+    CHECK_NOTHROW(factory.logCacheStatistics());
+
+    ap.cache_memory_limit = 0;
+    ap.training_split_ratio = AppParams().training_split_ratio;
+    factory.clear();
+  }
+
+  SUBCASE("Test training shards") {
+    auto &manager = Manager::getInstance();
+    auto &ap = manager.app_params;
+    ap.training_data_file = "";
+    ap.training_data_folder = "../data/images/target/";
+    ap.training_split_ratio = 1.0f;
+    ap.random_loading = false;
+    auto &factory = TrainingDataFactory::getInstance();
+    auto loadAll = [&factory]() {
+      std::vector<std::shared_ptr<Data>> datas;
+      factory.clear();
+      factory.loadData();
+      while (auto data = factory.next(TrainingPhase::Training)) {
+        datas.push_back(data);
+      }
+      return datas;
+    };
+    const auto fromFolder = loadAll();
+
+    // 1 byte shards: a shard per image
+    const std::string folder = "tmpShards";
+    const std::string index = folder + "/train.idx";
+    StringPool paths;
+    const auto images = TrainingDataReader().loadTrainingDataFolder(paths);
+    TrainingShardWriter().pack(images, paths, false, index, 1);
+    StringPool recordPaths;
+    bool withInputs = true;
+    auto records =
+        TrainingShardReader::loadIndex(index, recordPaths, withInputs);
+    CHECK_FALSE(withInputs);
+    REQUIRE(records.size() == images.size());
+    CHECK(records.front().shard_file != records.back().shard_file);
+
+    ap.training_data_folder = "";
+    ap.training_data_shards = index;
+    const auto fromShards = loadAll();
+    REQUIRE(fromShards.size() == fromFolder.size());
+    for (size_t i = 0; i < fromShards.size(); i++) {
+      CHECK(fromShards[i]->file_target == fromFolder[i]->file_target);
+      REQUIRE(fromShards[i]->img_target.size() ==
+              fromFolder[i]->img_target.size());
+      for (size_t j = 0; j < fromShards[i]->img_target.size(); j++) {
+        CHECK(cv::norm(fromShards[i]->img_target[j]->data,
+                       fromFolder[i]->img_target[j]->data,
+                       cv::NORM_INF) == 0);
+      }
+    }
+
+    // the shuffle keeps all the records
+    std::mt19937 gen(42);
+    TrainingShardReader::shuffle(records, 2, gen);
+    std::set<std::string> targets;
+    for (const auto &record : records) {
+      targets.insert(std::string(recordPaths.get(record.file_target)));
+    }
+    CHECK(targets.size() == images.size());
+
+    // corrupted record
+    records.front().shard_offset += 1;
+    std::vector<uchar> input;
+    std::vector<uchar> target;
+    CHECK_THROWS_AS(
+        TrainingShardReader().read(records.front(), recordPaths, input, target),
+        FileReaderException);
+
+    ap.training_data_shards = "";
+    ap.training_split_ratio = AppParams().training_split_ratio;
+    factory.clear();
+    std::filesystem::remove_all(folder);
+  }
+
+  SUBCASE("Test training CSV file") {
+    auto &ap = Manager::getInstance().app_params;
+    const std::string file = "tmpTraining.csv";
+    // large enough to be parsed in several chunks
+    constexpr size_t count = 200000;
+    {
+      std::ofstream csv(file);
+      csv << "\"input \"\"0\"\", a.png\",target0.png\r\n\n";
+      for (size_t i = 1; i < count; i++) {
+        csv << "../data/images/input/image" << i
+            << ".png,../data/images/target/image" << i << ".png\n";
+      }
+    }
+    ap.training_data_file = file;
+    StringPool paths;
+    auto datas = TrainingDataReader().loadTrainingDataPaths(paths);
+    REQUIRE(datas.size() == count);
+    CHECK(paths.get(datas[0].file_input) == "input \"0\", a.png");
+    CHECK(paths.get(datas[0].file_target) == "target0.png");
+    for (size_t i : {(size_t)1, count / 2, count - 1}) {
+      CHECK(paths.get(datas[i].file_input) ==
+            "../data/images/input/image" + std::to_string(i) + ".png");
+      CHECK(paths.get(datas[i].file_target) ==
+            "../data/images/target/image" + std::to_string(i) + ".png");
+    }
+
+    // an invalid line, reported with its line number
+    {
+      std::ofstream csv(file, std::ios::app);
+      csv << "a.png,b.png,c.png\n";
+    }
+    try {
+      StringPool invalidPaths;
+      TrainingDataReader().loadTrainingDataPaths(invalidPaths);
+      FAIL("no exception");
+    } catch (const FileReaderException &ex) {
+      CHECK(std::string(ex.what()).find(
+                "at line " + std::to_string(count + 2)) != std::string::npos);
+    }
+
+    ap.training_data_file = "";
+    std::filesystem::remove(file);
+  }
+}